@@ -0,0 +1,352 @@
+#include "benchmark.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "book_demo_scene.h"
+#include "framebuffer.h"
+#include "magic_spheres_scene.h"
+#include "profiler.h"
+#include "rainbow_spheres_scene.h"
+#include "random_spheres_scene.h"
+#include "raytracer.h"
+#include "scene_file.h"
+
+namespace raytrace {
+	namespace {
+		const char* DEFAULT_SCENES = "book,magic,rainbow,spheres_1k,spheres_10k,spheres_100k,spheres_1m";
+		const char* BUILT_IN_SCENES = "book,magic,rainbow";
+		// --validate-fast-math fails past these. A hit that flips at a silhouette can be off by a lot, so single
+		// pixels aren't held to anything. Dense clouds of small spheres are mostly silhouettes and differ the most.
+		const double FAST_MATH_MAX_MEAN_ERROR = 0.1;
+		const double FAST_MATH_MAX_DIFFERING_PIXELS = 0.02;
+
+		// Returns nullptr for unknown names
+		std::unique_ptr<Scene> CreateScene(const std::string& name) {
+			if (name == "book") {
+				return std::make_unique<BookDemoScene>();
+			}
+			if (name == "magic") {
+				return std::make_unique<MagicSpheresScene>();
+			}
+			if (name == "rainbow") {
+				return std::make_unique<RainbowSpheresScene>();
+			}
+			// spheres_<count> is static, animated_<count> moves every sphere each frame
+			for (bool animated : { false, true }) {
+				const std::string prefix = animated ? "animated_" : "spheres_";
+				if (name.compare(0, prefix.size(), prefix) != 0 || name.size() <= prefix.size()) {
+					continue;
+				}
+				char* suffix = nullptr;
+				long count = strtol(name.c_str() + prefix.size(), &suffix, 10);
+				std::string unit = suffix;
+				if (unit == "k") {
+					count *= 1000;
+				}
+				else if (unit == "m") {
+					count *= 1000000;
+				}
+				else if (!unit.empty()) {
+					return nullptr;
+				}
+				if (count <= 0) {
+					return nullptr;
+				}
+				return std::make_unique<RandomSpheresScene>((int)count, 1, animated);
+			}
+			// Anything else is a scene file or a text scene
+			std::unique_ptr<Scene> scene = std::make_unique<Scene>();
+			if (LoadScene(name, *scene) < 0) {
+				return nullptr;
+			}
+			return scene;
+		}
+
+		// The fast math image against the exact one, errors are in 8 bit color steps over all channels
+		struct FastMathResult {
+			double min_ms_per_frame = 0.0;
+			double speedup = 0.0; // Exact min ms/frame over fast min ms/frame
+			int max_error = 0;
+			double mean_error = 0.0;
+			double differing_pixels = 0.0; // Fraction of pixels with any channel off by more than one step
+		};
+
+		struct SceneResult {
+			std::string name;
+			int num_spheres = 0;
+			double load_ms = 0.0; // Building or loading the scene
+			double update_ms = 0.0; // Average Scene::Update, animations only
+			double ms_per_frame = 0.0;
+			double min_ms_per_frame = 0.0;
+			RenderStats stats; // Of a single frame, every frame renders the same image
+			bool validated = false;
+			FastMathResult fast_math;
+		};
+
+		// Scene file paths can hold backslashes
+		std::string EscapeJson(const std::string& text) {
+			std::string escaped;
+			for (char c : text) {
+				if (c == '\\' || c == '"') {
+					escaped += '\\';
+				}
+				escaped += c;
+			}
+			return escaped;
+		}
+
+		// Renders warmup frames, then times frames more. Returns the average and sets min_ms to the fastest.
+		double TimeFrames(RayTracer& rt, Scene* scene, int warmup, int frames, double& min_ms) {
+			// Warmup frames also build the BVH
+			for (int frame = 0; frame < warmup; frame++) {
+				rt.Render(scene);
+				RAYTRACE_PROFILE_FRAME();
+			}
+			double total_ms = 0.0;
+			for (int frame = 0; frame < frames; frame++) {
+				auto start = std::chrono::steady_clock::now();
+				rt.Render(scene);
+				auto end = std::chrono::steady_clock::now();
+				RAYTRACE_PROFILE_FRAME();
+				double ms = std::chrono::duration<double, std::milli>(end - start).count();
+				total_ms += ms;
+				min_ms = frame == 0 ? ms : std::min(min_ms, ms);
+			}
+			return total_ms / frames;
+		}
+
+		void CompareImages(const std::vector<u32>& exact, const Framebuffer& fast, FastMathResult& result) {
+			u64 total_error = 0;
+			u64 differing = 0;
+			int width = fast.GetWidth();
+			for (int y = 0; y < fast.GetHeight(); y++) {
+				const u32* row = fast.Row(y);
+				for (int x = 0; x < width; x++) {
+					u32 a = exact[(size_t)y * width + x];
+					u32 b = row[x];
+					int pixel_error = 0;
+					for (int shift = 0; shift < 24; shift += 8) {
+						int error = std::abs((int)((a >> shift) & 0xFF) - (int)((b >> shift) & 0xFF));
+						total_error += error;
+						pixel_error = std::max(pixel_error, error);
+					}
+					result.max_error = std::max(result.max_error, pixel_error);
+					differing += pixel_error > 1 ? 1 : 0;
+				}
+			}
+			u64 pixels = (u64)width * fast.GetHeight();
+			result.mean_error = (double)total_error / (double)(pixels * 3);
+			result.differing_pixels = (double)differing / (double)pixels;
+		}
+
+		void WriteReport(std::ostream& out, const std::vector<SceneResult>& results, int width, int height,
+			int threads, int frames, int bounces, u64 time_ms, bool packet_tracing, bool fast_math) {
+			out << std::fixed << std::setprecision(3);
+			out << "{\n";
+			out << "  \"width\": " << width << ",\n";
+			out << "  \"height\": " << height << ",\n";
+			out << "  \"threads\": " << threads << ",\n";
+			out << "  \"frames\": " << frames << ",\n";
+			out << "  \"bounces\": " << bounces << ",\n";
+			out << "  \"time_ms\": " << time_ms << ",\n";
+			out << "  \"packet_tracing\": " << (packet_tracing ? "true" : "false") << ",\n";
+			out << "  \"fast_math\": " << (fast_math ? "true" : "false") << ",\n";
+			out << "  \"simd\": \"" << SimdLevelName(DetectSimdLevel()) << "\",\n";
+			out << "  \"scenes\": [\n";
+			for (size_t i = 0; i < results.size(); i++) {
+				const SceneResult& r = results[i];
+				double seconds = r.ms_per_frame * 0.001;
+				out << "    {\n";
+				out << "      \"name\": \"" << EscapeJson(r.name) << "\",\n";
+				out << "      \"spheres\": " << r.num_spheres << ",\n";
+				out << "      \"load_ms\": " << r.load_ms << ",\n";
+				out << "      \"update_ms\": " << r.update_ms << ",\n";
+				out << "      \"ms_per_frame\": " << r.ms_per_frame << ",\n";
+				out << "      \"min_ms_per_frame\": " << r.min_ms_per_frame << ",\n";
+				out << "      \"primary_rays\": " << r.stats.primary_rays << ",\n";
+				out << "      \"shadow_rays\": " << r.stats.shadow_rays << ",\n";
+				out << "      \"reflection_rays\": " << r.stats.reflection_rays << ",\n";
+				out << "      \"intersection_tests\": " << r.stats.intersection_tests << ",\n";
+				out << "      \"occluder_cache_tests\": " << r.stats.occluder_cache_tests << ",\n";
+				out << "      \"occluder_cache_hits\": " << r.stats.occluder_cache_hits << ",\n";
+				out << "      \"occluder_cache_hit_rate\": " << (r.stats.occluder_cache_tests > 0 ? (double)r.stats.occluder_cache_hits / r.stats.occluder_cache_tests : 0.0) << ",\n";
+				out << "      \"primary_rays_per_sec\": " << r.stats.primary_rays / seconds << ",\n";
+				out << "      \"shadow_rays_per_sec\": " << r.stats.shadow_rays / seconds << ",\n";
+				out << "      \"total_rays_per_sec\": " << (r.stats.primary_rays + r.stats.shadow_rays + r.stats.reflection_rays) / seconds << (r.validated ? ",\n" : "\n");
+				if (r.validated) {
+					out << "      \"fast_math\": {\n";
+					out << "        \"min_ms_per_frame\": " << r.fast_math.min_ms_per_frame << ",\n";
+					out << "        \"speedup\": " << r.fast_math.speedup << ",\n";
+					out << "        \"max_error\": " << r.fast_math.max_error << ",\n";
+					out << "        \"mean_error\": " << std::setprecision(5) << r.fast_math.mean_error << ",\n";
+					out << "        \"differing_pixels\": " << r.fast_math.differing_pixels << std::setprecision(3) << "\n";
+					out << "      }\n";
+				}
+				out << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+			}
+			out << "  ]\n";
+			out << "}\n";
+		}
+	} // namespace
+
+	int RunBenchmark(int argc, char* argv[]) {
+		std::string scene_list;
+		std::string output;
+		int width = 640;
+		int height = 360;
+		int threads = ThreadPool::DefaultThreadCount();
+		int bounces = 2;
+		int frames = 5;
+		int warmup = 1;
+		u64 time_ms = 1000;
+		bool packet_tracing = true;
+		bool fast_math = false;
+		bool validate_fast_math = false;
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			if (arg == "--benchmark") {
+				continue;
+			}
+			if (arg == "--scalar") {
+				packet_tracing = false;
+				continue;
+			}
+			if (arg == "--fast-math") {
+				fast_math = true;
+				continue;
+			}
+			if (arg == "--validate-fast-math") {
+				validate_fast_math = true;
+				continue;
+			}
+			if (i + 1 >= argc) {
+				std::cerr << "Missing value for " << arg << std::endl;
+				return -1;
+			}
+			std::string value = argv[++i];
+			if (arg == "--scenes") {
+				scene_list = value;
+			}
+			else if (arg == "--scene-file") {
+				// Windowed mode option, skipped so it can be left on the command line
+			}
+			else if (arg == "--output") {
+				output = value;
+			}
+			else if (arg == "--width") {
+				width = atoi(value.c_str());
+			}
+			else if (arg == "--height") {
+				height = atoi(value.c_str());
+			}
+			else if (arg == "--threads") {
+				threads = atoi(value.c_str());
+			}
+			else if (arg == "--bounces") {
+				bounces = atoi(value.c_str());
+			}
+			else if (arg == "--frames") {
+				frames = atoi(value.c_str());
+			}
+			else if (arg == "--warmup") {
+				warmup = atoi(value.c_str());
+			}
+			else if (arg == "--time") {
+				time_ms = strtoull(value.c_str(), nullptr, 10);
+			}
+			else {
+				std::cerr << "Unknown option " << arg << std::endl;
+				return -1;
+			}
+		}
+		if (width <= 0 || height <= 0 || threads <= 0 || bounces < 0 || frames <= 0 || warmup < 0) {
+			std::cerr << "Width, height, threads and frames must be positive and bounces can't be negative" << std::endl;
+			return -1;
+		}
+
+		if (scene_list.empty()) {
+			scene_list = validate_fast_math ? BUILT_IN_SCENES : DEFAULT_SCENES;
+		}
+
+		std::vector<std::string> scene_names;
+		std::stringstream names(scene_list);
+		std::string name;
+		while (std::getline(names, name, ',')) {
+			if (!name.empty()) {
+				scene_names.push_back(name);
+			}
+		}
+
+		Framebuffer framebuffer(width, height);
+		std::vector<SceneResult> results;
+		bool validation_failed = false;
+		for (const std::string& scene_name : scene_names) {
+			// Scenes are built one at a time so the big ones don't all sit in memory together
+			auto load_start = std::chrono::steady_clock::now();
+			std::unique_ptr<Scene> scene = CreateScene(scene_name);
+			auto load_end = std::chrono::steady_clock::now();
+			if (!scene) {
+				std::cerr << "Unknown scene \"" << scene_name << "\"" << std::endl;
+				return -1;
+			}
+			RayTracer rt(&framebuffer, scene.get());
+			rt.SetThreadCount(threads);
+			rt.SetMaxBounces(bounces);
+			rt.SetPacketTracing(packet_tracing);
+			rt.SetFastMath(fast_math && !validate_fast_math);
+			// Updated as often as frames are measured, always to the same time so every frame renders the same image
+			scene->Update(0.0f, time_ms);
+			auto update_start = std::chrono::steady_clock::now();
+			for (int frame = 0; frame < frames; frame++) {
+				scene->Update(0.0f, time_ms);
+			}
+			auto update_end = std::chrono::steady_clock::now();
+
+			SceneResult result;
+			result.name = scene_name;
+			result.num_spheres = scene->sphere_store_.Size();
+			result.load_ms = std::chrono::duration<double, std::milli>(load_end - load_start).count();
+			result.update_ms = std::chrono::duration<double, std::milli>(update_end - update_start).count() / std::max(frames, 1);
+			result.ms_per_frame = TimeFrames(rt, scene.get(), warmup, frames, result.min_ms_per_frame);
+			result.stats = rt.GetLastFrameStats();
+			if (validate_fast_math) {
+				// The exact kernel ran first, keep its image and render again with the fast one
+				std::vector<u32> exact_image((size_t)width * height);
+				for (int y = 0; y < height; y++) {
+					std::copy(framebuffer.Row(y), framebuffer.Row(y) + width, exact_image.begin() + (size_t)y * width);
+				}
+				rt.SetFastMath(true);
+				TimeFrames(rt, scene.get(), warmup, frames, result.fast_math.min_ms_per_frame);
+				result.fast_math.speedup = result.min_ms_per_frame / std::max(result.fast_math.min_ms_per_frame, 1e-6);
+				CompareImages(exact_image, framebuffer, result.fast_math);
+				result.validated = true;
+				if (result.fast_math.mean_error > FAST_MATH_MAX_MEAN_ERROR || result.fast_math.differing_pixels > FAST_MATH_MAX_DIFFERING_PIXELS) {
+					std::cerr << "Fast math is off by too much in " << scene_name << ": mean error " << result.fast_math.mean_error
+						<< ", " << result.fast_math.differing_pixels * 100.0 << "% of pixels differ" << std::endl;
+					validation_failed = true;
+				}
+			}
+			results.push_back(result);
+		}
+
+		if (output.empty()) {
+			WriteReport(std::cout, results, width, height, threads, frames, bounces, time_ms, packet_tracing, fast_math);
+			return validation_failed ? -1 : 0;
+		}
+		std::ofstream file(output);
+		if (!file.is_open()) {
+			std::cerr << "Could not open \"" << output << "\" for writing" << std::endl;
+			return -1;
+		}
+		WriteReport(file, results, width, height, threads, frames, bounces, time_ms, packet_tracing, fast_math);
+		return file.good() && !validation_failed ? 0 : -1;
+	}
+} // namespace raytrace
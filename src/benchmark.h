@@ -0,0 +1,15 @@
+#pragma once
+#ifndef RAYTRACE_BENCHMARK_H_
+#define	RAYTRACE_BENCHMARK_H_
+
+namespace raytrace {
+	// Renders a list of scenes on the CPU at a fixed resolution and animation time and reports
+	// ms/frame, rays/sec and intersection tests as JSON.
+	// Options: --scenes book,magic,rainbow,spheres_1k,... (spheres_<count> takes k and m suffixes, anything else is loaded with LoadScene),
+	// --width, --height, --threads, --frames, --warmup, --time ms, --scalar, --fast-math, --output file.json (default stdout)
+	// --validate-fast-math renders every scene with the exact and the fast math kernels (the built-in scenes
+	// by default) and adds the speedup and the pixel error between the two to the report.
+	// Returns 0 on success, -1 on bad arguments, if the report could not be written or the fast math image is off by too much.
+	int RunBenchmark(int argc, char* argv[]);
+} // namespace raytrace
+#endif // RAYTRACE_BENCHMARK_H_
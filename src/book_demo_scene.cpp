@@ -0,0 +1,14 @@
+#include "book_demo_scene.h"
+
+namespace raytrace {
+
+	BookDemoScene::BookDemoScene() {
+		AddSphere(red_sphere_ref);
+		AddSphere(blue_sphere_ref);
+		AddSphere(green_sphere_ref);
+		AddSphere(yellow_sphere_ref);
+		AddLight(ambient_light_ref);
+		AddLight(point_light_ref);
+		AddLight(directional_light_ref);
+	}
+}
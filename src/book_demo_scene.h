@@ -0,0 +1,23 @@
+#pragma once
+#ifndef RAYTRACE_BOOK_DEMO_SCENE_H_
+#define	RAYTRACE_BOOK_DEMO_SCENE_H_
+
+#include "scene.h"
+
+namespace raytrace {
+	// The scene from Computer Graphics From Scratch, nothing moves
+	class BookDemoScene : public Scene {
+	public:
+		BookDemoScene();
+
+	private:
+		std::shared_ptr<Sphere> red_sphere_ref = std::make_shared<Sphere>(vec3(0.0f, -1.0f, 3.0f), 1.0f, Color(0xFF, 0x0, 0x0), 500, 0.2f);
+		std::shared_ptr<Sphere> blue_sphere_ref = std::make_shared<Sphere>(vec3(2.0f, 0.0f, 4.0f), 1.0f, Color(0x0, 0x0, 0xFF), 500, 0.3f);
+		std::shared_ptr<Sphere> green_sphere_ref = std::make_shared<Sphere>(vec3(-2.0f, 0.0f, 4.0f), 1.0f, Color(0x0, 0xFF, 0x0), 10, 0.4f);
+		std::shared_ptr<Sphere> yellow_sphere_ref = std::make_shared<Sphere>(vec3(0.0f, -5001.0f, 0.0f), 5000.0f, Color(0xFF, 0xFF, 0x0), 1000, 0.5f);
+		std::shared_ptr<Light> ambient_light_ref = std::make_shared<Light>(Light::AmbientLight(0.2f));
+		std::shared_ptr<Light> point_light_ref = std::make_shared<Light>(Light::PointLight(0.6f, vec3(2, 1, 0)));
+		std::shared_ptr<Light> directional_light_ref = std::make_shared<Light>(Light::DirectionalLight(0.2f, vec3(1, 4, 4)));
+	};
+} // namespace raytrace
+#endif // RAYTRACE_BOOK_DEMO_SCENE_H_
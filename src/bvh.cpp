@@ -0,0 +1,297 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace raytrace {
+	namespace {
+		struct Bounds {
+			vec3 min = vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+			vec3 max = vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+			void Grow(vec3 point) {
+				min = vec3(std::min(min.x, point.x), std::min(min.y, point.y), std::min(min.z, point.z));
+				max = vec3(std::max(max.x, point.x), std::max(max.y, point.y), std::max(max.z, point.z));
+			}
+			void Grow(const Bounds& other) {
+				Grow(other.min);
+				Grow(other.max);
+			}
+			void GrowSphere(vec3 center, float radius) {
+				Grow(center - vec3(radius, radius, radius));
+				Grow(center + vec3(radius, radius, radius));
+			}
+			// Half the surface area, the SAH only needs ratios
+			float HalfArea() const {
+				if (min.x > max.x) {
+					return 0.0f;
+				}
+				vec3 extent = max - min;
+				return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+			}
+		};
+		float Axis(vec3 v, int axis) {
+			return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+		}
+		void WriteBounds(BvhNode& node, const Bounds& bounds) {
+			node.bounds_min[0] = bounds.min.x;
+			node.bounds_min[1] = bounds.min.y;
+			node.bounds_min[2] = bounds.min.z;
+			node.bounds_max[0] = bounds.max.x;
+			node.bounds_max[1] = bounds.max.y;
+			node.bounds_max[2] = bounds.max.z;
+		}
+		Bounds ReadBounds(const BvhNode& node) {
+			Bounds bounds;
+			bounds.min = vec3(node.bounds_min[0], node.bounds_min[1], node.bounds_min[2]);
+			bounds.max = vec3(node.bounds_max[0], node.bounds_max[1], node.bounds_max[2]);
+			return bounds;
+		}
+
+		struct BuildContext {
+			const std::vector<vec3>& centers; // Indexed by SphereStore index
+			const std::vector<float>& radii;
+			std::vector<int>& indices;
+			std::vector<BvhNode>& nodes;
+		};
+
+		void BuildNode(BuildContext& ctx, int node_index, int first, int count, int depth) {
+			Bounds bounds;
+			Bounds centroid_bounds;
+			for (int i = first; i < first + count; i++) {
+				int sphere = ctx.indices[i];
+				bounds.GrowSphere(ctx.centers[sphere], ctx.radii[sphere]);
+				centroid_bounds.Grow(ctx.centers[sphere]);
+			}
+			WriteBounds(ctx.nodes[node_index], bounds);
+			if (count <= Bvh::MAX_LEAF_SIZE || depth >= Bvh::MAX_DEPTH - 1) {
+				ctx.nodes[node_index].first = first;
+				ctx.nodes[node_index].count = count;
+				return;
+			}
+
+			// Binned SAH, cost of a split is area * sphere count summed over both sides
+			float best_cost = FLT_MAX;
+			int best_axis = -1;
+			int best_split = 0;
+			for (int axis = 0; axis < 3; axis++) {
+				float axis_min = Axis(centroid_bounds.min, axis);
+				float extent = Axis(centroid_bounds.max, axis) - axis_min;
+				if (extent <= 0.0f) {
+					continue;
+				}
+				Bounds bin_bounds[Bvh::SAH_BINS];
+				int bin_counts[Bvh::SAH_BINS] = {};
+				float scale = Bvh::SAH_BINS / extent;
+				for (int i = first; i < first + count; i++) {
+					int sphere = ctx.indices[i];
+					int bin = std::min(Bvh::SAH_BINS - 1, (int)((Axis(ctx.centers[sphere], axis) - axis_min) * scale));
+					bin_bounds[bin].GrowSphere(ctx.centers[sphere], ctx.radii[sphere]);
+					bin_counts[bin]++;
+				}
+				float left_area[Bvh::SAH_BINS];
+				int left_count[Bvh::SAH_BINS];
+				Bounds sweep;
+				int sweep_count = 0;
+				for (int bin = 0; bin < Bvh::SAH_BINS - 1; bin++) {
+					sweep.Grow(bin_bounds[bin]);
+					sweep_count += bin_counts[bin];
+					left_area[bin] = sweep.HalfArea();
+					left_count[bin] = sweep_count;
+				}
+				sweep = Bounds();
+				sweep_count = 0;
+				for (int bin = Bvh::SAH_BINS - 1; bin > 0; bin--) {
+					sweep.Grow(bin_bounds[bin]);
+					sweep_count += bin_counts[bin];
+					if (left_count[bin - 1] == 0 || sweep_count == 0) {
+						continue;
+					}
+					float cost = left_area[bin - 1] * left_count[bin - 1] + sweep.HalfArea() * sweep_count;
+					if (cost < best_cost) {
+						best_cost = cost;
+						best_axis = axis;
+						best_split = bin;
+					}
+				}
+			}
+
+			int middle = first + count / 2;
+			if (best_axis != -1) {
+				float axis_min = Axis(centroid_bounds.min, best_axis);
+				float scale = Bvh::SAH_BINS / (Axis(centroid_bounds.max, best_axis) - axis_min);
+				int* split = std::partition(ctx.indices.data() + first, ctx.indices.data() + first + count, [&](int sphere) {
+					return std::min(Bvh::SAH_BINS - 1, (int)((Axis(ctx.centers[sphere], best_axis) - axis_min) * scale)) < best_split;
+				});
+				middle = (int)(split - ctx.indices.data());
+			}
+			if (best_axis == -1 || middle == first || middle == first + count) {
+				// Every centroid landed in one place, fall back to an even split
+				middle = first + count / 2;
+			}
+
+			int left = (int)ctx.nodes.size();
+			ctx.nodes.emplace_back();
+			ctx.nodes.emplace_back();
+			ctx.nodes[node_index].first = left;
+			ctx.nodes[node_index].count = 0;
+			BuildNode(ctx, left, first, middle - first, depth + 1);
+			BuildNode(ctx, left + 1, middle, first + count - middle, depth + 1);
+		}
+	} // namespace
+
+	void Bvh::Build(const SphereStore& store) {
+		int count = store.Size();
+		store_id_ = store.GetId();
+		store_generation_ = store.GetGeneration();
+		sphere_indices_.resize(count);
+		std::iota(sphere_indices_.begin(), sphere_indices_.end(), 0);
+		nodes_.clear();
+		if (count == 0) {
+			GatherLeafGeometry(store);
+			cost_ = built_cost_ = 0.0f;
+			return;
+		}
+		std::vector<vec3> centers(count);
+		std::vector<float> radii(count);
+		for (int i = 0; i < count; i++) {
+			centers[i] = store.GetCenter(i);
+			radii[i] = store.GetRadius(i);
+		}
+		nodes_.reserve(2 * (count / MAX_LEAF_SIZE + 1));
+		nodes_.emplace_back();
+		BuildContext ctx = { centers, radii, sphere_indices_, nodes_ };
+		BuildNode(ctx, 0, 0, count, 0);
+
+		GatherLeafGeometry(store);
+		cost_ = built_cost_ = ComputeCost();
+	}
+
+	// Keeps the tree shape and recomputes every bounding box from the spheres' current positions
+	void Bvh::Refit(const SphereStore& store) {
+		store_id_ = store.GetId();
+		store_generation_ = store.GetGeneration();
+		GatherLeafGeometry(store);
+		for (int i = (int)nodes_.size() - 1; i >= 0; i--) {
+			BvhNode& node = nodes_[i];
+			Bounds bounds;
+			if (node.count > 0) {
+				for (int p = node.first; p < node.first + node.count; p++) {
+					bounds.GrowSphere(vec3(center_x_[p], center_y_[p], center_z_[p]), radius_[p]);
+				}
+			}
+			else {
+				// Children come after their parent so they are already refit
+				bounds = ReadBounds(nodes_[node.first]);
+				bounds.Grow(ReadBounds(nodes_[node.first + 1]));
+			}
+			WriteBounds(node, bounds);
+		}
+		cost_ = ComputeCost();
+	}
+
+	void Bvh::Update(const SphereStore& store) {
+		if (store.GetId() == store_id_ && store.GetGeneration() == store_generation_ && store.Size() == (int)sphere_indices_.size()) {
+			return;
+		}
+		if (store.Size() != (int)sphere_indices_.size()) {
+			Build(store);
+			return;
+		}
+		Refit(store);
+		if (cost_ > built_cost_ * REBUILD_COST_RATIO) {
+			Build(store);
+		}
+	}
+
+	u64 Bvh::IntersectPacket(const RayPacket& packet, PacketHits& hits, bool fast_math) const {
+		for (int lane = 0; lane < packet.num_rays; lane++) {
+			hits.t[lane] = FLT_MAX;
+			hits.sphere[lane] = -1;
+		}
+		// t_max of each ray drops to its closest hit so far, later leaves only report closer hits
+		RayPacket rays = packet;
+		u64 tests = 0;
+		TraversePacket(rays, [&](int first, int count) {
+			tests += (u64)count * rays.num_rays;
+			PacketHits leaf_hits;
+			raytrace::IntersectPacket(rays, LeafGeometry(first, count), leaf_hits, fast_math);
+			for (int lane = 0; lane < rays.num_rays; lane++) {
+				if (leaf_hits.sphere[lane] != -1) {
+					hits.t[lane] = leaf_hits.t[lane];
+					hits.sphere[lane] = SphereIndex(first + leaf_hits.sphere[lane]);
+					rays.t_max[lane] = leaf_hits.t[lane];
+				}
+			}
+			return false;
+		});
+		return tests;
+	}
+
+	u64 Bvh::OccludedPacket(const RayPacket& packet, int* occluders, bool fast_math) const {
+		int num_active = 0;
+		for (int lane = 0; lane < packet.num_rays; lane++) {
+			occluders[lane] = -1;
+			if (packet.t_min[lane] <= packet.t_max[lane]) {
+				num_active++;
+			}
+		}
+		if (num_active == 0) {
+			return 0;
+		}
+		RayPacket rays = packet;
+		int num_occluded = 0;
+		u64 tests = 0;
+		TraversePacket(rays, [&](int first, int count) {
+			tests += (u64)count * rays.num_rays;
+			PacketHits leaf_hits;
+			raytrace::IntersectPacket(rays, LeafGeometry(first, count), leaf_hits, fast_math);
+			for (int lane = 0; lane < rays.num_rays; lane++) {
+				if (leaf_hits.sphere[lane] != -1) {
+					occluders[lane] = SphereIndex(first + leaf_hits.sphere[lane]);
+					num_occluded++;
+					// An empty interval drops the ray out of every later bounds and sphere test
+					rays.t_max[lane] = -FLT_MAX;
+				}
+			}
+			return num_occluded == num_active;
+		});
+		return tests;
+	}
+
+	void Bvh::GatherLeafGeometry(const SphereStore& store) {
+		int count = (int)sphere_indices_.size();
+		center_x_.resize(count);
+		center_y_.resize(count);
+		center_z_.resize(count);
+		radius_.resize(count);
+		radius_sq_.resize(count);
+		for (int p = 0; p < count; p++) {
+			int sphere = sphere_indices_[p];
+			vec3 center = store.GetCenter(sphere);
+			center_x_[p] = center.x;
+			center_y_[p] = center.y;
+			center_z_[p] = center.z;
+			radius_[p] = store.GetRadius(sphere);
+			radius_sq_[p] = store.GetRadiusSquared(sphere);
+		}
+	}
+
+	// SAH cost of the whole tree relative to the root's area
+	float Bvh::ComputeCost() const {
+		if (nodes_.empty()) {
+			return 0.0f;
+		}
+		float root_area = ReadBounds(nodes_[0]).HalfArea();
+		if (root_area <= 0.0f) {
+			return 0.0f;
+		}
+		const float TRAVERSAL_COST = 1.0f;
+		float cost = 0.0f;
+		for (const BvhNode& node : nodes_) {
+			float area = ReadBounds(node).HalfArea();
+			cost += node.count > 0 ? area * node.count : area * TRAVERSAL_COST;
+		}
+		return cost / root_area;
+	}
+} // namespace raytrace
@@ -0,0 +1,184 @@
+#pragma once
+#ifndef RAYTRACE_BVH_H_
+#define	RAYTRACE_BVH_H_
+
+#include <cfloat>
+#include <vector>
+
+#include "ray_packet.h"
+#include "sphere_store.h"
+#include "types.h"
+
+namespace raytrace {
+	struct BvhNode { // 32 bytes
+		float bounds_min[3];
+		float bounds_max[3];
+		int first; // Leaf: first sphere in leaf order. Interior: index of the left child, the right child follows it
+		int count; // Number of spheres in a leaf, 0 for interior nodes
+	};
+
+	// Bounding volume hierarchy over the spheres of a SphereStore.
+	// Static scenes get a binned SAH build. Animated scenes keep the tree and only refit
+	// the bounds each frame, until the refitted tree has degraded enough to rebuild it.
+	class Bvh {
+	public:
+		static const int MAX_LEAF_SIZE = 4;
+		static const int SAH_BINS = 16;
+		static const int MAX_DEPTH = 64;
+		// A refit tree is rebuilt once its SAH cost grows past this factor of a fresh build
+		static constexpr float REBUILD_COST_RATIO = 1.5f;
+
+		void Build(const SphereStore& store);
+		void Refit(const SphereStore& store);
+		// Call once per frame before tracing, refits or rebuilds as needed. Does nothing if the store hasn't changed
+		// since the last build or refit.
+		void Update(const SphereStore& store);
+
+		// Spheres copied into leaf order so a leaf is one contiguous run
+		SphereGeometry LeafGeometry(int first, int count) const {
+			SphereGeometry geometry;
+			geometry.center_x = center_x_.data() + first;
+			geometry.center_y = center_y_.data() + first;
+			geometry.center_z = center_z_.data() + first;
+			geometry.radius_sq = radius_sq_.data() + first;
+			geometry.count = count;
+			return geometry;
+		}
+		// Maps a leaf order position back to the SphereStore index
+		int SphereIndex(int leaf_position) const { return sphere_indices_[leaf_position]; };
+		const std::vector<BvhNode>& GetNodes() const { return nodes_; };
+		float GetCost() const { return cost_; };
+
+		// Closest hit of every ray in the packet, sphere indices are SphereStore indices.
+		// Returns the number of ray-sphere tests that were done. fast_math picks the kernel, see raytrace::IntersectPacket.
+		u64 IntersectPacket(const RayPacket& packet, PacketHits& hits, bool fast_math = false) const;
+		// Any-hit version for shadow rays, occluders[lane] is set to some sphere within the ray's (t_min, t_max)
+		// or -1. Rays with an empty interval are skipped and traversal stops once every other ray is blocked.
+		// Returns the number of ray-sphere tests that were done.
+		u64 OccludedPacket(const RayPacket& packet, int* occluders, bool fast_math = false) const;
+
+		// Calls visit_leaf(first, count) for every leaf the ray segment (t_min, t_max) passes through,
+		// nearer children first. visit_leaf may shrink t_max to the closest hit found so far,
+		// returning true stops the traversal.
+		template <typename VisitLeaf>
+		void Traverse(vec3 origin, vec3 direction, float t_min, float& t_max, VisitLeaf visit_leaf) const {
+			if (nodes_.empty()) {
+				return;
+			}
+			float inv_dir[3] = { 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z };
+			float o[3] = { origin.x, origin.y, origin.z };
+			int stack[MAX_DEPTH * 2];
+			int stack_size = 0;
+			stack[stack_size++] = 0;
+			while (stack_size > 0) {
+				const BvhNode& node = nodes_[stack[--stack_size]];
+				if (!HitsBounds(node, o, inv_dir, t_min, t_max)) {
+					continue;
+				}
+				if (node.count > 0) {
+					if (visit_leaf(node.first, node.count)) {
+						return;
+					}
+					continue;
+				}
+				// Visit the child whose center is in front first
+				const BvhNode& left = nodes_[node.first];
+				const BvhNode& right = nodes_[node.first + 1];
+				float left_distance = CenterDistance(left, o, direction);
+				float right_distance = CenterDistance(right, o, direction);
+				if (left_distance < right_distance) {
+					stack[stack_size++] = node.first + 1;
+					stack[stack_size++] = node.first;
+				}
+				else {
+					stack[stack_size++] = node.first;
+					stack[stack_size++] = node.first + 1;
+				}
+			}
+		}
+
+		// Packet version of Traverse, a node is entered when any ray of the packet overlaps it.
+		// visit_leaf may lower packet.t_max per ray, returning true stops the traversal.
+		template <typename VisitLeaf>
+		void TraversePacket(RayPacket& packet, VisitLeaf visit_leaf) const {
+			if (nodes_.empty()) {
+				return;
+			}
+			float inv_x[RayPacket::MAX_RAYS], inv_y[RayPacket::MAX_RAYS], inv_z[RayPacket::MAX_RAYS];
+			vec3 average_direction;
+			for (int lane = 0; lane < packet.num_rays; lane++) {
+				inv_x[lane] = 1.0f / packet.direction_x[lane];
+				inv_y[lane] = 1.0f / packet.direction_y[lane];
+				inv_z[lane] = 1.0f / packet.direction_z[lane];
+				average_direction = average_direction + vec3(packet.direction_x[lane], packet.direction_y[lane], packet.direction_z[lane]);
+			}
+			vec3 average_origin(packet.origin_x[0], packet.origin_y[0], packet.origin_z[0]);
+			int stack[MAX_DEPTH * 2];
+			int stack_size = 0;
+			stack[stack_size++] = 0;
+			while (stack_size > 0) {
+				const BvhNode& node = nodes_[stack[--stack_size]];
+				bool any_hit = false;
+				for (int lane = 0; lane < packet.num_rays && !any_hit; lane++) {
+					float o[3] = { packet.origin_x[lane], packet.origin_y[lane], packet.origin_z[lane] };
+					float inv_dir[3] = { inv_x[lane], inv_y[lane], inv_z[lane] };
+					any_hit = HitsBounds(node, o, inv_dir, packet.t_min[lane], packet.t_max[lane]);
+				}
+				if (!any_hit) {
+					continue;
+				}
+				if (node.count > 0) {
+					if (visit_leaf(node.first, node.count)) {
+						return;
+					}
+					continue;
+				}
+				float o[3] = { average_origin.x, average_origin.y, average_origin.z };
+				float left_distance = CenterDistance(nodes_[node.first], o, average_direction);
+				float right_distance = CenterDistance(nodes_[node.first + 1], o, average_direction);
+				if (left_distance < right_distance) {
+					stack[stack_size++] = node.first + 1;
+					stack[stack_size++] = node.first;
+				}
+				else {
+					stack[stack_size++] = node.first;
+					stack[stack_size++] = node.first + 1;
+				}
+			}
+		}
+
+	private:
+		// Slab test, a NaN from a ray lying in a slab plane drops out of the min/max and counts as a hit
+		static bool HitsBounds(const BvhNode& node, const float o[3], const float inv_dir[3], float t_min, float t_max) {
+			for (int axis = 0; axis < 3; axis++) {
+				float t0 = (node.bounds_min[axis] - o[axis]) * inv_dir[axis];
+				float t1 = (node.bounds_max[axis] - o[axis]) * inv_dir[axis];
+				t_min = std::max(t_min, std::min(t0, t1));
+				t_max = std::min(t_max, std::max(t0, t1));
+			}
+			return t_min <= t_max;
+		}
+		static float CenterDistance(const BvhNode& node, const float o[3], vec3 direction) {
+			vec3 center((node.bounds_min[0] + node.bounds_max[0]) * 0.5f - o[0],
+				(node.bounds_min[1] + node.bounds_max[1]) * 0.5f - o[1],
+				(node.bounds_min[2] + node.bounds_max[2]) * 0.5f - o[2]);
+			return center.dot(direction);
+		}
+		void GatherLeafGeometry(const SphereStore& store);
+		float ComputeCost() const;
+
+		std::vector<BvhNode> nodes_; // Children always come after their parent
+		std::vector<int> sphere_indices_;
+		std::vector<float> center_x_;
+		std::vector<float> center_y_;
+		std::vector<float> center_z_;
+		std::vector<float> radius_;
+		std::vector<float> radius_sq_;
+		float cost_ = 0.0f;
+		float built_cost_ = 0.0f;
+		// SphereStore::GetId and GetGeneration of the store the tree was last built or refit from
+		u64 store_id_ = 0;
+		u64 store_generation_ = 0;
+	};
+} // namespace raytrace
+#endif // RAYTRACE_BVH_H_
@@ -24,7 +24,7 @@ namespace raytrace {
 		vec3 forward = vec3(0.0f, 0.0f, 1.0f); // Based on RayTracer::CanvasToViewport having +Z looking forward
 		vec3 up = vec3(0.0f, 1.0f, 0.0f); // unused currently
 		vec3 right = vec3(-1.0f, 0.0f, 0.0f);
-		Mat4 RotationX() {
+		Mat4 RotationX() const {
 			float cam_rot[4][4] = {
 				{1, 0, 0, 0},
 				{0, cos(Radians(pitch)), -sin(Radians(pitch)), 0},
@@ -33,7 +33,7 @@ namespace raytrace {
 			};
 			return Mat4(cam_rot);
 		}
-		Mat4 RotationY() {
+		Mat4 RotationY() const {
 			float cam_rot[4][4] = {
 				{cos(Radians(yaw)), 0, -sin(Radians(yaw)), 0},
 				{0, 1, 0, 0},
@@ -42,7 +42,7 @@ namespace raytrace {
 			};
 			return Mat4(cam_rot);
 		}
-		Mat4 RotationZ() {
+		Mat4 RotationZ() const {
 			float cam_rot[4][4] = {
 				{cos(Radians(roll)), -sin(Radians(roll)), 0, 0},
 				{sin(Radians(roll)), cos(Radians(roll)), 0, 0},
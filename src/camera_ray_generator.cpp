@@ -0,0 +1,52 @@
+#include "camera_ray_generator.h"
+
+#include <math.h>
+
+namespace raytrace {
+
+	void CameraRayGenerator::Setup(const Camera& camera, int canvas_width, int canvas_height, float viewport_height, float dist_to_viewport) {
+		origin_ = camera.position;
+		rotation_x_ = camera.RotationX();
+		rotation_y_ = camera.RotationY();
+
+		float pixel_size = viewport_height / (float)canvas_height;
+		column_step_ = rotation_y_ * (rotation_x_ * vec3(pixel_size, 0.0f, 0.0f));
+		row_step_ = rotation_y_ * (rotation_x_ * vec3(0.0f, pixel_size, 0.0f));
+		forward_ = rotation_y_ * (rotation_x_ * vec3(0.0f, 0.0f, dist_to_viewport));
+
+		// The canvas has 0,0 at the center with y pointing up, rows go top to bottom.
+		// For odd sizes the range is one larger on the positive side.
+		left_ = (float)(-(canvas_width / 2));
+		top_ = (float)(canvas_height - 1 - canvas_height / 2);
+		top_left_ = forward_ + column_step_ * left_ + row_step_ * top_;
+
+		// The steps and forward are perpendicular, so once a direction is scaled to end on the viewport
+		// each pixel coordinate is a dot product
+		float forward_length_sq = forward_.dot(forward_);
+		forward_length_ = sqrtf(forward_length_sq);
+		forward_axis_ = forward_ / forward_length_sq;
+		column_axis_ = column_step_ / column_step_.dot(column_step_);
+		row_axis_ = row_step_ / row_step_.dot(row_step_);
+	}
+
+	bool CameraRayGenerator::Project(vec3 direction, float& column, float& row, float& depth) const {
+		float along = direction.dot(forward_axis_);
+		if (along <= 0.0f) {
+			return false;
+		}
+		float scale = 1.0f / along;
+		column = scale * direction.dot(column_axis_) - left_;
+		row = top_ - scale * direction.dot(row_axis_);
+		depth = along * forward_length_;
+		return true;
+	}
+
+	void CameraRayGenerator::AddBlock(RayPacket& packet, int column_start, int column_end, int row_start, int row_end, float t_min, float t_max) const {
+		for (int row = row_start; row < row_end; row++) {
+			vec3 row_start_direction = RowStart(row);
+			for (int column = column_start; column < column_end; column++) {
+				packet.AddRay(origin_, row_start_direction + column_step_ * (float)column, t_min, t_max);
+			}
+		}
+	}
+} // namespace raytrace
@@ -0,0 +1,54 @@
+#pragma once
+#ifndef RAYTRACE_CAMERA_RAY_GENERATOR_H_
+#define	RAYTRACE_CAMERA_RAY_GENERATOR_H_
+
+#include "camera.h"
+#include "ray_packet.h"
+#include "types.h"
+
+namespace raytrace {
+	// Primary rays of one frame. Setup builds the camera rotations once, after that the direction
+	// through any pixel is a couple of vector adds instead of two matrix products.
+	// Directions aren't normalized, they point at the pixel on the viewport plane.
+	class CameraRayGenerator {
+	public:
+		// viewport_height and dist_to_viewport are in world units, pixels are square
+		void Setup(const Camera& camera, int canvas_width, int canvas_height, float viewport_height, float dist_to_viewport);
+
+		vec3 GetOrigin() const { return origin_; };
+		// Same matrices the GPU path uploads as u_Camera_Rotation_Matrix_X/Y
+		const Mat4& GetRotationX() const { return rotation_x_; };
+		const Mat4& GetRotationY() const { return rotation_y_; };
+
+		// Direction of the ray through pixel (0, row), add column * ColumnStep() to move along the row
+		vec3 RowStart(int row) const { return top_left_ - row_step_ * (float)row; };
+		vec3 ColumnStep() const { return column_step_; };
+		vec3 Direction(int column, int row) const { return RowStart(row) + column_step_ * (float)column; };
+		// Moves a direction by a fraction of a pixel, rows go down
+		vec3 Offset(float columns, float rows) const { return column_step_ * columns - row_step_ * rows; };
+
+		// Where a direction from the origin crosses the canvas, in pixels. depth is the distance along the view axis.
+		// Returns false for directions that don't point in front of the camera.
+		bool Project(vec3 direction, float& column, float& row, float& depth) const;
+
+		// Adds the rays of pixels [column_start, column_end) x [row_start, row_end) to the packet row by row
+		void AddBlock(RayPacket& packet, int column_start, int column_end, int row_start, int row_end, float t_min, float t_max) const;
+
+	private:
+		vec3 origin_;
+		Mat4 rotation_x_ = Mat4::Identity();
+		Mat4 rotation_y_ = Mat4::Identity();
+		vec3 forward_; // Center of the viewport
+		float left_ = 0.0f; // Viewport position of pixel (0, 0) in pixels
+		float top_ = 0.0f;
+		// Used by Project
+		vec3 forward_axis_;
+		vec3 column_axis_;
+		vec3 row_axis_;
+		float forward_length_ = 1.0f;
+		vec3 top_left_; // Direction through pixel (0, 0)
+		vec3 column_step_; // One pixel to the right
+		vec3 row_step_; // One pixel up
+	};
+} // namespace raytrace
+#endif // RAYTRACE_CAMERA_RAY_GENERATOR_H_
@@ -0,0 +1,130 @@
+#pragma once
+#ifndef RAYTRACE_FAST_MATH_H_
+#define	RAYTRACE_FAST_MATH_H_
+
+#include <algorithm>
+#include <cfloat>
+#include <math.h>
+
+#include "simd.h"
+#include "types.h"
+
+// Cheaper versions of the math RayTracer shades and intersects with, used when RayTracer::SetFastMath is on, and the
+// trig SphereAnimator evaluates for every animated sphere. Results are a few ulps off the exact versions, run the
+// benchmark with --validate-fast-math to see what that does to the image.
+namespace raytrace {
+	// x^n for n >= 0 by squaring, at most 2 * log2(n) multiplies where pow goes through exp and log
+	inline float PowInt(float x, int n) {
+		float result = 1.0f;
+		while (n > 0) {
+			if (n & 1) {
+				result *= x;
+			}
+			x *= x;
+			n >>= 1;
+		}
+		return result;
+	}
+
+	// 1 / sqrt(x) for x > 0. The hardware estimate is good to 12 bits, one Newton-Raphson step brings it to about 22.
+	inline float RsqrtFast(float x) {
+#ifdef RAYTRACE_X86
+		float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+		return y * (1.5f - 0.5f * x * y * y);
+#else
+		return 1.0f / sqrtf(x);
+#endif
+	}
+
+	// RayTracer::IntersectRaySphere with half of b, so one sqrt and no division. a is direction.dot(direction) and inv_a
+	// is 1 / a, they are the same for every sphere a ray is tested against so callers work them out once per ray.
+	// For unit length directions both are 1 and this is the usual normalized-direction test.
+	inline vec2 IntersectRaySphereFast(vec3 o, vec3 direction, float a, float inv_a, vec3 center, float radius_sq) {
+		vec3 CO = o - center;
+		float half_b = CO.dot(direction);
+		float c = CO.dot(CO) - radius_sq;
+		float discriminant = half_b * half_b - a * c;
+		if (discriminant < 0) {
+			return vec2(FLT_MAX, FLT_MAX);
+		}
+		float root = sqrtf(discriminant);
+		return vec2((-half_b + root) * inv_a, (-half_b - root) * inv_a);
+	}
+
+	namespace fast_trig {
+		const float PI = 3.14159265f;
+		const float HALF_PI = 1.57079633f;
+		const float INV_TWO_PI = 0.159154943f;
+		// 2pi split in three, the first two have few enough bits that q times them is exact for |q| up to a few thousand
+		const float TWO_PI_1 = 6.28125f;
+		const float TWO_PI_2 = 1.93500518798828125e-3f;
+		const float TWO_PI_3 = 3.01991598e-7f;
+		const float TWO_PI = 6.28318531f;
+		// Taylor series of sin up to x^11, off by less than 1e-7 on [-pi/2, pi/2]
+		const float C3 = -1.0f / 6.0f;
+		const float C5 = 1.0f / 120.0f;
+		const float C7 = -1.0f / 5040.0f;
+		const float C9 = 1.0f / 362880.0f;
+		const float C11 = -1.0f / 39916800.0f;
+
+		// x in [-pi, pi], folded into [-pi/2, pi/2] with sin(pi - x) = sin(x)
+		inline float SinReduced(float x) {
+			x = std::max(std::min(x, PI - x), -PI - x);
+			float x2 = x * x;
+			return x * (1.0f + x2 * (C3 + x2 * (C5 + x2 * (C7 + x2 * (C9 + x2 * C11)))));
+		}
+	} // namespace fast_trig
+
+	// sin and cos of x in radians without a libm call or a branch, less than 3e-7 off for |x| up to a few thousand.
+	// x is reduced into [-pi, pi] once and both come out of the same polynomial, cos as sin(x + pi/2).
+	inline void SinCosFast(float x, float& sin_x, float& cos_x) {
+		using namespace fast_trig;
+		float q = floorf(x * INV_TWO_PI + 0.5f);
+		float r = ((x - q * TWO_PI_1) - q * TWO_PI_2) - q * TWO_PI_3;
+		float shifted = r + HALF_PI;
+		shifted = shifted > PI ? shifted - TWO_PI : shifted;
+		sin_x = SinReduced(r);
+		cos_x = SinReduced(shifted);
+	}
+	inline float SinFast(float x) {
+		using namespace fast_trig;
+		float q = floorf(x * INV_TWO_PI + 0.5f);
+		return SinReduced(((x - q * TWO_PI_1) - q * TWO_PI_2) - q * TWO_PI_3);
+	}
+
+#ifdef RAYTRACE_X86
+	// SinCosFast of 4 floats with the same operations, SSE2 is part of x86-64 so there's nothing to check at runtime
+	namespace fast_trig {
+		inline __m128 SinReduced4(__m128 x) {
+			x = _mm_max_ps(_mm_min_ps(x, _mm_sub_ps(_mm_set1_ps(PI), x)), _mm_sub_ps(_mm_set1_ps(-PI), x));
+			__m128 x2 = _mm_mul_ps(x, x);
+			__m128 p = _mm_add_ps(_mm_set1_ps(C9), _mm_mul_ps(x2, _mm_set1_ps(C11)));
+			p = _mm_add_ps(_mm_set1_ps(C7), _mm_mul_ps(x2, p));
+			p = _mm_add_ps(_mm_set1_ps(C5), _mm_mul_ps(x2, p));
+			p = _mm_add_ps(_mm_set1_ps(C3), _mm_mul_ps(x2, p));
+			p = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(x2, p));
+			return _mm_mul_ps(x, p);
+		}
+		// x reduced into [-pi, pi], rounding to nearest where the scalar version rounds half up
+		inline __m128 Reduce4(__m128 x) {
+			__m128 q = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(INV_TWO_PI))));
+			x = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(TWO_PI_1)));
+			x = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(TWO_PI_2)));
+			return _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(TWO_PI_3)));
+		}
+	} // namespace fast_trig
+
+	inline void SinCosFast4(__m128 x, __m128& sin_x, __m128& cos_x) {
+		using namespace fast_trig;
+		__m128 r = Reduce4(x);
+		__m128 shifted = _mm_add_ps(r, _mm_set1_ps(HALF_PI));
+		__m128 wrap = _mm_and_ps(_mm_cmpgt_ps(shifted, _mm_set1_ps(PI)), _mm_set1_ps(TWO_PI));
+		sin_x = SinReduced4(r);
+		cos_x = SinReduced4(_mm_sub_ps(shifted, wrap));
+	}
+	inline __m128 SinFast4(__m128 x) {
+		return fast_trig::SinReduced4(fast_trig::Reduce4(x));
+	}
+#endif
+} // namespace raytrace
+#endif // RAYTRACE_FAST_MATH_H_
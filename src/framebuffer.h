@@ -0,0 +1,36 @@
+#pragma once
+#ifndef RAYTRACE_FRAMEBUFFER_H_
+#define	RAYTRACE_FRAMEBUFFER_H_
+
+#include <vector>
+
+#include "types.h"
+
+namespace raytrace {
+	// XRGB8888 pixels in rows from top to bottom.
+	// Either owns its memory (headless rendering) or wraps memory owned by someone else, like a window surface.
+	class Framebuffer {
+	public:
+		Framebuffer(int width, int height) :width_(width), height_(height), pitch_(width * (int)sizeof(u32)), storage_((size_t)width * height, 0) {
+			pixels_ = (u8*)storage_.data();
+		};
+		// pitch is the number of bytes between the start of two rows
+		Framebuffer(void* pixels, int width, int height, int pitch) :width_(width), height_(height), pitch_(pitch), pixels_((u8*)pixels) {};
+		Framebuffer(const Framebuffer&) = delete;
+		Framebuffer& operator=(const Framebuffer&) = delete;
+
+		int GetWidth() const { return width_; };
+		int GetHeight() const { return height_; };
+		int GetPitch() const { return pitch_; };
+		u32* Row(int y) { return (u32*)(pixels_ + (size_t)y * pitch_); };
+		const u32* Row(int y) const { return (const u32*)(pixels_ + (size_t)y * pitch_); };
+
+	private:
+		int width_;
+		int height_;
+		int pitch_;
+		std::vector<u32> storage_;
+		u8* pixels_ = nullptr;
+	};
+} // namespace raytrace
+#endif // RAYTRACE_FRAMEBUFFER_H_
@@ -0,0 +1,117 @@
+#include "gpu_timer.h"
+
+#include <iostream>
+
+namespace raytrace {
+
+	int GpuTimer::Init() {
+		if (initialized_) {
+			return 0;
+		}
+		if (!GLEW_ARB_timer_query) {
+			std::cout << "GPU timing needs GL_ARB_timer_query" << std::endl;
+			return -1;
+		}
+		// Drivers may report timer queries with a 0 bit counter
+		GLint counter_bits = 0;
+		glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &counter_bits);
+		if (counter_bits == 0) {
+			std::cout << "GPU timing isn't supported by the driver" << std::endl;
+			return -1;
+		}
+		for (Frame& frame : frames_) {
+			glGenQueries(NUM_SECTIONS, frame.begin_queries);
+			glGenQueries(NUM_SECTIONS, frame.end_queries);
+			frame.number = 0;
+		}
+		initialized_ = true;
+		return 0;
+	}
+
+	void GpuTimer::Delete() {
+		if (!initialized_) {
+			return;
+		}
+		for (Frame& frame : frames_) {
+			glDeleteQueries(NUM_SECTIONS, frame.begin_queries);
+			glDeleteQueries(NUM_SECTIONS, frame.end_queries);
+			frame = Frame();
+		}
+		initialized_ = false;
+		last_timing_ = GpuFrameTiming();
+	}
+
+	bool GpuTimer::Collect(Frame& frame) {
+		bool any_used = false;
+		for (int i = 0; i < NUM_SECTIONS; i++) {
+			if (!frame.used[i]) {
+				continue;
+			}
+			any_used = true;
+			// Timestamps complete in order, the end is available only after the begin
+			GLint available = GL_FALSE;
+			glGetQueryObjectiv(frame.end_queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) {
+				return false;
+			}
+		}
+		if (!any_used) { // Nothing was drawn that frame, keep the last timing
+			frame.number = 0;
+			return true;
+		}
+		// Available results never block
+		float ms[NUM_SECTIONS] = {};
+		for (int i = 0; i < NUM_SECTIONS; i++) {
+			if (frame.used[i]) {
+				GLuint64 begin_ns = 0;
+				GLuint64 end_ns = 0;
+				glGetQueryObjectui64v(frame.begin_queries[i], GL_QUERY_RESULT, &begin_ns);
+				glGetQueryObjectui64v(frame.end_queries[i], GL_QUERY_RESULT, &end_ns);
+				ms[i] = end_ns > begin_ns ? (float)((double)(end_ns - begin_ns) / 1000000.0) : 0.0f;
+			}
+		}
+		last_timing_.upload_ms = ms[(int)Section::kUpload];
+		last_timing_.draw_ms = ms[(int)Section::kDraw];
+		last_timing_.frame = frame.number;
+		frame.number = 0;
+		return true;
+	}
+
+	void GpuTimer::BeginFrame() {
+		if (!initialized_) {
+			return;
+		}
+		// Oldest first, the GPU finishes frames in order so the first pending one ends the search
+		for (int i = 1; i <= RING_SIZE; i++) {
+			Frame& frame = frames_[(current_ + i) % RING_SIZE];
+			if (frame.number != 0 && !Collect(frame)) {
+				break;
+			}
+		}
+		current_ = (current_ + 1) % RING_SIZE;
+		Frame& frame = frames_[current_];
+		if (frame.number != 0) { // Still running RING_SIZE frames later, reusing the queries throws its results away
+			dropped_frames_++;
+		}
+		frame.number = ++frame_number_;
+		for (bool& used : frame.used) {
+			used = false;
+		}
+	}
+
+	void GpuTimer::Begin(Section section) {
+		if (!initialized_ || frames_[current_].number == 0) {
+			return;
+		}
+		glQueryCounter(frames_[current_].begin_queries[(int)section], GL_TIMESTAMP);
+	}
+
+	void GpuTimer::End(Section section) {
+		if (!initialized_ || frames_[current_].number == 0) {
+			return;
+		}
+		Frame& frame = frames_[current_];
+		glQueryCounter(frame.end_queries[(int)section], GL_TIMESTAMP);
+		frame.used[(int)section] = true;
+	}
+} // namespace raytrace
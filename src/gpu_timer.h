@@ -0,0 +1,63 @@
+#pragma once
+#ifndef RAYTRACE_GPU_TIMER_H_
+#define	RAYTRACE_GPU_TIMER_H_
+
+#include "GL/glew.h"
+
+#include "types.h"
+
+namespace raytrace {
+	// GPU time of the last frame whose queries came back
+	struct GpuFrameTiming {
+		float upload_ms = 0.0f; // Uniform or texture buffer uploads
+		float draw_ms = 0.0f; // The fullscreen ray tracing pass
+		u64 frame = 0; // Frame number the times belong to, 0 before the first result
+	};
+
+	// Measures sections of a GPU frame with a GL_TIMESTAMP query at the start and end of each. Every frame uses
+	// its own set of queries out of a ring of RING_SIZE, results are only read once the GPU says they are available
+	// so the CPU never waits on them. A frame whose queries are still pending when its slot comes around again is dropped.
+	// Mesa's llvmpipe rasterizes when the frame is flushed, there the draw only measures the time to queue it.
+	class GpuTimer {
+	public:
+		static const int RING_SIZE = 4;
+		enum class Section {
+			kUpload = 0,
+			kDraw,
+			kCount
+		};
+
+		// Returns -1 if the driver has no timer queries (GL 3.3 or ARB_timer_query)
+		int Init();
+		bool IsInitialized() const { return initialized_; };
+		void Delete();
+
+		// Collects every finished frame and moves to the next slot of the ring
+		void BeginFrame();
+		void Begin(Section section);
+		void End(Section section);
+
+		const GpuFrameTiming& GetLastTiming() const { return last_timing_; };
+		// Frames whose results weren't back before their queries had to be reused
+		u64 GetDroppedFrames() const { return dropped_frames_; };
+
+	private:
+		static const int NUM_SECTIONS = (int)Section::kCount;
+		struct Frame {
+			GLuint begin_queries[NUM_SECTIONS] = {};
+			GLuint end_queries[NUM_SECTIONS] = {};
+			bool used[NUM_SECTIONS] = {}; // Sections that began and ended this frame, the rest count as 0 ms
+			u64 number = 0; // 0 when there is nothing to collect
+		};
+		// Reads the frame's results if they are all available, returns false if the GPU isn't done with it yet
+		bool Collect(Frame& frame);
+
+		bool initialized_ = false;
+		Frame frames_[RING_SIZE];
+		int current_ = RING_SIZE - 1;
+		u64 frame_number_ = 0;
+		GpuFrameTiming last_timing_;
+		u64 dropped_frames_ = 0;
+	};
+} // namespace raytrace
+#endif // RAYTRACE_GPU_TIMER_H_
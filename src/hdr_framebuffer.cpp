@@ -0,0 +1,132 @@
+#include "hdr_framebuffer.h"
+
+#include <algorithm>
+
+#include "simd.h"
+
+namespace raytrace {
+
+	static u32 QuantizeChannel(float value) {
+		return (u32)(std::min(std::max(0.0f, value), 1.0f) * 255.0f + 0.5f);
+	}
+	static void QuantizeRowScalar(const float* red, const float* green, const float* blue, int count, u32* dst) {
+		for (int i = 0; i < count; i++) {
+			dst[i] = 0xFF000000u | (QuantizeChannel(red[i]) << 16) | (QuantizeChannel(green[i]) << 8) | QuantizeChannel(blue[i]);
+		}
+	}
+
+	// max(value, 0) is written with value first so a NaN becomes 0, the same as the scalar version
+#ifdef RAYTRACE_X86
+	RAYTRACE_TARGET("sse4.1")
+	static void QuantizeRowSSE41(const float* red, const float* green, const float* blue, int count, u32* dst) {
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 scale = _mm_set1_ps(255.0f);
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128i alpha = _mm_set1_epi32((int)0xFF000000u);
+		int i = 0;
+		for (; i + 4 <= count; i += 4) {
+			__m128i r = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(red + i), zero), one), scale), half));
+			__m128i g = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(green + i), zero), one), scale), half));
+			__m128i b = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(blue + i), zero), one), scale), half));
+			__m128i pixels = _mm_or_si128(_mm_or_si128(alpha, _mm_slli_epi32(r, 16)), _mm_or_si128(_mm_slli_epi32(g, 8), b));
+			_mm_storeu_si128((__m128i*)(dst + i), pixels);
+		}
+		QuantizeRowScalar(red + i, green + i, blue + i, count - i, dst + i);
+	}
+
+	RAYTRACE_TARGET("avx2")
+	static void QuantizeRowAVX2(const float* red, const float* green, const float* blue, int count, u32* dst) {
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 scale = _mm256_set1_ps(255.0f);
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256i alpha = _mm256_set1_epi32((int)0xFF000000u);
+		int i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m256i r = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(red + i), zero), one), scale), half));
+			__m256i g = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(green + i), zero), one), scale), half));
+			__m256i b = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(blue + i), zero), one), scale), half));
+			__m256i pixels = _mm256_or_si256(_mm256_or_si256(alpha, _mm256_slli_epi32(r, 16)), _mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+			_mm256_storeu_si256((__m256i*)(dst + i), pixels);
+		}
+		QuantizeRowScalar(red + i, green + i, blue + i, count - i, dst + i);
+	}
+
+	RAYTRACE_TARGET("avx512f")
+	static void QuantizeRowAVX512(const float* red, const float* green, const float* blue, int count, u32* dst) {
+		const __m512 zero = _mm512_setzero_ps();
+		const __m512 one = _mm512_set1_ps(1.0f);
+		const __m512 scale = _mm512_set1_ps(255.0f);
+		const __m512 half = _mm512_set1_ps(0.5f);
+		const __m512i alpha = _mm512_set1_epi32((int)0xFF000000u);
+		int i = 0;
+		for (; i + 16 <= count; i += 16) {
+			__m512i r = _mm512_cvttps_epi32(_mm512_add_ps(_mm512_mul_ps(_mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(red + i), zero), one), scale), half));
+			__m512i g = _mm512_cvttps_epi32(_mm512_add_ps(_mm512_mul_ps(_mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(green + i), zero), one), scale), half));
+			__m512i b = _mm512_cvttps_epi32(_mm512_add_ps(_mm512_mul_ps(_mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(blue + i), zero), one), scale), half));
+			__m512i pixels = _mm512_or_si512(_mm512_or_si512(alpha, _mm512_slli_epi32(r, 16)), _mm512_or_si512(_mm512_slli_epi32(g, 8), b));
+			_mm512_storeu_si512((void*)(dst + i), pixels);
+		}
+		QuantizeRowScalar(red + i, green + i, blue + i, count - i, dst + i);
+	}
+#endif
+
+	using QuantizeRowFn = void (*)(const float*, const float*, const float*, int, u32*);
+	static QuantizeRowFn SelectQuantizeRow() {
+		switch (DetectSimdLevel()) {
+#ifdef RAYTRACE_X86
+		case SimdLevel::kAVX512:
+			return QuantizeRowAVX512;
+		case SimdLevel::kAVX2:
+			return QuantizeRowAVX2;
+		case SimdLevel::kSSE41:
+			return QuantizeRowSSE41;
+#endif
+		default:
+			return QuantizeRowScalar;
+		}
+	}
+
+	void QuantizeRow(const float* red, const float* green, const float* blue, int count, u32* dst) {
+		static const QuantizeRowFn quantize_row = SelectQuantizeRow();
+		quantize_row(red, green, blue, count, dst);
+	}
+
+	void HdrFramebuffer::UpscaleRow(int y, float scale, float x_offset, float y_offset, Framebuffer& target) const {
+		float source_y = std::min(std::max(y_offset, 0.0f), (float)(height_ - 1));
+		int y0 = (int)source_y;
+		int y1 = std::min(y0 + 1, height_ - 1);
+		float fy = source_y - (float)y0;
+		const float* planes[3] = { red_.data(), green_.data(), blue_.data() };
+
+		// Filtered in chunks on the stack and quantized with the same kernel as a full resolution row.
+		// The horizontal taps are worked out once per chunk and shared by the three planes.
+		const int CHUNK = 256;
+		int x0[CHUNK];
+		int x1[CHUNK];
+		float fx[CHUNK];
+		float filtered[3][CHUNK];
+		u32* dst = target.Row(y);
+		int width = target.GetWidth();
+		for (int chunk_start = 0; chunk_start < width; chunk_start += CHUNK) {
+			int count = std::min(CHUNK, width - chunk_start);
+			for (int i = 0; i < count; i++) {
+				float source_x = std::min(std::max((float)(chunk_start + i) * scale + x_offset, 0.0f), (float)(width_ - 1));
+				x0[i] = (int)source_x;
+				x1[i] = std::min(x0[i] + 1, width_ - 1);
+				fx[i] = source_x - (float)x0[i];
+			}
+			for (int c = 0; c < 3; c++) {
+				const float* row0 = planes[c] + (size_t)y0 * width_;
+				const float* row1 = planes[c] + (size_t)y1 * width_;
+				for (int i = 0; i < count; i++) {
+					float left = row0[x0[i]] + (row1[x0[i]] - row0[x0[i]]) * fy;
+					float right = row0[x1[i]] + (row1[x1[i]] - row0[x1[i]]) * fy;
+					filtered[c][i] = left + (right - left) * fx[i];
+				}
+			}
+			raytrace::QuantizeRow(filtered[0], filtered[1], filtered[2], count, dst + chunk_start);
+		}
+	}
+} // namespace raytrace
@@ -0,0 +1,57 @@
+#pragma once
+#ifndef RAYTRACE_HDR_FRAMEBUFFER_H_
+#define	RAYTRACE_HDR_FRAMEBUFFER_H_
+
+#include <vector>
+
+#include "framebuffer.h"
+#include "types.h"
+
+namespace raytrace {
+	// Clamps count linear pixels to [0, 1] and writes them as XRGB8888, rounded to the nearest step
+	// like a GL fragment output would be. Uses the widest SIMD the CPU has.
+	void QuantizeRow(const float* red, const float* green, const float* blue, int count, u32* dst);
+
+	// Float RGB pixels in rows from top to bottom, one plane per channel so rows can be quantized
+	// a whole register at a time.
+	class HdrFramebuffer {
+	public:
+		// Contents are undefined after a resize
+		void Resize(int width, int height) {
+			width_ = width;
+			height_ = height;
+			red_.resize((size_t)width * height);
+			green_.resize((size_t)width * height);
+			blue_.resize((size_t)width * height);
+		}
+		int GetWidth() const { return width_; };
+		int GetHeight() const { return height_; };
+
+		void SetPixel(int x, int y, HdrColor c) {
+			size_t i = (size_t)y * width_ + x;
+			red_[i] = c.x;
+			green_[i] = c.y;
+			blue_[i] = c.z;
+		}
+		HdrColor GetPixel(int x, int y) const {
+			size_t i = (size_t)y * width_ + x;
+			return HdrColor(red_[i], green_[i], blue_[i]);
+		}
+		// Writes pixels [x_start, x_end) of row y into the same pixels of target
+		void QuantizeRow(int y, int x_start, int x_end, Framebuffer& target) const {
+			size_t i = (size_t)y * width_ + x_start;
+			raytrace::QuantizeRow(&red_[i], &green_[i], &blue_[i], x_end - x_start, target.Row(y) + x_start);
+		}
+		// Bilinear upscale of this buffer into row y of a larger target. Target pixel (x, y) samples
+		// source position (x * scale + x_offset, y_offset), positions past the edges are clamped.
+		void UpscaleRow(int y, float scale, float x_offset, float y_offset, Framebuffer& target) const;
+
+	private:
+		int width_ = 0;
+		int height_ = 0;
+		std::vector<float> red_;
+		std::vector<float> green_;
+		std::vector<float> blue_;
+	};
+} // namespace raytrace
+#endif // RAYTRACE_HDR_FRAMEBUFFER_H_
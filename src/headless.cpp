@@ -0,0 +1,112 @@
+#include "headless.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "book_demo_scene.h"
+#include "framebuffer.h"
+#include "image_writer.h"
+#include "magic_spheres_scene.h"
+#include "rainbow_spheres_scene.h"
+#include "raytracer.h"
+#include "scene_file.h"
+
+namespace raytrace {
+	namespace {
+		std::unique_ptr<Scene> CreateScene(const std::string& name) {
+			if (name == "book") {
+				return std::make_unique<BookDemoScene>();
+			}
+			if (name == "magic") {
+				return std::make_unique<MagicSpheresScene>();
+			}
+			if (name == "rainbow") {
+				return std::make_unique<RainbowSpheresScene>();
+			}
+			// Anything else is a scene file or a text scene
+			std::unique_ptr<Scene> scene = std::make_unique<Scene>();
+			if (LoadScene(name, *scene) < 0) {
+				return nullptr;
+			}
+			return scene;
+		}
+	} // namespace
+
+	int RunHeadless(int argc, char* argv[]) {
+		std::string scene_name = "book";
+		std::string output = "render.ppm";
+		int width = 500;
+		int height = 500;
+		int threads = ThreadPool::DefaultThreadCount();
+		int bounces = 2;
+		u64 time_ms = 0;
+		bool fast_math = false;
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			if (arg == "--headless") {
+				continue;
+			}
+			if (arg == "--fast-math") {
+				fast_math = true;
+				continue;
+			}
+			if (i + 1 >= argc) {
+				std::cout << "Missing value for " << arg << std::endl;
+				return -1;
+			}
+			std::string value = argv[++i];
+			if (arg == "--scene") {
+				scene_name = value;
+			}
+			else if (arg == "--scene-file") {
+				// Only the window uses it, --scene takes a scene file too
+			}
+			else if (arg == "--output") {
+				output = value;
+			}
+			else if (arg == "--width") {
+				width = atoi(value.c_str());
+			}
+			else if (arg == "--height") {
+				height = atoi(value.c_str());
+			}
+			else if (arg == "--threads") {
+				threads = atoi(value.c_str());
+			}
+			else if (arg == "--bounces") {
+				bounces = atoi(value.c_str());
+			}
+			else if (arg == "--time") {
+				time_ms = strtoull(value.c_str(), nullptr, 10);
+			}
+			else {
+				std::cout << "Unknown option " << arg << std::endl;
+				return -1;
+			}
+		}
+		if (width <= 0 || height <= 0 || threads <= 0 || bounces < 0) {
+			std::cout << "Width, height and threads must be positive and bounces can't be negative" << std::endl;
+			return -1;
+		}
+		std::unique_ptr<Scene> scene = CreateScene(scene_name);
+		if (!scene) {
+			std::cout << "Unknown scene \"" << scene_name << "\", expected book, magic, rainbow or a scene file" << std::endl;
+			return -1;
+		}
+
+		Framebuffer framebuffer(width, height);
+		RayTracer rt(&framebuffer, scene.get());
+		rt.SetThreadCount(threads);
+		rt.SetMaxBounces(bounces);
+		rt.SetFastMath(fast_math);
+		scene->Update(0.0f, time_ms);
+		rt.Render(scene.get());
+		if (WriteImage(output, framebuffer) < 0) {
+			return -1;
+		}
+		std::cout << "Wrote " << width << "x" << height << " " << scene_name << " to " << output << std::endl;
+		return 0;
+	}
+} // namespace raytrace
@@ -0,0 +1,11 @@
+#pragma once
+#ifndef RAYTRACE_HEADLESS_H_
+#define	RAYTRACE_HEADLESS_H_
+
+namespace raytrace {
+	// Renders one frame on the CPU into memory and writes it to disk, no window or GL context needed.
+	// Options: --scene book|magic|rainbow|scene file, --width, --height, --threads, --bounces, --time ms, --fast-math, --output file.ppm|file.png
+	// Returns 0 on success, -1 on bad arguments or if the image could not be written.
+	int RunHeadless(int argc, char* argv[]);
+} // namespace raytrace
+#endif // RAYTRACE_HEADLESS_H_
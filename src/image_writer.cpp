@@ -0,0 +1,133 @@
+#include "image_writer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace raytrace {
+	namespace {
+		void AppendRGB(std::vector<u8>& out, u32 xrgb) {
+			out.push_back((u8)(xrgb >> 16));
+			out.push_back((u8)(xrgb >> 8));
+			out.push_back((u8)xrgb);
+		}
+		void AppendU32BigEndian(std::vector<u8>& out, u32 value) {
+			out.push_back((u8)(value >> 24));
+			out.push_back((u8)(value >> 16));
+			out.push_back((u8)(value >> 8));
+			out.push_back((u8)value);
+		}
+		u32 Crc32(const u8* data, size_t size, u32 crc = 0) {
+			static u32 table[256];
+			static bool table_ready = false;
+			if (!table_ready) {
+				for (u32 n = 0; n < 256; n++) {
+					u32 c = n;
+					for (int k = 0; k < 8; k++) {
+						c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					}
+					table[n] = c;
+				}
+				table_ready = true;
+			}
+			crc = ~crc;
+			for (size_t i = 0; i < size; i++) {
+				crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+			}
+			return ~crc;
+		}
+		u32 Adler32(const std::vector<u8>& data) {
+			u32 a = 1, b = 0;
+			for (u8 byte : data) {
+				a = (a + byte) % 65521;
+				b = (b + a) % 65521;
+			}
+			return (b << 16) | a;
+		}
+		void AppendChunk(std::vector<u8>& png, const char type[4], const std::vector<u8>& data) {
+			AppendU32BigEndian(png, (u32)data.size());
+			size_t type_start = png.size();
+			png.insert(png.end(), type, type + 4);
+			png.insert(png.end(), data.begin(), data.end());
+			AppendU32BigEndian(png, Crc32(&png[type_start], data.size() + 4));
+		}
+		int WriteFile(const std::string& path, const std::vector<u8>& bytes) {
+			std::ofstream file(path, std::ios::out | std::ios::binary);
+			if (!file.is_open()) {
+				std::cout << "Could not open \"" << path << "\" for writing" << std::endl;
+				return -1;
+			}
+			file.write((const char*)bytes.data(), bytes.size());
+			return file.good() ? 0 : -1;
+		}
+	} // namespace
+
+	int WritePPM(const std::string& path, const Framebuffer& image) {
+		std::string header = "P6\n" + std::to_string(image.GetWidth()) + " " + std::to_string(image.GetHeight()) + "\n255\n";
+		std::vector<u8> bytes(header.begin(), header.end());
+		bytes.reserve(header.size() + (size_t)image.GetWidth() * image.GetHeight() * 3);
+		for (int y = 0; y < image.GetHeight(); y++) {
+			const u32* row = image.Row(y);
+			for (int x = 0; x < image.GetWidth(); x++) {
+				AppendRGB(bytes, row[x]);
+			}
+		}
+		return WriteFile(path, bytes);
+	}
+
+	int WritePNG(const std::string& path, const Framebuffer& image) {
+		// Scanlines with filter type 0 in front of each row
+		std::vector<u8> raw;
+		raw.reserve((size_t)image.GetHeight() * (image.GetWidth() * 3 + 1));
+		for (int y = 0; y < image.GetHeight(); y++) {
+			raw.push_back(0);
+			const u32* row = image.Row(y);
+			for (int x = 0; x < image.GetWidth(); x++) {
+				AppendRGB(raw, row[x]);
+			}
+		}
+
+		// zlib stream made of stored deflate blocks, at most 65535 bytes each
+		std::vector<u8> zlib = { 0x78, 0x01 };
+		size_t offset = 0;
+		do {
+			size_t block_size = std::min<size_t>(65535, raw.size() - offset);
+			bool last_block = offset + block_size == raw.size();
+			zlib.push_back(last_block ? 1 : 0);
+			zlib.push_back((u8)block_size);
+			zlib.push_back((u8)(block_size >> 8));
+			zlib.push_back((u8)~block_size);
+			zlib.push_back((u8)(~block_size >> 8));
+			zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + block_size);
+			offset += block_size;
+		} while (offset < raw.size());
+		AppendU32BigEndian(zlib, Adler32(raw));
+
+		std::vector<u8> ihdr;
+		AppendU32BigEndian(ihdr, (u32)image.GetWidth());
+		AppendU32BigEndian(ihdr, (u32)image.GetHeight());
+		ihdr.push_back(8); // Bit depth
+		ihdr.push_back(2); // Truecolor RGB
+		ihdr.push_back(0); // Compression
+		ihdr.push_back(0); // Filter
+		ihdr.push_back(0); // No interlace
+
+		std::vector<u8> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		AppendChunk(png, "IHDR", ihdr);
+		AppendChunk(png, "IDAT", zlib);
+		AppendChunk(png, "IEND", {});
+		return WriteFile(path, png);
+	}
+
+	int WriteImage(const std::string& path, const Framebuffer& image) {
+		size_t dot = path.find_last_of('.');
+		std::string extension = dot == std::string::npos ? "" : path.substr(dot);
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)tolower(c); });
+		if (extension == ".png") {
+			return WritePNG(path, image);
+		}
+		return WritePPM(path, image);
+	}
+} // namespace raytrace
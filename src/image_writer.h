@@ -0,0 +1,17 @@
+#pragma once
+#ifndef RAYTRACE_IMAGE_WRITER_H_
+#define	RAYTRACE_IMAGE_WRITER_H_
+
+#include <string>
+
+#include "framebuffer.h"
+
+namespace raytrace {
+	// Both return 0 on success, -1 if the file could not be written
+	int WritePPM(const std::string& path, const Framebuffer& image);
+	// Uncompressed (stored deflate blocks) so there is no zlib dependency
+	int WritePNG(const std::string& path, const Framebuffer& image);
+	// Picks the format from the extension, anything that isn't .png is written as PPM
+	int WriteImage(const std::string& path, const Framebuffer& image);
+} // namespace raytrace
+#endif // RAYTRACE_IMAGE_WRITER_H_
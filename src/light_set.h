@@ -0,0 +1,84 @@
+#pragma once
+#ifndef RAYTRACE_LIGHT_SET_H_
+#define	RAYTRACE_LIGHT_SET_H_
+
+#include <memory>
+#include <vector>
+
+#include "types.h"
+
+namespace raytrace {
+	// A scene's lights laid out for shading, compiled once per frame so the kernels never touch the Light objects.
+	// Ambient lights are the same at every point and are summed into one term. Point and directional lights are
+	// kept apart in packed arrays, so each loop only does the work of its own type, and directions are normalized.
+	class LightSet {
+	public:
+		// Keeps the arrays' storage, recompiling an unchanged number of lights allocates nothing
+		void Compile(const std::vector<std::shared_ptr<Light>>& lights) {
+			ambient_ = 0.0f;
+			point_x_.clear();
+			point_y_.clear();
+			point_z_.clear();
+			point_intensity_.clear();
+			direction_x_.clear();
+			direction_y_.clear();
+			direction_z_.clear();
+			directional_intensity_.clear();
+			direction_length_.clear();
+			for (const std::shared_ptr<Light>& light : lights) {
+				switch (light->type) {
+				case LightType::kAmbient:
+					ambient_ += light->intensity;
+					break;
+				case LightType::kPoint:
+					point_x_.push_back(light->position.x);
+					point_y_.push_back(light->position.y);
+					point_z_.push_back(light->position.z);
+					point_intensity_.push_back(light->intensity);
+					break;
+				case LightType::kDirectional:
+					{
+						float length = vec3::Length(light->direction);
+						if (length <= 0.0f) { // Lights nothing
+							break;
+						}
+						vec3 direction = light->direction / length;
+						direction_x_.push_back(direction.x);
+						direction_y_.push_back(direction.y);
+						direction_z_.push_back(direction.z);
+						directional_intensity_.push_back(light->intensity);
+						direction_length_.push_back(length);
+					}
+					break;
+				}
+			}
+		}
+
+		float GetAmbient() const { return ambient_; };
+		int GetPointCount() const { return (int)point_intensity_.size(); };
+		int GetDirectionalCount() const { return (int)directional_intensity_.size(); };
+		// Lights that cast shadows are numbered point lights first, then directional lights
+		int GetShadowCasterCount() const { return GetPointCount() + GetDirectionalCount(); };
+
+		vec3 GetPointPosition(int i) const { return vec3(point_x_[i], point_y_[i], point_z_[i]); };
+		float GetPointIntensity(int i) const { return point_intensity_[i]; };
+		// Unit length, pointing toward the light
+		vec3 GetDirection(int i) const { return vec3(direction_x_[i], direction_y_[i], direction_z_[i]); };
+		float GetDirectionalIntensity(int i) const { return directional_intensity_[i]; };
+		// Length of the direction before it was normalized. Shadow ray offsets are measured in it, the same as on the GPU.
+		float GetDirectionLength(int i) const { return direction_length_[i]; };
+
+	private:
+		float ambient_ = 0.0f;
+		std::vector<float> point_x_;
+		std::vector<float> point_y_;
+		std::vector<float> point_z_;
+		std::vector<float> point_intensity_;
+		std::vector<float> direction_x_;
+		std::vector<float> direction_y_;
+		std::vector<float> direction_z_;
+		std::vector<float> directional_intensity_;
+		std::vector<float> direction_length_;
+	};
+} // namespace raytrace
+#endif // RAYTRACE_LIGHT_SET_H_
@@ -3,6 +3,7 @@
 #define	RAYTRACE_MAGIC_SPHERES_SCENE_H_
 
 #include "scene.h"
+#include "sphere_animator.h"
 
 namespace raytrace {
 	class MagicSpheresScene : public Scene {
@@ -11,10 +12,11 @@ namespace raytrace {
 
 		MagicSpheresScene();
 
-		void Update(float delta_time) override;
+		void Update(float delta_time, u64 time_ms) override;
 		
 
 	private:
+		SphereAnimator animator_; // The magic spheres, they come first in the store
 		Sphere floor = Sphere(vec3(0.0f, -5001.0f, 0.0f), 5000.0f, Color(0xFF, 0xFF, 0xFF), 800, 0.4f);
 		std::shared_ptr<Sphere> floor_ref = std::make_shared<Sphere>(floor);
 		Light al = Light::AmbientLight(0.2f);
@@ -2,14 +2,23 @@
 #include <iomanip>
 #include <iostream>
 #include <math.h>
+#include <memory>
+#include <sstream>
+#include <string>
 
 #include <GL/glew.h>
 #include <SDL.h>
 #include <SDL_opengl.h>
 
+#include "benchmark.h"
+#include "book_demo_scene.h"
+#include "framebuffer.h"
+#include "headless.h"
 #include "magic_spheres_scene.h"
+#include "profiler.h"
 #include "rainbow_spheres_scene.h"
 #include "raytracer.h"
+#include "scene_file.h"
 #include "sphere.h"
 #include "shader.h"
 #include "util.h"
@@ -17,9 +26,56 @@
 
 const int CANVAS_WIDTH = 500;
 const int CANVAS_HEIGHT = 500;
+// The CPU path lowers its resolution to stay near this frame time, R toggles it
+const float CPU_TARGET_FRAME_MS = 1000.0f / 30.0f;
+// How long the loop sleeps while the progressive CPU image has converged and nothing changes
+const u32 IDLE_DELAY_MS = 10;
+// Written on exit when built with RAYTRACE_PROFILE
+const char* TRACE_FILE = "trace.json";
 using namespace raytrace;
 
+// Uniforms the main loop sets on whichever program RenderGPU draws with
+struct CameraUniforms {
+	GLint time;
+	GLint rotation_x;
+	GLint rotation_y;
+	GLint position;
+	GLint max_bounces;
+};
+CameraUniforms GetCameraUniforms(const Shader& shader) {
+	GLuint program = shader.GetProgramID();
+	CameraUniforms uniforms;
+	uniforms.time = glGetUniformLocation(program, "u_Time");
+	uniforms.rotation_x = glGetUniformLocation(program, "u_Camera_Rotation_Matrix_X");
+	uniforms.rotation_y = glGetUniformLocation(program, "u_Camera_Rotation_Matrix_Y");
+	uniforms.position = glGetUniformLocation(program, "u_Camera_Position");
+	uniforms.max_bounces = glGetUniformLocation(program, "u_Max_Bounces");
+	return uniforms;
+}
+
 int main(int argc, char* argv[]) {
+	std::string scene_file;
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--convert-scene") {
+			if (i + 2 >= argc) {
+				std::cout << "Usage: --convert-scene scene.txt scene" << SCENE_FILE_EXTENSION << std::endl;
+				return -1;
+			}
+			return ConvertSceneText(argv[i + 1], argv[i + 2]);
+		}
+		if (std::string(argv[i]) == "--scene-file" && i + 1 < argc) {
+			scene_file = argv[++i];
+			continue;
+		}
+		if (std::string(argv[i]) == "--headless") {
+			return RunHeadless(argc, argv);
+		}
+		if (std::string(argv[i]) == "--benchmark") {
+			int result = RunBenchmark(argc, argv);
+			RAYTRACE_PROFILE_WRITE_TRACE(TRACE_FILE);
+			return result;
+		}
+	}
 
 	SDL_Window* window = NULL;
 	SDL_Surface* canvas = NULL;
@@ -38,6 +94,15 @@ int main(int argc, char* argv[]) {
 		return -1;
 	}
 	canvas = SDL_GetWindowSurface(window);
+	// The CPU path draws XRGB8888 straight into the window surface, ARGB8888 has the same layout.
+	// Any other format gets a framebuffer of its own that is converted when it's presented.
+	const SDL_PixelFormat* canvas_format = canvas->format;
+	bool canvas_is_xrgb = canvas_format->BytesPerPixel == 4 && canvas_format->Rmask == 0x00FF0000
+		&& canvas_format->Gmask == 0x0000FF00 && canvas_format->Bmask == 0x000000FF;
+	std::unique_ptr<Framebuffer> window_framebuffer = canvas_is_xrgb
+		? std::make_unique<Framebuffer>(canvas->pixels, canvas->w, canvas->h, canvas->pitch)
+		: std::make_unique<Framebuffer>(canvas->w, canvas->h);
+	bool convert_failed = false;
 
 	// Create the OpenGL Context
 	SDL_GLContext context = SDL_GL_CreateContext(window);
@@ -76,51 +141,37 @@ int main(int argc, char* argv[]) {
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, (void*)0);
 	glEnableVertexAttribArray(0);
 	
-	Shader shader_program("default.vert", "default.frag");
-	shader_program.Enable();
-	GLuint u_time = glGetUniformLocation(shader_program.GetProgramID(), "u_Time");
-	GLuint u_Camera_Rotation_Matrix_X = glGetUniformLocation(shader_program.GetProgramID(), "u_Camera_Rotation_Matrix_X");
-	GLuint u_Camera_Rotation_Matrix_Y = glGetUniformLocation(shader_program.GetProgramID(), "u_Camera_Rotation_Matrix_Y");
-	GLuint u_Camera_Position = glGetUniformLocation(shader_program.GetProgramID(), "u_Camera_Position");
-
+	// Programs build in the background, frames are drawn on the CPU until they are ready. Every scene
+	// gets a program specialized for it, drawn with the generic one until it is built.
+	// Uniforms are looked up again every time the program changes.
+	ShaderVariants uniform_buffer_programs("default.vert", "default.frag", Scene::BindUniformBlocks);
+	Shader texture_buffer_program("default.vert", "texture_buffer.frag");
+	GLuint texture_buffer_program_id = 0;
+	GLuint camera_uniforms_program_id = 0;
+	CameraUniforms camera_uniforms = {};
+	bool gpu_failed = false;
 
 	// Initialize Scene buffers
-	Scene::Init(shader_program);
+	Scene::Init(uniform_buffer_programs);
+
 	// Demo scene
 	
-	Scene book_demo;
-	Sphere red_sphere = Sphere(vec3(0.0f, -1.0f, 3.0f), 1.0f, Color(0xFF, 0x0, 0x0), 500, 0.2f);
-	Sphere blue_sphere = Sphere(vec3(2.0f, 0.0f, 4.0f), 1.0f, Color(0x0, 0x0, 0xFF), 500, 0.3f);
-	Sphere green_sphere = Sphere(vec3(-2.0f, 0.0f, 4.0f), 1.0f, Color(0x0, 0xFF, 0x0), 10, 0.4f);
-	Sphere yellow_sphere = Sphere(vec3(0.0f, -5001.0f, 0.0f), 5000.0f, Color(0xFF, 0xFF, 0x0), 1000, 0.5f);
-
-	std::shared_ptr<Sphere> red_sphere_ref = std::make_shared<Sphere>(red_sphere);
-	std::shared_ptr<Sphere> blue_sphere_ref = std::make_shared<Sphere>(blue_sphere);
-	std::shared_ptr<Sphere> green_sphere_ref = std::make_shared<Sphere>(green_sphere);
-	std::shared_ptr<Sphere> yellow_sphere_ref = std::make_shared<Sphere>(yellow_sphere);
-
-	Light ambient_light = Light::AmbientLight(0.2f);
-	Light point_light = Light::PointLight(0.6f, vec3(2, 1, 0));
-	Light directional_light = Light::DirectionalLight(0.2f, vec3(1, 4, 4));
-
-	std::shared_ptr<Light> ambient_light_ref = std::make_shared<Light>(ambient_light);
-	std::shared_ptr<Light> point_light_ref = std::make_shared<Light>(point_light);
-	std::shared_ptr<Light> directional_light_ref = std::make_shared<Light>(directional_light);
-
-	book_demo.AddSphere(red_sphere_ref);
-	book_demo.AddSphere(blue_sphere_ref);
-	book_demo.AddSphere(green_sphere_ref);
-	book_demo.AddSphere(yellow_sphere_ref);
-
-	book_demo.AddLight(ambient_light_ref);
-	book_demo.AddLight(point_light_ref);
-	book_demo.AddLight(directional_light_ref);
-	
-
+	BookDemoScene book_demo;
 	MagicSpheresScene magic_sphere_scene;
 	RainbowSpheresScene rainbow_sphere_scene;
+	// F4, only there when --scene-file loaded
+	Scene file_scene;
+	bool has_file_scene = !scene_file.empty() && LoadScene(scene_file, file_scene) == 0;
 
-	RayTracer rt(canvas, &magic_sphere_scene);
+	RayTracer rt(window_framebuffer.get(), &magic_sphere_scene);
+	rt.SetTargetFrameTime(CPU_TARGET_FRAME_MS);
+	rt.SetTemporalReprojection(true);
+	// Start building the demo scenes' programs now so switching between them doesn't wait
+	Scene* demo_scenes[] = { &book_demo, &magic_sphere_scene, &rainbow_sphere_scene };
+	for (Scene* scene : demo_scenes) {
+		rt.GetGpuShader(*scene);
+	}
+	u64 last_title_time = 0;
 	// Setup Scene ============================================================
 	
 	// Setup Scene ============================================================
@@ -133,6 +184,7 @@ int main(int argc, char* argv[]) {
 	float delta_time = 0;
 	SDL_SetRelativeMouseMode(SDL_TRUE);
 	bool RENDER_CPU = false;
+	bool progressive = true; // Only used on the CPU, dynamic resolution and reprojection apply when it is off
 	Scene* active_scene = &magic_sphere_scene;
 	while (!exit) {
 		previous_time = current_time;
@@ -166,8 +218,41 @@ int main(int argc, char* argv[]) {
 						active_scene = &rainbow_sphere_scene;
 						std::cout << "Scene 3 Loaded." << std::endl;
 					}
+					else if (key == SDLK_F4 && has_file_scene) {
+						active_scene = &file_scene;
+						std::cout << scene_file << " Loaded." << std::endl;
+					}
 					else if (key == SDLK_5) {
 						RENDER_CPU = !RENDER_CPU;
+						SDL_SetWindowTitle(window, "rt demo");
+					}
+					else if (key == SDLK_i) {
+						progressive = !progressive;
+						std::cout << "Progressive refinement: " << (progressive ? "on" : "off") << std::endl;
+					}
+					else if (key == SDLK_t) {
+						rt.SetTemporalReprojection(!rt.GetTemporalReprojection());
+						std::cout << "Temporal reprojection: " << (rt.GetTemporalReprojection() ? "on" : "off") << std::endl;
+					}
+					else if (key == SDLK_b) {
+						rt.SetGpuBackend(rt.GetGpuBackend() == GpuBackend::kTextureBuffers ? GpuBackend::kUniformBuffers : GpuBackend::kTextureBuffers);
+						std::cout << "GPU scene data: " << (rt.GetGpuBackend() == GpuBackend::kTextureBuffers ? "texture buffers" : "uniform buffers") << std::endl;
+					}
+					else if (key == SDLK_g) {
+						if (rt.SetGpuTiming(!rt.GetGpuTiming()) == 0) {
+							std::cout << "GPU timing: " << (rt.GetGpuTiming() ? "on" : "off") << std::endl;
+						}
+						SDL_SetWindowTitle(window, "rt demo");
+					}
+					else if (key == SDLK_F5) {
+						uniform_buffer_programs.Reload();
+						texture_buffer_program.Reload();
+						gpu_failed = false;
+						std::cout << "Reloading shaders..." << std::endl;
+					}
+					else if (key == SDLK_r) {
+						rt.SetTargetFrameTime(rt.GetTargetFrameTime() > 0.0f ? 0.0f : CPU_TARGET_FRAME_MS);
+						std::cout << "Dynamic resolution: " << (rt.GetTargetFrameTime() > 0.0f ? "on" : "off") << std::endl;
 					}
 				}
 				break;
@@ -182,34 +267,99 @@ int main(int argc, char* argv[]) {
 		}
 
 		
-		// Update Uniforms
-		glUniform1f(u_time, (float)SDL_GetTicks64());
-		GLfloat mx[16];
-		memcpy(mx, &active_scene->camera_.RotationX(), 64);
-		GLfloat my[16];
-		memcpy(my, &active_scene->camera_.RotationY(), 64);
-		glUniformMatrix4fv(u_Camera_Rotation_Matrix_X, 1, GL_FALSE, mx);
-		glUniformMatrix4fv(u_Camera_Rotation_Matrix_Y, 1, GL_FALSE, my);
-		GLfloat cam_pos[4] = { 1.0f };
-		memcpy(cam_pos, &active_scene->camera_.position, sizeof(vec3));
-		glUniform4fv(u_Camera_Position,1,cam_pos);
+		// The shader and the scene animate off the same timestamp
+		u64 time_ms = SDL_GetTicks64();
 
 		// Manipulate scene ============================================================
 
 		
 //		rt.camera_.pitch = 90.0f;
 		// Manipulate scene ============================================================
-		active_scene->Update(delta_time);
-		if (RENDER_CPU) {
-			rt.Render(active_scene);
-			SDL_UpdateWindowSurface(window);
+		{
+			RAYTRACE_PROFILE_SCOPE("Scene::Update");
+			active_scene->Update(delta_time, time_ms);
+		}
+
+		if (texture_buffer_program.IsReady() && texture_buffer_program.GetProgramID() != texture_buffer_program_id) {
+			texture_buffer_program_id = texture_buffer_program.GetProgramID();
+			Scene::InitTextureBuffers(texture_buffer_program);
+		}
+		if (uniform_buffer_programs.GetGeneric().HasFailed() && !gpu_failed) {
+			gpu_failed = true;
+			std::cout << "GPU shaders failed to build, rendering on the CPU. Press F5 to try again." << std::endl;
+		}
+		Shader* gpu_shader = rt.GetGpuShader(*active_scene);
+
+		if (RENDER_CPU || gpu_shader == nullptr) {
+			bool drawn = true;
+			if (progressive) {
+				drawn = rt.RenderProgressive(active_scene);
+			}
+			else {
+				rt.Render(active_scene);
+			}
+			if (drawn) {
+				RAYTRACE_PROFILE_SCOPE("Present");
+				if (!canvas_is_xrgb && SDL_ConvertPixels(canvas->w, canvas->h, SDL_PIXELFORMAT_RGB888, window_framebuffer->Row(0), window_framebuffer->GetPitch(),
+					canvas_format->format, canvas->pixels, canvas->pitch) < 0 && !convert_failed) {
+					convert_failed = true;
+					std::cout << "Can't show CPU frames in window pixel format " << SDL_GetPixelFormatName(canvas_format->format) << ": " << SDL_GetError() << std::endl;
+				}
+				SDL_UpdateWindowSurface(window);
+			}
+			else {
+				SDL_Delay(IDLE_DELAY_MS);
+			}
+			// Twice a second is enough to follow the resolution controller
+			if (time_ms - last_title_time >= 500) {
+				last_title_time = time_ms;
+				const FrameTiming& timing = rt.GetLastFrameTiming();
+				std::ostringstream title;
+				title << "rt demo - " << std::fixed << std::setprecision(1) << timing.total_ms << " ms, ";
+				if (progressive) {
+					title << (rt.IsConverged() ? "converged" : "pass " + std::to_string(rt.GetProgressivePass()));
+				}
+				else {
+					title << timing.render_width << "x" << timing.render_height << " (" << (int)(timing.scale * 100.0f + 0.5f) << "%)";
+					const RenderStats& stats = rt.GetLastFrameStats();
+					if (rt.GetTemporalReprojection()) {
+						u64 pixels = (u64)timing.render_width * timing.render_height;
+						title << ", " << (int)(100 * stats.reprojected_pixels / std::max<u64>(pixels, 1)) << "% reused";
+					}
+				}
+				SDL_SetWindowTitle(window, title.str().c_str());
+			}
 		}
 		else {
+			// Update Uniforms, the camera comes from the same per-frame basis the CPU path traces with
+			const CameraRayGenerator& camera_rays = rt.SetupCamera(*active_scene);
+			if (gpu_shader->GetProgramID() != camera_uniforms_program_id) {
+				camera_uniforms_program_id = gpu_shader->GetProgramID();
+				camera_uniforms = GetCameraUniforms(*gpu_shader);
+			}
+			const CameraUniforms& uniforms = camera_uniforms;
+			gpu_shader->Enable();
+			glUniform1f(uniforms.time, (float)time_ms);
+			glUniformMatrix4fv(uniforms.rotation_x, 1, GL_FALSE, &camera_rays.GetRotationX().values_[0][0]);
+			glUniformMatrix4fv(uniforms.rotation_y, 1, GL_FALSE, &camera_rays.GetRotationY().values_[0][0]);
+			vec3 camera_position = camera_rays.GetOrigin();
+			GLfloat cam_pos[4] = { camera_position.x, camera_position.y, camera_position.z, 1.0f };
+			glUniform4fv(uniforms.position, 1, cam_pos);
+			glUniform1i(uniforms.max_bounces, rt.GetMaxBounces());
 			rt.RenderGPU(active_scene);
+			if (rt.GetGpuTiming() && time_ms - last_title_time >= 500) {
+				last_title_time = time_ms;
+				const GpuFrameTiming& timing = rt.GetLastGpuTiming();
+				std::ostringstream title;
+				title << "rt demo - GPU upload " << std::fixed << std::setprecision(2) << timing.upload_ms << " ms, draw " << timing.draw_ms << " ms";
+				SDL_SetWindowTitle(window, title.str().c_str());
+			}
+			RAYTRACE_PROFILE_SCOPE("Present");
 			SDL_GL_SwapWindow(window);
 		}
-
+		RAYTRACE_PROFILE_FRAME();
 
 	}
+	RAYTRACE_PROFILE_WRITE_TRACE(TRACE_FILE);
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,95 @@
+#include "mapped_file.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace raytrace {
+
+#ifdef _WIN32
+	int MappedFile::Open(const std::string& path) {
+		Close();
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			std::cerr << "Could not open " << path << std::endl;
+			return -1;
+		}
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+			std::cerr << "Could not map " << path << ", it is empty or its size can't be read" << std::endl;
+			CloseHandle(file);
+			return -1;
+		}
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+		if (!view) {
+			std::cerr << "Could not map " << path << std::endl;
+			if (mapping) {
+				CloseHandle(mapping);
+			}
+			CloseHandle(file);
+			return -1;
+		}
+		file_ = file;
+		mapping_ = mapping;
+		data_ = (const u8*)view;
+		size_ = (u64)size.QuadPart;
+		return 0;
+	}
+
+	void MappedFile::Close() {
+		if (data_) {
+			UnmapViewOfFile(data_);
+			CloseHandle((HANDLE)mapping_);
+			CloseHandle((HANDLE)file_);
+		}
+		data_ = nullptr;
+		size_ = 0;
+		file_ = nullptr;
+		mapping_ = nullptr;
+	}
+#else
+	int MappedFile::Open(const std::string& path) {
+		Close();
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			std::cerr << "Could not open " << path << std::endl;
+			return -1;
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			std::cerr << "Could not map " << path << ", it is empty or its size can't be read" << std::endl;
+			close(fd);
+			return -1;
+		}
+		void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd); // The mapping keeps the file open
+		if (view == MAP_FAILED) {
+			std::cerr << "Could not map " << path << std::endl;
+			return -1;
+		}
+		// Files are read front to back once, let the OS read ahead
+		madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);
+		data_ = (const u8*)view;
+		size_ = (u64)info.st_size;
+		return 0;
+	}
+
+	void MappedFile::Close() {
+		if (data_) {
+			munmap((void*)data_, (size_t)size_);
+		}
+		data_ = nullptr;
+		size_ = 0;
+	}
+#endif
+} // namespace raytrace
@@ -0,0 +1,35 @@
+#pragma once
+#ifndef RAYTRACE_MAPPED_FILE_H_
+#define	RAYTRACE_MAPPED_FILE_H_
+
+#include <string>
+
+#include "types.h"
+
+namespace raytrace {
+	// Read only view of a whole file mapped into memory, pages are read in by the OS as they are touched.
+	// Uses mmap on POSIX and a file mapping on Windows.
+	class MappedFile {
+	public:
+		MappedFile() {};
+		~MappedFile() { Close(); };
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		// Returns -1 if the file can't be opened or mapped, empty files can't be mapped either
+		int Open(const std::string& path);
+		void Close();
+		bool IsOpen() const { return data_ != nullptr; };
+		const u8* Data() const { return data_; };
+		u64 Size() const { return size_; };
+
+	private:
+		const u8* data_ = nullptr;
+		u64 size_ = 0;
+#ifdef _WIN32
+		void* file_ = nullptr;
+		void* mapping_ = nullptr;
+#endif
+	};
+} // namespace raytrace
+#endif // RAYTRACE_MAPPED_FILE_H_
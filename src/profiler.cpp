@@ -0,0 +1,119 @@
+#include "profiler.h"
+
+#ifdef RAYTRACE_PROFILE
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace raytrace {
+	namespace {
+		const char* COUNTER_NAMES[] = { "primary rays", "reflection rays", "shadow rays", "sphere tests" };
+		static_assert(sizeof(COUNTER_NAMES) / sizeof(COUNTER_NAMES[0]) == (int)ProfileCounter::kCount, "Every counter needs a name");
+
+		const std::chrono::steady_clock::time_point PROFILE_EPOCH = std::chrono::steady_clock::now();
+	} // namespace
+
+	u64 Profiler::NowMicroseconds() {
+		return (u64)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - PROFILE_EPOCH).count();
+	}
+
+	// Small stable numbers read better in the trace viewer than OS thread ids
+	u32 Profiler::ThreadIndex() {
+		thread_local u32 index = next_thread_index_.fetch_add(1);
+		return index;
+	}
+
+	void Profiler::AddScope(const char* name, u64 start_us, u64 end_us) {
+		u32 thread = ThreadIndex();
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (events_.size() < MAX_TRACE_EVENTS) {
+			events_.push_back({ name, thread, start_us, end_us - start_us });
+		}
+		// The same literal can have a different address in another translation unit
+		auto total = std::find_if(window_scopes_.begin(), window_scopes_.end(), [&](const ScopeTotal& scope) {
+			return scope.name == name || strcmp(scope.name, name) == 0;
+		});
+		if (total == window_scopes_.end()) {
+			window_scopes_.push_back({ name, 0, 0 });
+			total = window_scopes_.end() - 1;
+		}
+		total->total_us += end_us - start_us;
+		total->calls++;
+	}
+
+	void Profiler::EndFrame() {
+		u64 now_us = NowMicroseconds();
+		std::lock_guard<std::mutex> lock(mutex_);
+		CounterSample sample;
+		sample.time_us = frame_start_us_;
+		frame_start_us_ = now_us;
+		for (int i = 0; i < NUM_COUNTERS; i++) {
+			u64 total = counters_[i].load(std::memory_order_relaxed);
+			sample.values[i] = total - last_counters_[i];
+			last_counters_[i] = total;
+			window_counters_[i] += sample.values[i];
+		}
+		if (counter_samples_.size() < MAX_TRACE_EVENTS) {
+			counter_samples_.push_back(sample);
+		}
+
+		window_frames_++;
+		if (now_us - window_start_us_ >= (u64)SUMMARY_INTERVAL_MS * 1000) {
+			PrintSummary(now_us);
+			window_scopes_.clear();
+			std::fill(window_counters_, window_counters_ + NUM_COUNTERS, 0);
+			window_start_us_ = now_us;
+			window_frames_ = 0;
+		}
+	}
+
+	// Averages per frame since the last summary. Scopes on worker threads add up, so they can exceed the frame time.
+	void Profiler::PrintSummary(u64 now_us) {
+		double frames = (double)std::max(window_frames_, 1);
+		std::cerr << std::fixed << std::setprecision(2);
+		std::cerr << "[profile] " << window_frames_ << " frames, " << (double)(now_us - window_start_us_) / 1000.0 / frames << " ms/frame" << std::endl;
+		for (const ScopeTotal& scope : window_scopes_) {
+			std::cerr << "  " << std::left << std::setw(32) << scope.name << std::right << std::setw(9) << (double)scope.total_us / 1000.0 / frames
+				<< " ms/frame " << std::setw(8) << (double)scope.calls / frames << " calls/frame" << std::endl;
+		}
+		std::cerr << std::setprecision(0);
+		for (int i = 0; i < NUM_COUNTERS; i++) {
+			std::cerr << "  " << std::left << std::setw(32) << COUNTER_NAMES[i] << std::right << std::setw(9) << (double)window_counters_[i] / frames << " /frame" << std::endl;
+		}
+		std::cerr.unsetf(std::ios::floatfield);
+		std::cerr << std::setprecision(6);
+	}
+
+	int Profiler::WriteTrace(const std::string& path) {
+		std::ofstream file(path, std::ios::out | std::ios::trunc);
+		if (!file.is_open()) {
+			std::cerr << "Can't write the trace to " << path << std::endl;
+			return -1;
+		}
+		std::lock_guard<std::mutex> lock(mutex_);
+		file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+		bool first = true;
+		for (const Event& event : events_) {
+			file << (first ? "" : ",\n") << "{\"name\": \"" << event.name << "\", \"cat\": \"cpu\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << event.thread
+				<< ", \"ts\": " << event.start_us << ", \"dur\": " << event.duration_us << "}";
+			first = false;
+		}
+		// One counter track per counter, each value spans the frame it was counted in
+		for (const CounterSample& sample : counter_samples_) {
+			for (int i = 0; i < NUM_COUNTERS; i++) {
+				file << (first ? "" : ",\n") << "{\"name\": \"" << COUNTER_NAMES[i] << "\", \"ph\": \"C\", \"pid\": 0, \"ts\": " << sample.time_us
+					<< ", \"args\": {\"per frame\": " << sample.values[i] << "}}";
+				first = false;
+			}
+		}
+		file << "\n]}\n";
+		std::cerr << "Wrote " << events_.size() << " trace events to " << path << std::endl;
+		return 0;
+	}
+} // namespace raytrace
+
+#endif // RAYTRACE_PROFILE
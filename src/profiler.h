@@ -0,0 +1,111 @@
+#pragma once
+#ifndef RAYTRACE_PROFILER_H_
+#define	RAYTRACE_PROFILER_H_
+
+// Instrumentation of the main loop and the CPU renderer, only compiled in when RAYTRACE_PROFILE is defined.
+// Without it every macro expands to nothing, arguments included.
+//
+//   RAYTRACE_PROFILE_SCOPE("name")         Times the rest of the enclosing scope, name must be a string literal
+//   RAYTRACE_PROFILE_COUNT(kCounter, n)    Adds n to a ProfileCounter
+//   RAYTRACE_PROFILE_FRAME()               Ends a frame, prints a summary every SUMMARY_INTERVAL_MS
+//   RAYTRACE_PROFILE_WRITE_TRACE("path")   Writes everything recorded as Chrome trace_event JSON,
+//                                          open it in chrome://tracing or ui.perfetto.dev
+
+#ifdef RAYTRACE_PROFILE
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+namespace raytrace {
+	enum class ProfileCounter {
+		kPrimaryRays = 0,
+		kReflectionRays,
+		kShadowRays,
+		kSphereTests,
+		kCount
+	};
+
+	class Profiler {
+	public:
+		static const int SUMMARY_INTERVAL_MS = 1000;
+		// Events past this are dropped from the trace, the summary keeps counting. About a minute of CPU frames.
+		static const size_t MAX_TRACE_EVENTS = 1 << 20;
+
+		static u64 NowMicroseconds();
+		static void AddScope(const char* name, u64 start_us, u64 end_us);
+		static void AddCount(ProfileCounter counter, u64 value) {
+			counters_[(int)counter].fetch_add(value, std::memory_order_relaxed);
+		}
+		static void EndFrame();
+		static int WriteTrace(const std::string& path);
+
+	private:
+		static const int NUM_COUNTERS = (int)ProfileCounter::kCount;
+		struct Event {
+			const char* name;
+			u32 thread;
+			u64 start_us;
+			u64 duration_us;
+		};
+		// Counter values of one frame
+		struct CounterSample {
+			u64 time_us;
+			u64 values[NUM_COUNTERS];
+		};
+		struct ScopeTotal {
+			const char* name;
+			u64 total_us;
+			u64 calls;
+		};
+		static u32 ThreadIndex();
+		static void PrintSummary(u64 now_us);
+
+		static inline std::atomic<u64> counters_[NUM_COUNTERS] = {};
+		static inline std::atomic<u32> next_thread_index_ = 0;
+
+		// Everything below is guarded by mutex_
+		static inline std::mutex mutex_;
+		static inline std::vector<Event> events_;
+		static inline std::vector<CounterSample> counter_samples_;
+		static inline u64 last_counters_[NUM_COUNTERS] = {};
+		static inline u64 frame_start_us_ = 0;
+		// Since the last summary
+		static inline std::vector<ScopeTotal> window_scopes_;
+		static inline u64 window_counters_[NUM_COUNTERS] = {};
+		static inline u64 window_start_us_ = 0;
+		static inline int window_frames_ = 0;
+	};
+
+	class ProfileScope {
+	public:
+		explicit ProfileScope(const char* name) : name_(name), start_us_(Profiler::NowMicroseconds()) {};
+		~ProfileScope() { Profiler::AddScope(name_, start_us_, Profiler::NowMicroseconds()); };
+		ProfileScope(const ProfileScope&) = delete;
+		ProfileScope& operator=(const ProfileScope&) = delete;
+
+	private:
+		const char* name_;
+		u64 start_us_;
+	};
+} // namespace raytrace
+
+#define RAYTRACE_PROFILE_CONCAT_(a, b) a##b
+#define RAYTRACE_PROFILE_CONCAT(a, b) RAYTRACE_PROFILE_CONCAT_(a, b)
+#define RAYTRACE_PROFILE_SCOPE(name) ::raytrace::ProfileScope RAYTRACE_PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define RAYTRACE_PROFILE_COUNT(counter, value) ::raytrace::Profiler::AddCount(::raytrace::ProfileCounter::counter, value)
+#define RAYTRACE_PROFILE_FRAME() ::raytrace::Profiler::EndFrame()
+#define RAYTRACE_PROFILE_WRITE_TRACE(path) ::raytrace::Profiler::WriteTrace(path)
+
+#else
+
+#define RAYTRACE_PROFILE_SCOPE(name) ((void)0)
+#define RAYTRACE_PROFILE_COUNT(counter, value) ((void)0)
+#define RAYTRACE_PROFILE_FRAME() ((void)0)
+#define RAYTRACE_PROFILE_WRITE_TRACE(path) ((void)0)
+
+#endif // RAYTRACE_PROFILE
+#endif // RAYTRACE_PROFILER_H_
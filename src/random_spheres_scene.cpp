@@ -0,0 +1,59 @@
+#include "random_spheres_scene.h"
+
+#include <random>
+
+#include "util.h"
+
+namespace raytrace {
+
+	RandomSpheresScene::RandomSpheresScene(int num_spheres, u32 seed, bool animated) :animated_(animated) {
+		// mt19937 produces the same sequence everywhere, the standard distributions don't
+		std::mt19937 rng(seed);
+		auto random_float = [&rng](float min, float max) {
+			return min + (max - min) * (float)(rng() >> 8) * (1.0f / 16777216.0f);
+		};
+
+		// The cloud grows with the sphere count so the density stays about the same
+		float half_extent = std::max(2.0f, cbrtf((float)num_spheres));
+		cloud_center_ = vec3(0.0f, 0.0f, 2.0f + half_extent);
+		for (int i = 0; i < num_spheres; i++) {
+			vec3 center;
+			if (animated) {
+				// Spread evenly over the cylinder's disc so nothing leaves the cloud's box while circling
+				float orbit_radius = half_extent * sqrtf(random_float(0.0f, 1.0f));
+				float orbit_angle = random_float(0.0f, 2.0f * (float)M_PI);
+				float height = random_float(-half_extent, half_extent);
+				animator_.Add(orbit_radius, orbit_angle, random_float(0.5f, 1.5f), height, random_float(0.0f, 2.0f * (float)M_PI));
+				center = cloud_center_ + vec3(orbit_radius * cosf(orbit_angle), height, orbit_radius * sinf(orbit_angle));
+			}
+			else {
+				center = vec3(random_float(-half_extent, half_extent),
+					random_float(-half_extent, half_extent),
+					random_float(2.0f, 2.0f + 2.0f * half_extent));
+			}
+			float radius = random_float(0.1f, 0.4f);
+			Color color((u8)(rng() & 0xFF), (u8)(rng() & 0xFF), (u8)(rng() & 0xFF));
+			int specular = (int)random_float(10.0f, 1000.0f);
+			float reflective = random_float(0.0f, 0.5f);
+			// Straight into the store, a Sphere handle each would only cost an allocation per sphere
+			sphere_store_.Add(center, radius, { color, specular, reflective });
+		}
+		(*pl_ref).position = vec3(0.0f, half_extent, half_extent);
+		AddLight(al_ref);
+		AddLight(pl_ref);
+		AddLight(dl_ref);
+	}
+
+	void RandomSpheresScene::Update(float delta_time, u64 time_ms) {
+		if (!animated_) {
+			return;
+		}
+		float x = (float)time_ms;
+		SphereAnimator::Frame frame;
+		frame.orbit_center = cloud_center_;
+		frame.orbit_angle = x * (2.0f * (float)M_PI / 60000.0f); // A turn a minute at speed 1
+		frame.bob_angle = x * (2.0f * (float)M_PI / 2000.0f);
+		frame.bob_amplitude = 0.25f;
+		animator_.Evaluate(frame, sphere_store_);
+	}
+}
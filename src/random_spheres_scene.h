@@ -0,0 +1,28 @@
+#pragma once
+#ifndef RAYTRACE_RANDOM_SPHERES_SCENE_H_
+#define	RAYTRACE_RANDOM_SPHERES_SCENE_H_
+
+#include "scene.h"
+#include "sphere_animator.h"
+
+namespace raytrace {
+	// A cloud of num_spheres random spheres in front of the camera, used for benchmarking.
+	// The same seed always gives the same scene on every platform.
+	// Too big for the GPU uniform blocks, the GPU path draws it from texture buffers.
+	// Animated clouds are a cylinder of spheres that circle its axis at their own speed and bob up and down.
+	class RandomSpheresScene : public Scene {
+	public:
+		RandomSpheresScene(int num_spheres, u32 seed = 1, bool animated = false);
+
+		void Update(float delta_time, u64 time_ms) override;
+
+	private:
+		bool animated_;
+		vec3 cloud_center_ = vec3(0.0f, 0.0f, 0.0f);
+		SphereAnimator animator_;
+		std::shared_ptr<Light> al_ref = std::make_shared<Light>(Light::AmbientLight(0.2f));
+		std::shared_ptr<Light> pl_ref = std::make_shared<Light>(Light::PointLight(0.6f, vec3(0, 0, 0)));
+		std::shared_ptr<Light> dl_ref = std::make_shared<Light>(Light::DirectionalLight(0.2f, vec3(1, 4, -4)));
+	};
+} // namespace raytrace
+#endif // RAYTRACE_RANDOM_SPHERES_SCENE_H_
@@ -0,0 +1,248 @@
+#include "ray_packet.h"
+
+#include <cfloat>
+#include <math.h>
+
+namespace raytrace {
+
+	// All kernels evaluate the quadratic in the same order as RayTracer::IntersectRaySphere, or IntersectRaySphereFast
+	// when FAST is set, so packet and single ray tracing agree on every hit.
+	template <bool FAST>
+	static void IntersectPacketScalar(const RayPacket& packet, const SphereGeometry& geometry, PacketHits& hits) {
+		for (int lane = 0; lane < packet.num_rays; lane++) {
+			float ox = packet.origin_x[lane], oy = packet.origin_y[lane], oz = packet.origin_z[lane];
+			float dx = packet.direction_x[lane], dy = packet.direction_y[lane], dz = packet.direction_z[lane];
+			float t_min = packet.t_min[lane];
+			float t_max = packet.t_max[lane];
+			float a = dx * dx + dy * dy + dz * dz;
+			float inv_a = FAST ? 1.0f / a : 0.0f;
+			float closest_t = FLT_MAX;
+			int closest_sphere = -1;
+			for (int i = 0; i < geometry.count; i++) {
+				float cox = ox - geometry.center_x[i];
+				float coy = oy - geometry.center_y[i];
+				float coz = oz - geometry.center_z[i];
+				float c = (cox * cox + coy * coy + coz * coz) - geometry.radius_sq[i];
+				float t1, t2;
+				if constexpr (FAST) {
+					float half_b = cox * dx + coy * dy + coz * dz;
+					float discriminant = half_b * half_b - a * c;
+					if (discriminant < 0) {
+						continue;
+					}
+					float root = sqrtf(discriminant);
+					t1 = (-half_b + root) * inv_a;
+					t2 = (-half_b - root) * inv_a;
+				}
+				else {
+					float b = 2 * (cox * dx + coy * dy + coz * dz);
+					float discriminant = b * b - 4 * a * c;
+					if (discriminant < 0) {
+						continue;
+					}
+					t1 = (-b + sqrt(discriminant)) / (2 * a);
+					t2 = (-b - sqrt(discriminant)) / (2 * a);
+				}
+				if (t1 > t_min && t1 < t_max && t1 < closest_t) {
+					closest_t = t1;
+					closest_sphere = i;
+				}
+				if (t2 > t_min && t2 < t_max && t2 < closest_t) {
+					closest_t = t2;
+					closest_sphere = i;
+				}
+			}
+			hits.t[lane] = closest_t;
+			hits.sphere[lane] = closest_sphere;
+		}
+	}
+
+#ifdef RAYTRACE_X86
+	template <bool FAST>
+	RAYTRACE_TARGET("sse4.1")
+	static void IntersectPacketSSE41(const RayPacket& packet, const SphereGeometry& geometry, PacketHits& hits) {
+		const __m128 two = _mm_set1_ps(2.0f);
+		const __m128 four = _mm_set1_ps(4.0f);
+		const __m128 zero = _mm_setzero_ps();
+		for (int lane = 0; lane < packet.num_rays; lane += 4) {
+			__m128 ox = _mm_load_ps(packet.origin_x + lane);
+			__m128 oy = _mm_load_ps(packet.origin_y + lane);
+			__m128 oz = _mm_load_ps(packet.origin_z + lane);
+			__m128 dx = _mm_load_ps(packet.direction_x + lane);
+			__m128 dy = _mm_load_ps(packet.direction_y + lane);
+			__m128 dz = _mm_load_ps(packet.direction_z + lane);
+			__m128 t_min = _mm_load_ps(packet.t_min + lane);
+			__m128 t_max = _mm_load_ps(packet.t_max + lane);
+			__m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			__m128 two_a = _mm_mul_ps(two, a);
+			__m128 inv_a = FAST ? _mm_div_ps(_mm_set1_ps(1.0f), a) : zero;
+			__m128 four_a = _mm_mul_ps(four, a);
+			__m128 active = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32(packet.num_rays - lane), _mm_setr_epi32(0, 1, 2, 3)));
+			__m128 closest_t = _mm_set1_ps(FLT_MAX);
+			__m128i closest_sphere = _mm_set1_epi32(-1);
+			for (int i = 0; i < geometry.count; i++) {
+				__m128 cox = _mm_sub_ps(ox, _mm_set1_ps(geometry.center_x[i]));
+				__m128 coy = _mm_sub_ps(oy, _mm_set1_ps(geometry.center_y[i]));
+				__m128 coz = _mm_sub_ps(oz, _mm_set1_ps(geometry.center_z[i]));
+				__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cox, dx), _mm_mul_ps(coy, dy)), _mm_mul_ps(coz, dz));
+				__m128 b = FAST ? dot : _mm_mul_ps(two, dot);
+				__m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(cox, cox), _mm_mul_ps(coy, coy)), _mm_mul_ps(coz, coz)), _mm_set1_ps(geometry.radius_sq[i]));
+				__m128 discriminant = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(FAST ? a : four_a, c));
+				__m128 real_roots = _mm_and_ps(active, _mm_cmpge_ps(discriminant, zero));
+				if (_mm_movemask_ps(real_roots) == 0) {
+					continue;
+				}
+				__m128 root = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+				__m128 neg_b = _mm_sub_ps(zero, b);
+				__m128 t1 = FAST ? _mm_mul_ps(_mm_add_ps(neg_b, root), inv_a) : _mm_div_ps(_mm_add_ps(neg_b, root), two_a);
+				__m128 t2 = FAST ? _mm_mul_ps(_mm_sub_ps(neg_b, root), inv_a) : _mm_div_ps(_mm_sub_ps(neg_b, root), two_a);
+				__m128i index = _mm_set1_epi32(i);
+
+				__m128 closer = _mm_and_ps(_mm_and_ps(real_roots, _mm_cmpgt_ps(t1, t_min)), _mm_and_ps(_mm_cmplt_ps(t1, t_max), _mm_cmplt_ps(t1, closest_t)));
+				closest_t = _mm_blendv_ps(closest_t, t1, closer);
+				closest_sphere = _mm_blendv_epi8(closest_sphere, index, _mm_castps_si128(closer));
+
+				closer = _mm_and_ps(_mm_and_ps(real_roots, _mm_cmpgt_ps(t2, t_min)), _mm_and_ps(_mm_cmplt_ps(t2, t_max), _mm_cmplt_ps(t2, closest_t)));
+				closest_t = _mm_blendv_ps(closest_t, t2, closer);
+				closest_sphere = _mm_blendv_epi8(closest_sphere, index, _mm_castps_si128(closer));
+			}
+			_mm_store_ps(hits.t + lane, closest_t);
+			_mm_store_si128((__m128i*)(hits.sphere + lane), closest_sphere);
+		}
+	}
+
+	template <bool FAST>
+	RAYTRACE_TARGET("avx2")
+	static void IntersectPacketAVX2(const RayPacket& packet, const SphereGeometry& geometry, PacketHits& hits) {
+		const __m256 two = _mm256_set1_ps(2.0f);
+		const __m256 four = _mm256_set1_ps(4.0f);
+		const __m256 zero = _mm256_setzero_ps();
+		for (int lane = 0; lane < packet.num_rays; lane += 8) {
+			__m256 ox = _mm256_load_ps(packet.origin_x + lane);
+			__m256 oy = _mm256_load_ps(packet.origin_y + lane);
+			__m256 oz = _mm256_load_ps(packet.origin_z + lane);
+			__m256 dx = _mm256_load_ps(packet.direction_x + lane);
+			__m256 dy = _mm256_load_ps(packet.direction_y + lane);
+			__m256 dz = _mm256_load_ps(packet.direction_z + lane);
+			__m256 t_min = _mm256_load_ps(packet.t_min + lane);
+			__m256 t_max = _mm256_load_ps(packet.t_max + lane);
+			__m256 a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+			__m256 two_a = _mm256_mul_ps(two, a);
+			__m256 inv_a = FAST ? _mm256_div_ps(_mm256_set1_ps(1.0f), a) : zero;
+			__m256 four_a = _mm256_mul_ps(four, a);
+			__m256 active = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(packet.num_rays - lane), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+			__m256 closest_t = _mm256_set1_ps(FLT_MAX);
+			__m256i closest_sphere = _mm256_set1_epi32(-1);
+			for (int i = 0; i < geometry.count; i++) {
+				__m256 cox = _mm256_sub_ps(ox, _mm256_set1_ps(geometry.center_x[i]));
+				__m256 coy = _mm256_sub_ps(oy, _mm256_set1_ps(geometry.center_y[i]));
+				__m256 coz = _mm256_sub_ps(oz, _mm256_set1_ps(geometry.center_z[i]));
+				__m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cox, dx), _mm256_mul_ps(coy, dy)), _mm256_mul_ps(coz, dz));
+				__m256 b = FAST ? dot : _mm256_mul_ps(two, dot);
+				__m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cox, cox), _mm256_mul_ps(coy, coy)), _mm256_mul_ps(coz, coz)), _mm256_set1_ps(geometry.radius_sq[i]));
+				__m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(FAST ? a : four_a, c));
+				__m256 real_roots = _mm256_and_ps(active, _mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ));
+				if (_mm256_movemask_ps(real_roots) == 0) {
+					continue;
+				}
+				__m256 root = _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+				__m256 neg_b = _mm256_sub_ps(zero, b);
+				__m256 t1 = FAST ? _mm256_mul_ps(_mm256_add_ps(neg_b, root), inv_a) : _mm256_div_ps(_mm256_add_ps(neg_b, root), two_a);
+				__m256 t2 = FAST ? _mm256_mul_ps(_mm256_sub_ps(neg_b, root), inv_a) : _mm256_div_ps(_mm256_sub_ps(neg_b, root), two_a);
+				__m256i index = _mm256_set1_epi32(i);
+
+				__m256 closer = _mm256_and_ps(_mm256_and_ps(real_roots, _mm256_cmp_ps(t1, t_min, _CMP_GT_OQ)),
+					_mm256_and_ps(_mm256_cmp_ps(t1, t_max, _CMP_LT_OQ), _mm256_cmp_ps(t1, closest_t, _CMP_LT_OQ)));
+				closest_t = _mm256_blendv_ps(closest_t, t1, closer);
+				closest_sphere = _mm256_blendv_epi8(closest_sphere, index, _mm256_castps_si256(closer));
+
+				closer = _mm256_and_ps(_mm256_and_ps(real_roots, _mm256_cmp_ps(t2, t_min, _CMP_GT_OQ)),
+					_mm256_and_ps(_mm256_cmp_ps(t2, t_max, _CMP_LT_OQ), _mm256_cmp_ps(t2, closest_t, _CMP_LT_OQ)));
+				closest_t = _mm256_blendv_ps(closest_t, t2, closer);
+				closest_sphere = _mm256_blendv_epi8(closest_sphere, index, _mm256_castps_si256(closer));
+			}
+			_mm256_store_ps(hits.t + lane, closest_t);
+			_mm256_store_si256((__m256i*)(hits.sphere + lane), closest_sphere);
+		}
+	}
+
+	template <bool FAST>
+	RAYTRACE_TARGET("avx512f")
+	static void IntersectPacketAVX512(const RayPacket& packet, const SphereGeometry& geometry, PacketHits& hits) {
+		const __m512 two = _mm512_set1_ps(2.0f);
+		const __m512 four = _mm512_set1_ps(4.0f);
+		const __m512 zero = _mm512_setzero_ps();
+		__m512 ox = _mm512_load_ps(packet.origin_x);
+		__m512 oy = _mm512_load_ps(packet.origin_y);
+		__m512 oz = _mm512_load_ps(packet.origin_z);
+		__m512 dx = _mm512_load_ps(packet.direction_x);
+		__m512 dy = _mm512_load_ps(packet.direction_y);
+		__m512 dz = _mm512_load_ps(packet.direction_z);
+		__m512 t_min = _mm512_load_ps(packet.t_min);
+		__m512 t_max = _mm512_load_ps(packet.t_max);
+		__m512 a = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_mul_ps(dz, dz));
+		__m512 two_a = _mm512_mul_ps(two, a);
+		__m512 inv_a = FAST ? _mm512_div_ps(_mm512_set1_ps(1.0f), a) : zero;
+		__m512 four_a = _mm512_mul_ps(four, a);
+		__m512 closest_t = _mm512_set1_ps(FLT_MAX);
+		__m512i closest_sphere = _mm512_set1_epi32(-1);
+		__mmask16 active = (__mmask16)((1u << packet.num_rays) - 1);
+		for (int i = 0; i < geometry.count; i++) {
+			__m512 cox = _mm512_sub_ps(ox, _mm512_set1_ps(geometry.center_x[i]));
+			__m512 coy = _mm512_sub_ps(oy, _mm512_set1_ps(geometry.center_y[i]));
+			__m512 coz = _mm512_sub_ps(oz, _mm512_set1_ps(geometry.center_z[i]));
+			__m512 dot = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(cox, dx), _mm512_mul_ps(coy, dy)), _mm512_mul_ps(coz, dz));
+			__m512 b = FAST ? dot : _mm512_mul_ps(two, dot);
+			__m512 c = _mm512_sub_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(cox, cox), _mm512_mul_ps(coy, coy)), _mm512_mul_ps(coz, coz)), _mm512_set1_ps(geometry.radius_sq[i]));
+			__m512 discriminant = _mm512_sub_ps(_mm512_mul_ps(b, b), _mm512_mul_ps(FAST ? a : four_a, c));
+			__mmask16 real_roots = _mm512_mask_cmp_ps_mask(active, discriminant, zero, _CMP_GE_OQ);
+			if (real_roots == 0) {
+				continue;
+			}
+			__m512 root = _mm512_sqrt_ps(_mm512_max_ps(discriminant, zero));
+			__m512 neg_b = _mm512_sub_ps(zero, b);
+			__m512 t1 = FAST ? _mm512_mul_ps(_mm512_add_ps(neg_b, root), inv_a) : _mm512_div_ps(_mm512_add_ps(neg_b, root), two_a);
+			__m512 t2 = FAST ? _mm512_mul_ps(_mm512_sub_ps(neg_b, root), inv_a) : _mm512_div_ps(_mm512_sub_ps(neg_b, root), two_a);
+			__m512i index = _mm512_set1_epi32(i);
+
+			__mmask16 closer = _mm512_mask_cmp_ps_mask(real_roots, t1, t_min, _CMP_GT_OQ);
+			closer = _mm512_mask_cmp_ps_mask(closer, t1, t_max, _CMP_LT_OQ);
+			closer = _mm512_mask_cmp_ps_mask(closer, t1, closest_t, _CMP_LT_OQ);
+			closest_t = _mm512_mask_blend_ps(closer, closest_t, t1);
+			closest_sphere = _mm512_mask_blend_epi32(closer, closest_sphere, index);
+
+			closer = _mm512_mask_cmp_ps_mask(real_roots, t2, t_min, _CMP_GT_OQ);
+			closer = _mm512_mask_cmp_ps_mask(closer, t2, t_max, _CMP_LT_OQ);
+			closer = _mm512_mask_cmp_ps_mask(closer, t2, closest_t, _CMP_LT_OQ);
+			closest_t = _mm512_mask_blend_ps(closer, closest_t, t2);
+			closest_sphere = _mm512_mask_blend_epi32(closer, closest_sphere, index);
+		}
+		_mm512_store_ps(hits.t, closest_t);
+		_mm512_store_si512((__m512i*)hits.sphere, closest_sphere);
+	}
+#endif
+
+	using IntersectPacketFn = void (*)(const RayPacket&, const SphereGeometry&, PacketHits&);
+	template <bool FAST>
+	static IntersectPacketFn SelectIntersectPacket() {
+		switch (DetectSimdLevel()) {
+#ifdef RAYTRACE_X86
+		case SimdLevel::kAVX512:
+			return IntersectPacketAVX512<FAST>;
+		case SimdLevel::kAVX2:
+			return IntersectPacketAVX2<FAST>;
+		case SimdLevel::kSSE41:
+			return IntersectPacketSSE41<FAST>;
+#endif
+		default:
+			return IntersectPacketScalar<FAST>;
+		}
+	}
+
+	void IntersectPacket(const RayPacket& packet, const SphereGeometry& geometry, PacketHits& hits, bool fast_math) {
+		// Resolved once, the first time any thread traces a packet
+		static const IntersectPacketFn intersect_packet = SelectIntersectPacket<false>();
+		static const IntersectPacketFn intersect_packet_fast = SelectIntersectPacket<true>();
+		(fast_math ? intersect_packet_fast : intersect_packet)(packet, geometry, hits);
+	}
+} // namespace raytrace
@@ -0,0 +1,55 @@
+#pragma once
+#ifndef RAYTRACE_RAY_PACKET_H_
+#define	RAYTRACE_RAY_PACKET_H_
+
+#include "simd.h"
+#include "types.h"
+
+namespace raytrace {
+	// Read-only view over packed sphere geometry, one entry per sphere in every array
+	struct SphereGeometry {
+		const float* center_x = nullptr;
+		const float* center_y = nullptr;
+		const float* center_z = nullptr;
+		const float* radius_sq = nullptr;
+		int count = 0;
+	};
+
+	// Up to MAX_RAYS rays stored as structure of arrays so a whole register of rays
+	// can be tested against one sphere at a time. Lanes past num_rays are ignored.
+	struct RayPacket {
+		static const int MAX_RAYS = 16;
+		alignas(64) float origin_x[MAX_RAYS] = {};
+		alignas(64) float origin_y[MAX_RAYS] = {};
+		alignas(64) float origin_z[MAX_RAYS] = {};
+		alignas(64) float direction_x[MAX_RAYS] = {};
+		alignas(64) float direction_y[MAX_RAYS] = {};
+		alignas(64) float direction_z[MAX_RAYS] = {};
+		alignas(64) float t_min[MAX_RAYS] = {};
+		alignas(64) float t_max[MAX_RAYS] = {};
+		int num_rays = 0;
+
+		// Returns the lane the ray was written to
+		int AddRay(vec3 origin, vec3 direction, float min_t, float max_t) {
+			int lane = num_rays++;
+			origin_x[lane] = origin.x;
+			origin_y[lane] = origin.y;
+			origin_z[lane] = origin.z;
+			direction_x[lane] = direction.x;
+			direction_y[lane] = direction.y;
+			direction_z[lane] = direction.z;
+			t_min[lane] = min_t;
+			t_max[lane] = max_t;
+			return lane;
+		}
+	};
+	struct PacketHits {
+		alignas(64) float t[RayPacket::MAX_RAYS];
+		alignas(64) int sphere[RayPacket::MAX_RAYS]; // -1 when the ray missed everything
+	};
+
+	// Finds the closest sphere in (t_min, t_max) for every ray of the packet.
+	// Gives the same answers as running RayTracer::IntersectRaySphere over each sphere, or IntersectRaySphereFast with fast_math.
+	void IntersectPacket(const RayPacket& packet, const SphereGeometry& geometry, PacketHits& hits, bool fast_math = false);
+} // namespace raytrace
+#endif // RAYTRACE_RAY_PACKET_H_
@@ -1,6 +1,7 @@
 #include "raytracer.h"
 
 #include <algorithm>
+#include <chrono>
 #include <math.h>
 #include <tuple>
 
@@ -9,91 +10,209 @@
 #include <SDL_opengl.h>
 
 
+#include "fast_math.h"
+#include "profiler.h"
 #include "util.h"
 #include "sphere.h"
 
 namespace raytrace {
-	RayTracer::RayTracer(SDL_Surface* canvas, Scene* default_scene) : canvas_(canvas),scene_(default_scene) {
+	RayTracer::RayTracer(Framebuffer* canvas, Scene* default_scene) : canvas_(canvas),scene_(default_scene) {
+		SetThreadCount(ThreadPool::DefaultThreadCount());
 	};
 
-	// x and y are assumed to be from a centered origin, in the range	x: -width/2 -> width/2 - 1, y: -height/2 -> height/2 - 1
-	int RayTracer::putPixel(SDL_Surface* canvas, int x, int y, Color c) {
+	vec3 ReflectRay(vec3 ray_to_reflect, vec3 normal_to_reflect_over) {
+		return normal_to_reflect_over * (2.0f * normal_to_reflect_over.dot(ray_to_reflect)) - ray_to_reflect;
+	}
+	// True if either solution of IntersectRaySphere lies within (t_min, t_max)
+	bool HitWithin(vec2 intersects, float t_min, float t_max) {
+		return ((intersects.x > t_min) && (intersects.x < t_max)) || ((intersects.y > t_min) && (intersects.y < t_max));
+	}
+	// Shadow rays start this far along the light vector so the surface doesn't shadow itself
+	const float SHADOW_T_MIN = 0.01f;
+	// How far along the light vector a shadow ray goes. The vector to a point light ends on the light,
+	// so anything past t = 1 is behind it and can't cast a shadow.
+	const float POINT_LIGHT_MAX_T = 1.0f;
+	// One over the length of v, v can't be zero. FAST picks the fast_math.h version, it is a template parameter
+	// so the exact path never computes both.
+	template <bool FAST>
+	float InverseLength(vec3 v) {
+		if constexpr (FAST) {
+			return RsqrtFast(v.dot(v));
+		}
+		else {
+			return 1.0f / vec3::Length(v);
+		}
+	}
+	template <bool FAST>
+	vec3 Normalize(vec3 v) {
+		if constexpr (FAST) {
+			return v * RsqrtFast(v.dot(v));
+		}
+		else {
+			return v / vec3::Length(v);
+		}
+	}
+	// Adds the diffuse and specular contribution of an unobstructed light. normal is unit length, inv_light_length
+	// and inv_camera_length are one over the lengths of light_vec and vec_to_camera.
+	template <bool FAST>
+	void AddDirectLight(float& intensity, float light_intensity, vec3 light_vec, float inv_light_length, vec3 normal, vec3 vec_to_camera, float inv_camera_length, int s) {
+		// Diffuse 
+		float n_dot_l = normal.dot(light_vec);
+		if (n_dot_l > 0) {
+			intensity += light_intensity * n_dot_l * inv_light_length;
+		}
 
-		x = x + canvas->w / 2;
-		// y is subtracted from width/2 because positive values of y in a centered origin 
-		// // would index down farther in the array of pixels, tdlr it flips the y.
-		// Need to subract 1 from y to make the xy input ranges the same
-		// because positive values map from 0->249 and negative from -1->-250
-		y = canvas->h / 2 - y - 1;
+		// Specular
+		if (s != -1) {
+			// Reflecting over a unit normal keeps the length, so the reflection is as long as light_vec
+			vec3 reflection = ReflectRay(light_vec, normal);
+			float r_dot_v = reflection.dot(vec_to_camera);
 
-		if (SDL_PIXELFORMAT_XRGB8888 != canvas->format->format) {
-			std::cout << "Idk bout that format" << std::endl;
-			return -1;
+			// Reflection is facing the camera.
+			// angle between reflection and camera is less than 90 degrees
+			if (r_dot_v > 0.05f) { 
+				float cos_angle = r_dot_v * inv_light_length * inv_camera_length;
+				intensity += light_intensity * (FAST ? PowInt(cos_angle, s) : pow(cos_angle, s));
+			}
 		}
-		u32* pixel = (u32*)((u8*)canvas->pixels + x * canvas->format->BytesPerPixel + y * canvas->pitch);
-		*pixel = c.xrgb_pixel;
-		return 0;
 	}
-	vec3 ReflectRay(vec3 ray_to_reflect, vec3 normal_to_reflect_over) {
-		return normal_to_reflect_over * (2.0f * normal_to_reflect_over.dot(ray_to_reflect)) - ray_to_reflect;
+	// light numbers the occluder cache entry, see LightSet::GetShadowCasterCount
+	bool RayTracer::InShadow(const Scene& scene, vec3 point, vec3 light_vec, float t_min, float t_max, int light, TraceContext& context) const {
+		// The sphere that blocked this light last time is the most likely blocker
+		context.stats.shadow_rays++;
+		int cached_occluder = context.occluder_cache.Get(light);
+		if (cached_occluder != -1) {
+			context.stats.occluder_cache_tests++;
+			context.stats.intersection_tests++;
+			vec3 center = scene.sphere_store_.GetCenter(cached_occluder);
+			float radius_sq = scene.sphere_store_.GetRadiusSquared(cached_occluder);
+			float a = light_vec.dot(light_vec);
+			vec2 intersects = fast_math_ ? IntersectRaySphereFast(point, light_vec, a, 1.0f / a, center, radius_sq) : IntersectRaySphere(point, light_vec, center, radius_sq);
+			if (HitWithin(intersects, t_min, t_max)) {
+				context.stats.occluder_cache_hits++;
+				return true;
+			}
+		}
+		int occluder = FindOccluder(scene, point, light_vec, t_min, t_max, context);
+		if (occluder != -1) {
+			context.occluder_cache.Set(light, occluder);
+			return true;
+		}
+		return false;
+	}
+	// s is the specular exponent, normal is unit length
+	float RayTracer::ComputeLighting(const Scene& scene, vec3 point, vec3 normal, vec3 vec_to_camera, int s, TraceContext& context) const {
+		return fast_math_ ? ComputeLightingKernel<true>(scene, point, normal, vec_to_camera, s, context)
+			: ComputeLightingKernel<false>(scene, point, normal, vec_to_camera, s, context);
 	}
-	// s is the specular exponent
-	float RayTracer::ComputeLighting(vec3 point, vec3 normal, vec3 vec_to_camera, int s) {
+	template <bool FAST>
+	float RayTracer::ComputeLightingKernel(const Scene& scene, vec3 point, vec3 normal, vec3 vec_to_camera, int s, TraceContext& context) const {
+		const LightSet& lights = scene.light_set_;
+		float intensity = lights.GetAmbient();
+		float inv_camera_length = s != -1 ? InverseLength<FAST>(vec_to_camera) : 0.0f;
 
-		float intensity = 0.0f;
+		for (int i = 0; i < lights.GetPointCount(); i++) {
+			vec3 light_vec = lights.GetPointPosition(i) - point;
+			if (InShadow(scene, point, light_vec, SHADOW_T_MIN, POINT_LIGHT_MAX_T, i, context)) {
+				continue;
+			}
+			AddDirectLight<FAST>(intensity, lights.GetPointIntensity(i), light_vec, InverseLength<FAST>(light_vec), normal, vec_to_camera, inv_camera_length, s);
+		}
+		for (int i = 0; i < lights.GetDirectionalCount(); i++) {
+			vec3 light_vec = lights.GetDirection(i);
+			if (InShadow(scene, point, light_vec, SHADOW_T_MIN * lights.GetDirectionLength(i), FLT_MAX, lights.GetPointCount() + i, context)) {
+				continue;
+			}
+			AddDirectLight<FAST>(intensity, lights.GetDirectionalIntensity(i), light_vec, 1.0f, normal, vec_to_camera, inv_camera_length, s);
+		}
+		return intensity;
+	}
+	// Packet version of ComputeLighting, the shadow rays of all points are traced together for each light
+	void RayTracer::ComputeLightingPacket(const Scene& scene, int count, const vec3* points, const vec3* normals, const vec3* vecs_to_camera, const int* specular, float* intensities, TraceContext& context) const {
+		if (fast_math_) {
+			ComputeLightingPacketKernel<true>(scene, count, points, normals, vecs_to_camera, specular, intensities, context);
+		}
+		else {
+			ComputeLightingPacketKernel<false>(scene, count, points, normals, vecs_to_camera, specular, intensities, context);
+		}
+	}
+	template <bool FAST>
+	void RayTracer::ComputeLightingPacketKernel(const Scene& scene, int count, const vec3* points, const vec3* normals, const vec3* vecs_to_camera, const int* specular, float* intensities, TraceContext& context) const {
+		const LightSet& lights = scene.light_set_;
+		float inv_camera_lengths[RayPacket::MAX_RAYS];
+		for (int k = 0; k < count; k++) {
+			intensities[k] = lights.GetAmbient();
+			inv_camera_lengths[k] = specular[k] != -1 ? InverseLength<FAST>(vecs_to_camera[k]) : 0.0f;
+		}
 
-		for (int i = 0; i < scene_->lights.size(); i++) {
-			Light light = *scene_->lights[i].get();
-			if (light.type == LightType::kAmbient) {
-				intensity += light.intensity;
+		// Shades every point with one light, light_vecs point from each point toward it
+		vec3 light_vecs[RayPacket::MAX_RAYS];
+		float inv_light_lengths[RayPacket::MAX_RAYS];
+		auto add_light = [&](int light, float light_intensity, float t_min, float t_max) {
+			RayPacket shadow_rays;
+			for (int k = 0; k < count; k++) {
+				shadow_rays.AddRay(points[k], light_vecs[k], t_min, t_max);
 			}
-			else {
-				vec3 light_vec;
-				if (light.type == LightType::kPoint) {
-					light_vec = light.position - point;
+			context.stats.shadow_rays += count;
+
+			// Test the whole packet against the cached occluder first, rays it blocks drop out of the full query
+			bool occluded[RayPacket::MAX_RAYS] = {};
+			int cached_occluder = context.occluder_cache.Get(light);
+			if (cached_occluder != -1) {
+				PacketHits cached_hits;
+				IntersectPacket(shadow_rays, scene.sphere_store_.Geometry(cached_occluder, 1), cached_hits, FAST);
+				context.stats.occluder_cache_tests += count;
+				context.stats.intersection_tests += count;
+				for (int k = 0; k < count; k++) {
+					if (cached_hits.sphere[k] != -1) {
+						occluded[k] = true;
+						shadow_rays.t_max[k] = -FLT_MAX;
+						context.stats.occluder_cache_hits++;
+					}
 				}
-				else { // Directional light
-					light_vec = light.direction;
+			}
+			int occluders[RayPacket::MAX_RAYS];
+			context.stats.intersection_tests += scene.bvh_.OccludedPacket(shadow_rays, occluders, FAST);
+			for (int k = 0; k < count; k++) {
+				if (occluders[k] != -1) {
+					occluded[k] = true;
+					context.occluder_cache.Set(light, occluders[k]);
 				}
+			}
 
-				// Check for shadow
-				Sphere* obscuring_sphere = NULL;
-				float closest_t;
-				std::tie(obscuring_sphere, closest_t) = ClosestIntersection(point, light_vec, 0.01f, FLT_MAX);
-				if (obscuring_sphere != NULL) {
+			for (int k = 0; k < count; k++) {
+				if (occluded[k]) {
 					continue;
 				}
+				AddDirectLight<FAST>(intensities[k], light_intensity, light_vecs[k], inv_light_lengths[k], normals[k], vecs_to_camera[k], inv_camera_lengths[k], specular[k]);
+			}
+		};
 
-				// Diffuse 
-				float n_dot_l = normal.dot(light_vec);
-				if (n_dot_l > 0) {
-					intensity += light.intensity * n_dot_l / (vec3::Length(normal)* vec3::Length(light_vec));
-				}
-
-				// Specular
-				if (s != -1) {
-					vec3 reflection = ReflectRay(light_vec, normal);
-					float r_dot_v = reflection.dot(vec_to_camera);
-
-					// Reflection is facing the camera.
-					// angle between reflection and camera is less than 90 degrees
-					if (r_dot_v > 0.05f) { 
-						intensity += light.intensity * pow(r_dot_v / (vec3::Length(reflection) * vec3::Length(vec_to_camera)),s);
-					}
-				}
+		for (int i = 0; i < lights.GetPointCount(); i++) {
+			vec3 position = lights.GetPointPosition(i);
+			for (int k = 0; k < count; k++) {
+				light_vecs[k] = position - points[k];
+				inv_light_lengths[k] = InverseLength<FAST>(light_vecs[k]);
 			}
+			add_light(i, lights.GetPointIntensity(i), SHADOW_T_MIN, POINT_LIGHT_MAX_T);
+		}
+		for (int i = 0; i < lights.GetDirectionalCount(); i++) {
+			vec3 direction = lights.GetDirection(i);
+			for (int k = 0; k < count; k++) {
+				light_vecs[k] = direction;
+				inv_light_lengths[k] = 1.0f;
+			}
+			add_light(lights.GetPointCount() + i, lights.GetDirectionalIntensity(i), SHADOW_T_MIN * lights.GetDirectionLength(i), FLT_MAX);
 		}
-		return intensity;
 	}
 	// Returns the solutions as a vec2 of scalars 
-	vec2 RayTracer::IntersectRaySphere(vec3 o, vec3 direction, Sphere sphere) {
-		float r = sphere.radius;
-		vec3 CO = o - sphere.center;
+	vec2 RayTracer::IntersectRaySphere(vec3 o, vec3 direction, vec3 center, float radius_sq) {
+		vec3 CO = o - center;
 
 		// Setting up Quadratic Formula
 		float a = direction.dot(direction);
 		float b = 2 * CO.dot(direction);
-		float c = CO.dot(CO) - r * r;
+		float c = CO.dot(CO) - radius_sq;
 
 		// The discriminant determines how many solutions to the sphere intersection there are
 		// discriminat > 0, two real roots
@@ -112,62 +231,215 @@ namespace raytrace {
 		return vec2(t1, t2);
 	};
 
-	// Handle all intersections of a given ray
-	Color RayTracer::TraceRay(vec3 ray_origin, vec3 direction, float t_min, float t_max, int recursion_depth) {
-		float closest_t = FLT_MAX;
-		Sphere* closest_sphere = NULL;
-		
+	// Follows a ray through up to max_bounces reflections. Every hit adds its local color scaled by how much
+	// light still reaches the camera along the path (throughput), the reflective part carries on to the next hit.
+	HdrColor RayTracer::TraceRay(const Scene& scene, vec3 ray_origin, vec3 direction, float t_min, float t_max, int max_bounces, TraceContext& context, PrimaryHit* primary_hit) const {
+		HdrColor color(0.0f, 0.0f, 0.0f);
+		float throughput = 1.0f;
+		for (int bounce = 0; ; bounce++) {
+			float closest_t = FLT_MAX;
+			int closest_sphere = -1;
+			std::tie(closest_sphere, closest_t) = ClosestIntersection(scene, ray_origin, direction, t_min, t_max, context);
+			if (bounce == 0 && primary_hit != nullptr) {
+				primary_hit->sphere = closest_sphere;
+				primary_hit->t = closest_t;
+			}
+
+			if (closest_sphere == -1) {
+				return color + background_color_.ToHdr() * throughput;
+			}
+			const SphereMaterial& material = scene.sphere_store_.GetMaterial(closest_sphere);
+			vec3 point = ray_origin + direction * closest_t;
+			vec3 point_normal = point - scene.sphere_store_.GetCenter(closest_sphere);
+			point_normal = fast_math_ ? Normalize<true>(point_normal) : Normalize<false>(point_normal);
+			HdrColor local_color = material.color.ToHdr() * ComputeLighting(scene, point, point_normal, -direction, material.specular, context);
 
-		std::tie(closest_sphere, closest_t) = ClosestIntersection(ray_origin, direction, t_min, t_max);
+			// If out of bounces or object is not reflective, exit
+			float r = material.reflective;
+			if ((bounce >= max_bounces) || (r <= 0.0f)) {
+				return color + local_color * throughput;
+			}
+			color = color + local_color * (throughput * (1.0f - r));
+			throughput *= r;
 
-		if (closest_sphere == NULL) {
-			return background_color_;
+			// Continue with the reflected ray
+			direction = ReflectRay(-direction, point_normal);
+			ray_origin = point;
+			t_min = 0.1f;
+			t_max = FLT_MAX;
+			context.stats.reflection_rays++;
+		}
+	};
+	// Packet version of TraceRay, writes one color per ray of the packet.
+	// Only the first hit and its shadows are traced as packets, reflections go through TraceRay.
+	void RayTracer::TracePacket(const Scene& scene, const RayPacket& packet, int max_bounces, HdrColor* colors, TraceContext& context, PrimaryHit* primary_hits) const {
+		PacketHits hits;
+		context.stats.intersection_tests += scene.bvh_.IntersectPacket(packet, hits, fast_math_);
+		if (primary_hits != nullptr) {
+			for (int lane = 0; lane < packet.num_rays; lane++) {
+				primary_hits[lane].sphere = hits.sphere[lane];
+				primary_hits[lane].t = hits.t[lane];
+			}
 		}
-		vec3 point = ray_origin + direction * closest_t;
-		vec3 point_normal = point - closest_sphere->center;
-		point_normal = point_normal/vec3::Length(point_normal);
-		Color local_color = closest_sphere->color * ComputeLighting(point, point_normal, -direction, closest_sphere->specular);
 
-		// If at end of recursion or object is not reflective, exit
-		float r = closest_sphere->reflective;
-		if ((recursion_depth <= 0) || (r <= 0.0f)) {
-			return local_color;
+		int hit_lanes[RayPacket::MAX_RAYS];
+		vec3 points[RayPacket::MAX_RAYS];
+		vec3 normals[RayPacket::MAX_RAYS];
+		vec3 vecs_to_camera[RayPacket::MAX_RAYS];
+		int specular[RayPacket::MAX_RAYS];
+		int num_hits = 0;
+		for (int lane = 0; lane < packet.num_rays; lane++) {
+			if (hits.sphere[lane] == -1) {
+				colors[lane] = background_color_.ToHdr();
+				continue;
+			}
+			vec3 origin(packet.origin_x[lane], packet.origin_y[lane], packet.origin_z[lane]);
+			vec3 direction(packet.direction_x[lane], packet.direction_y[lane], packet.direction_z[lane]);
+			vec3 point = origin + direction * hits.t[lane];
+			vec3 point_normal = point - scene.sphere_store_.GetCenter(hits.sphere[lane]);
+			point_normal = fast_math_ ? Normalize<true>(point_normal) : Normalize<false>(point_normal);
+
+			hit_lanes[num_hits] = lane;
+			points[num_hits] = point;
+			normals[num_hits] = point_normal;
+			vecs_to_camera[num_hits] = -direction;
+			specular[num_hits] = scene.sphere_store_.GetMaterial(hits.sphere[lane]).specular;
+			num_hits++;
 		}
 
-		// Compute reflected color
-		vec3 reflected_ray = ReflectRay(-direction, point_normal);
-		Color reflected_color = TraceRay(point, reflected_ray, 0.1f, FLT_MAX, recursion_depth - 1);
+		float intensities[RayPacket::MAX_RAYS];
+		ComputeLightingPacket(scene, num_hits, points, normals, vecs_to_camera, specular, intensities, context);
 
-		return (local_color * (1.0f - r)) + reflected_color * r;
-	};
+		for (int k = 0; k < num_hits; k++) {
+			int lane = hit_lanes[k];
+			const SphereMaterial& material = scene.sphere_store_.GetMaterial(hits.sphere[lane]);
+			HdrColor local_color = material.color.ToHdr() * intensities[k];
+
+			// If out of bounces or object is not reflective, exit
+			float r = material.reflective;
+			if ((max_bounces <= 0) || (r <= 0.0f)) {
+				colors[lane] = local_color;
+				continue;
+			}
+
+			// Compute reflected color
+			vec3 reflected_ray = ReflectRay(vecs_to_camera[k], normals[k]);
+			context.stats.reflection_rays++;
+			HdrColor reflected_color = TraceRay(scene, points[k], reflected_ray, 0.1f, FLT_MAX, max_bounces - 1, context);
+			colors[lane] = (local_color * (1.0f - r)) + reflected_color * r;
+		}
+	}
 	// Handle all intersections of a given ray
-	std::tuple<Sphere*, float> 
-	RayTracer::ClosestIntersection(vec3 ray_origin, vec3 direction, float t_min, float t_max) {
+	std::tuple<int, float> 
+	RayTracer::ClosestIntersection(const Scene& scene, vec3 ray_origin, vec3 direction, float t_min, float t_max, TraceContext& context) const {
+		if (fast_math_) {
+			return ClosestIntersectionFast(scene, ray_origin, direction, t_min, t_max, context);
+		}
 		float closest_t = FLT_MAX;
-		Sphere* closest_sphere = NULL;
+		int closest_sphere = -1;
 
-		// Test each sphere in the scene for each ray 
-		for (int i = 0; i < scene_->spheres.size(); i++) {
+		// Only test the spheres in BVH leaves the ray passes through
+		float t_limit = t_max;
+		scene.bvh_.Traverse(ray_origin, direction, t_min, t_limit, [&](int first, int count) {
+			SphereGeometry leaf = scene.bvh_.LeafGeometry(first, count);
+			context.stats.intersection_tests += count;
+			for (int i = 0; i < leaf.count; i++) {
 
-			vec2 intersects = IntersectRaySphere(ray_origin, direction, *scene_->spheres[i].get());
+				vec3 center(leaf.center_x[i], leaf.center_y[i], leaf.center_z[i]);
+				vec2 intersects = IntersectRaySphere(ray_origin, direction, center, leaf.radius_sq[i]);
 
 
-			// Check for closer intersections 
-			if (((intersects.x > t_min) && (intersects.x < t_max)) && intersects.x < closest_t) {
-				closest_t = intersects.x;
-				closest_sphere = scene_->spheres[i].get();
-			}
-			if (((intersects.y > t_min) && (intersects.y < t_max)) && intersects.y < closest_t) {
-				closest_t = intersects.y;
-				closest_sphere = scene_->spheres[i].get();
+				// Check for closer intersections 
+				if (((intersects.x > t_min) && (intersects.x < t_max)) && intersects.x < closest_t) {
+					closest_t = intersects.x;
+					closest_sphere = scene.bvh_.SphereIndex(first + i);
+				}
+				if (((intersects.y > t_min) && (intersects.y < t_max)) && intersects.y < closest_t) {
+					closest_t = intersects.y;
+					closest_sphere = scene.bvh_.SphereIndex(first + i);
+				}
 			}
-		}
+			// Leaves past the closest hit can be skipped
+			t_limit = std::min(t_max, closest_t);
+			return false;
+		});
 		return std::make_tuple(closest_sphere, closest_t);
 	};
+	int RayTracer::FindOccluder(const Scene& scene, vec3 ray_origin, vec3 direction, float t_min, float t_max, TraceContext& context) const {
+		if (fast_math_) {
+			return FindOccluderFast(scene, ray_origin, direction, t_min, t_max, context);
+		}
+		int occluder = -1;
+		float t_limit = t_max;
+		scene.bvh_.Traverse(ray_origin, direction, t_min, t_limit, [&](int first, int count) {
+			SphereGeometry leaf = scene.bvh_.LeafGeometry(first, count);
+			for (int i = 0; i < leaf.count; i++) {
+				context.stats.intersection_tests++;
+				vec3 center(leaf.center_x[i], leaf.center_y[i], leaf.center_z[i]);
+				vec2 intersects = IntersectRaySphere(ray_origin, direction, center, leaf.radius_sq[i]);
+				if (HitWithin(intersects, t_min, t_max)) {
+					occluder = scene.bvh_.SphereIndex(first + i);
+					return true;
+				}
+			}
+			return false;
+		});
+		return occluder;
+	}
+	// ClosestIntersection with IntersectRaySphereFast. Kept apart so the exact version compiles the same as without fast math.
+	std::tuple<int, float>
+	RayTracer::ClosestIntersectionFast(const Scene& scene, vec3 ray_origin, vec3 direction, float t_min, float t_max, TraceContext& context) const {
+		float closest_t = FLT_MAX;
+		int closest_sphere = -1;
+		float t_limit = t_max;
+		float a = direction.dot(direction);
+		float inv_a = 1.0f / a;
+		scene.bvh_.Traverse(ray_origin, direction, t_min, t_limit, [&](int first, int count) {
+			SphereGeometry leaf = scene.bvh_.LeafGeometry(first, count);
+			context.stats.intersection_tests += count;
+			for (int i = 0; i < leaf.count; i++) {
+				vec3 center(leaf.center_x[i], leaf.center_y[i], leaf.center_z[i]);
+				vec2 intersects = IntersectRaySphereFast(ray_origin, direction, a, inv_a, center, leaf.radius_sq[i]);
+				if (((intersects.x > t_min) && (intersects.x < t_max)) && intersects.x < closest_t) {
+					closest_t = intersects.x;
+					closest_sphere = scene.bvh_.SphereIndex(first + i);
+				}
+				if (((intersects.y > t_min) && (intersects.y < t_max)) && intersects.y < closest_t) {
+					closest_t = intersects.y;
+					closest_sphere = scene.bvh_.SphereIndex(first + i);
+				}
+			}
+			t_limit = std::min(t_max, closest_t);
+			return false;
+		});
+		return std::make_tuple(closest_sphere, closest_t);
+	}
+	int RayTracer::FindOccluderFast(const Scene& scene, vec3 ray_origin, vec3 direction, float t_min, float t_max, TraceContext& context) const {
+		int occluder = -1;
+		float t_limit = t_max;
+		float a = direction.dot(direction);
+		float inv_a = 1.0f / a;
+		scene.bvh_.Traverse(ray_origin, direction, t_min, t_limit, [&](int first, int count) {
+			SphereGeometry leaf = scene.bvh_.LeafGeometry(first, count);
+			for (int i = 0; i < leaf.count; i++) {
+				context.stats.intersection_tests++;
+				vec3 center(leaf.center_x[i], leaf.center_y[i], leaf.center_z[i]);
+				vec2 intersects = IntersectRaySphereFast(ray_origin, direction, a, inv_a, center, leaf.radius_sq[i]);
+				if (HitWithin(intersects, t_min, t_max)) {
+					occluder = scene.bvh_.SphereIndex(first + i);
+					return true;
+				}
+			}
+			return false;
+		});
+		return occluder;
+	}
 	// Takes a canvas coordinate and converts it to a point on the viewport
 	// This will be subtracted from the origin/camera to create a vector/ray
-	vec3 RayTracer::CanvasToViewport(int x, int y) {
-		return vec3((float)x * (float)viewport_width_ / (float)canvas_->w, (float)y * (float)viewport_height_ / (float)canvas_->h, dist_to_viewport_);
+	vec3 RayTracer::CanvasToViewport(int x, int y) const {
+		// Both axes are scaled by the height so pixels stay square on canvases that aren't
+		float canvas_height = (float)canvas_->GetHeight();
+		return vec3((float)x * (float)viewport_height_ / canvas_height, (float)y * (float)viewport_height_ / canvas_height, dist_to_viewport_);
 	};
 
 	void RayTracer::SetFov(float degrees) {
@@ -184,30 +456,546 @@ namespace raytrace {
 		return degrees * 2;
 	}
 
+	void RayTracer::SetThreadCount(int num_threads) {
+		num_threads = std::max(1, num_threads);
+		if (thread_pool_ && thread_pool_->GetThreadCount() == num_threads) {
+			return;
+		}
+		thread_pool_ = std::make_unique<ThreadPool>(num_threads);
+	}
+	int RayTracer::GetThreadCount() const {
+		return thread_pool_->GetThreadCount();
+	}
+	void RayTracer::SetPacketTracing(bool enabled) {
+		packet_tracing_ = enabled;
+	}
+	bool RayTracer::GetPacketTracing() const {
+		return packet_tracing_;
+	}
+	void RayTracer::SetMaxBounces(int max_bounces) {
+		max_bounces_ = std::max(0, max_bounces);
+	}
+	int RayTracer::GetMaxBounces() const {
+		return max_bounces_;
+	}
+	const RenderStats& RayTracer::GetLastFrameStats() const {
+		return last_frame_stats_;
+	}
+	void RayTracer::SetTargetFrameTime(float ms) {
+		resolution_.SetTargetFrameTime(ms);
+	}
+	float RayTracer::GetTargetFrameTime() const {
+		return resolution_.GetTargetFrameTime();
+	}
+	float RayTracer::GetResolutionScale() const {
+		return resolution_.GetScale();
+	}
+	const FrameTiming& RayTracer::GetLastFrameTiming() const {
+		return last_frame_timing_;
+	}
+	void RayTracer::SetTemporalReprojection(bool enabled) {
+		temporal_reprojection_ = enabled;
+		if (!enabled) {
+			temporal_cache_.Clear();
+		}
+	}
+	bool RayTracer::GetTemporalReprojection() const {
+		return temporal_reprojection_;
+	}
+	void RayTracer::SetGpuBackend(GpuBackend backend) {
+		gpu_backend_ = backend;
+	}
+	GpuBackend RayTracer::GetGpuBackend() const {
+		return gpu_backend_;
+	}
+	void RayTracer::SetFastMath(bool enabled) {
+		fast_math_ = enabled;
+	}
+	bool RayTracer::GetFastMath() const {
+		return fast_math_;
+	}
+	int RayTracer::SetGpuTiming(bool enabled) {
+		if (!enabled) {
+			gpu_timer_.Delete();
+			return 0;
+		}
+		return gpu_timer_.Init();
+	}
+	bool RayTracer::GetGpuTiming() const {
+		return gpu_timer_.IsInitialized();
+	}
+	const GpuFrameTiming& RayTracer::GetLastGpuTiming() const {
+		return gpu_timer_.GetLastTiming();
+	}
+	GpuBackend RayTracer::GpuBackendFor(const Scene& scene) const {
+		if (!Scene::texture_buffers_.IsInitialized()) {
+			return GpuBackend::kUniformBuffers;
+		}
+		if (gpu_backend_ == GpuBackend::kTextureBuffers || !scene.FitsUniformBuffers()) {
+			return GpuBackend::kTextureBuffers;
+		}
+		return GpuBackend::kUniformBuffers;
+	}
+	Shader* RayTracer::GetGpuShader(const Scene& scene) const {
+		if (GpuBackendFor(scene) == GpuBackend::kTextureBuffers) {
+			return Scene::texture_buffers_.GetShader();
+		}
+		return Scene::shader_variants_ ? Scene::shader_variants_->Get(scene.GetShaderSignature(max_bounces_)) : nullptr;
+	}
+
+	// Renders one TILE_SIZE x TILE_SIZE block of the canvas, tiles are numbered row by row.
+	// Pixels are traced into hdr_canvas_, then the tile's rows are quantized into canvas_ in one pass
+	// unless the frame is traced at a lower resolution and still has to be upscaled.
+	void RayTracer::RenderTile(const Scene& scene, int tile_index, TraceContext& context) {
+		int width = hdr_canvas_.GetWidth();
+		int height = hdr_canvas_.GetHeight();
+		int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+		int x_start = (tile_index % tiles_x) * TILE_SIZE;
+		int y_start = (tile_index / tiles_x) * TILE_SIZE;
+		int x_end = std::min(x_start + TILE_SIZE, width);
+		int y_end = std::min(y_start + TILE_SIZE, height);
+
+		if (packet_tracing_) {
+			// 4x4 blocks of pixels make coherent packets of 16 rays
+			for (int block_y = y_start; block_y < y_end; block_y += 4) {
+				for (int block_x = x_start; block_x < x_end; block_x += 4) {
+					int block_width = std::min(block_x + 4, x_end) - block_x;
+					RayPacket packet;
+					camera_rays_.AddBlock(packet, block_x, block_x + block_width, block_y, std::min(block_y + 4, y_end), 1, FLT_MAX);
+					HdrColor colors[RayPacket::MAX_RAYS];
+					context.stats.primary_rays += packet.num_rays;
+					TracePacket(scene, packet, max_bounces_, colors, context);
+					// AddBlock fills the lanes row by row
+					for (int lane = 0; lane < packet.num_rays; lane++) {
+						hdr_canvas_.SetPixel(block_x + lane % block_width, block_y + lane / block_width, colors[lane]);
+					}
+				}
+			}
+		}
+		else {
+			for (int row = y_start; row < y_end; row++) {
+				vec3 row_start = camera_rays_.RowStart(row);
+				for (int column = x_start; column < x_end; column++) {
+					// D is the distance from the camera to the viewport
+					vec3 D = row_start + camera_rays_.ColumnStep() * (float)column;
+					context.stats.primary_rays++;
+					HdrColor pixel_color = TraceRay(scene, camera_rays_.GetOrigin(), D, 1, FLT_MAX, max_bounces_, context);
+					hdr_canvas_.SetPixel(column, row, pixel_color);
+				}
+			}
+		}
+
+		if (width == canvas_->GetWidth() && height == canvas_->GetHeight()) {
+			for (int row = y_start; row < y_end; row++) {
+				hdr_canvas_.QuantizeRow(row, x_start, x_end, *canvas_);
+			}
+		}
+	}
+	void RayTracer::UpscaleRows(int row_start, int row_end) {
+		// Maps canvas pixels to the traced pixel that looks at the same point of the viewport.
+		// Pixels are square and scaled by the height, see CameraRayGenerator::Setup.
+		int width = canvas_->GetWidth();
+		int height = canvas_->GetHeight();
+		int render_width = hdr_canvas_.GetWidth();
+		int render_height = hdr_canvas_.GetHeight();
+		float scale = (float)render_height / (float)height;
+		float x_offset = (float)(render_width / 2) - (float)(width / 2) * scale;
+		float top = (float)(render_height - 1 - render_height / 2) - (float)(height - 1 - height / 2) * scale;
+		for (int row = row_start; row < row_end; row++) {
+			hdr_canvas_.UpscaleRow(row, scale, x_offset, top + (float)row * scale, *canvas_);
+		}
+	}
 	void RayTracer::Render(Scene* scene) {
+		RAYTRACE_PROFILE_SCOPE("RayTracer::Render");
+		auto frame_start = std::chrono::steady_clock::now();
 		scene_ = scene;
-		const Color GREEN(0x0, 0xFF, 0x0);
-		vec3 O(0, 0, 0);
-		int recursion_depth = 2;
-		// Canvas has 0,0 at center
-		for (int x = -canvas_->w / 2; x < canvas_->w / 2; x++) {
-			for (int y = -canvas_->h / 2; y < canvas_->h / 2; y++) {
+		{
+			RAYTRACE_PROFILE_SCOPE("Bvh::Update");
+			scene->bvh_.Update(scene->sphere_store_);
+		}
+		scene->light_set_.Compile(scene->lights);
+
+		float scale = resolution_.GetScale();
+		int render_width = std::max(1, (int)((float)canvas_->GetWidth() * scale + 0.5f));
+		int render_height = std::max(1, (int)((float)canvas_->GetHeight() * scale + 0.5f));
+		if (hdr_canvas_.GetWidth() != render_width || hdr_canvas_.GetHeight() != render_height) {
+			hdr_canvas_.Resize(render_width, render_height);
+		}
+		SetupCamera(*scene, render_width, render_height);
+		bool temporal = temporal_reprojection_;
+		if (temporal) {
+			temporal_cache_.BeginFrame(SceneStateHash(*scene), render_width, render_height);
+			if (temporal_cache_.HasPrevious()) {
+				RAYTRACE_PROFILE_SCOPE("TemporalCache::Reproject");
+				int bands = (render_height + TILE_SIZE - 1) / TILE_SIZE;
+				thread_pool_->ParallelFor(bands, [&](int band) {
+					temporal_cache_.Reproject(camera_rays_, band * TILE_SIZE, std::min((band + 1) * TILE_SIZE, render_height));
+				});
+			}
+		}
+		// Tiles only read the scene and write disjoint pixels, so they need no locking
+		int tiles_x = (render_width + TILE_SIZE - 1) / TILE_SIZE;
+		int tiles_y = (render_height + TILE_SIZE - 1) / TILE_SIZE;
+		tile_stats_.assign(tiles_x * tiles_y, RenderStats());
+		thread_pool_->ParallelFor(tiles_x * tiles_y, [&](int tile_index) {
+			// Counted on the stack, neighbouring tile_stats_ entries share cache lines.
+			// Every tile starts with an empty occluder cache so results don't depend on which thread ran it.
+			RAYTRACE_PROFILE_SCOPE("Tile");
+			TraceContext context;
+			if (temporal) {
+				RenderTemporalTile(*scene, tile_index, context);
+			}
+			else {
+				RenderTile(*scene, tile_index, context);
+			}
+			tile_stats_[tile_index] = context.stats;
+		});
+		if (temporal) {
+			temporal_cache_.EndFrame();
+		}
+		last_frame_stats_ = RenderStats();
+		for (const RenderStats& stats : tile_stats_) {
+			last_frame_stats_ += stats;
+		}
+		CountFrameStats();
+		auto trace_end = std::chrono::steady_clock::now();
 
-				// D is the distance from the camera to the viewport
-				vec3 D = (scene_->camera_.RotationY() * (scene_->camera_.RotationX() * CanvasToViewport(x, y)));
-				Color pixel_color = TraceRay(scene_->camera_.position, D, 1, FLT_MAX, recursion_depth);
-				//std::cout << x << ", " << y << std::endl;
-				putPixel(canvas_, x, y, pixel_color);
+		bool upscaled = render_width != canvas_->GetWidth() || render_height != canvas_->GetHeight();
+		if (upscaled) {
+			RAYTRACE_PROFILE_SCOPE("Upscale");
+			int bands = (canvas_->GetHeight() + TILE_SIZE - 1) / TILE_SIZE;
+			thread_pool_->ParallelFor(bands, [&](int band) {
+				UpscaleRows(band * TILE_SIZE, std::min((band + 1) * TILE_SIZE, canvas_->GetHeight()));
+			});
+		}
+		auto frame_end = std::chrono::steady_clock::now();
+
+		last_frame_timing_.total_ms = std::chrono::duration<float, std::milli>(frame_end - frame_start).count();
+		last_frame_timing_.trace_ms = std::chrono::duration<float, std::milli>(trace_end - frame_start).count();
+		last_frame_timing_.upscale_ms = upscaled ? std::chrono::duration<float, std::milli>(frame_end - trace_end).count() : 0.0f;
+		last_frame_timing_.scale = scale;
+		last_frame_timing_.render_width = render_width;
+		last_frame_timing_.render_height = render_height;
+		resolution_.Update(last_frame_timing_.total_ms);
+	}
+	// Sub-pixel position of the nth extra progressive sample, in (-0.5, 0.5) around the pixel's own sample.
+	// An R2 sequence, every prefix of it covers the pixel evenly.
+	static vec2 ProgressiveJitter(int n) {
+		float x = 0.5f + 0.7548776662f * (float)n;
+		float y = 0.5f + 0.5698402910f * (float)n;
+		return vec2(x - floorf(x) - 0.5f, y - floorf(y) - 0.5f);
+	}
+	// Traces the camera rays through the listed pixels, 16 at a time when packet tracing is on.
+	// jitter moves every ray by the same fraction of a pixel, primary_hits can be null.
+	void RayTracer::TracePixels(const Scene& scene, const int* columns, const int* rows, int count, vec3 jitter, HdrColor* colors, PrimaryHit* primary_hits, TraceContext& context) const {
+		context.stats.primary_rays += count;
+		for (int first = 0; first < count; first += RayPacket::MAX_RAYS) {
+			int batch = std::min(RayPacket::MAX_RAYS, count - first);
+			if (packet_tracing_) {
+				RayPacket packet;
+				for (int k = 0; k < batch; k++) {
+					packet.AddRay(camera_rays_.GetOrigin(), camera_rays_.Direction(columns[first + k], rows[first + k]) + jitter, 1, FLT_MAX);
+				}
+				TracePacket(scene, packet, max_bounces_, colors + first, context, primary_hits != nullptr ? primary_hits + first : nullptr);
+			}
+			else {
+				for (int k = first; k < first + batch; k++) {
+					vec3 D = camera_rays_.Direction(columns[k], rows[k]) + jitter;
+					colors[k] = TraceRay(scene, camera_rays_.GetOrigin(), D, 1, FLT_MAX, max_bounces_, context, primary_hits != nullptr ? primary_hits + k : nullptr);
+				}
 			}
 		}
 	}
+	// Pixels whose reprojected sample still checks out keep its color, everything else is traced.
+	// A sample checks out when the pixel's camera ray misses everything like the sample did, or hits the same
+	// sphere, the sample's point still faces the camera and the camera moved less than MAX_CAMERA_MOVE pixel
+	// widths at that distance since the sample was traced. Turning the camera keeps every sample, moving it
+	// expires them before highlights and reflections visibly slide. Checking only takes the closest hit of
+	// the camera ray, the shading, shadow and reflection rays of the pixel are skipped.
+	void RayTracer::RenderTemporalTile(const Scene& scene, int tile_index, TraceContext& context) {
+		int width = hdr_canvas_.GetWidth();
+		int height = hdr_canvas_.GetHeight();
+		int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+		int x_start = (tile_index % tiles_x) * TILE_SIZE;
+		int y_start = (tile_index / tiles_x) * TILE_SIZE;
+		int x_end = std::min(x_start + TILE_SIZE, width);
+		int y_end = std::min(y_start + TILE_SIZE, height);
+
+		// Listed in 4x4 blocks like RenderTile, a frame with nothing to reuse traces the same packets
+		int reuse_columns[TILE_SIZE * TILE_SIZE];
+		int reuse_rows[TILE_SIZE * TILE_SIZE];
+		const TemporalSample* reuse_samples[TILE_SIZE * TILE_SIZE];
+		int reuse_count = 0;
+		int trace_columns[TILE_SIZE * TILE_SIZE];
+		int trace_rows[TILE_SIZE * TILE_SIZE];
+		int trace_count = 0;
+		for (int block_y = y_start; block_y < y_end; block_y += 4) {
+			for (int block_x = x_start; block_x < x_end; block_x += 4) {
+				for (int row = block_y; row < std::min(block_y + 4, y_end); row++) {
+					for (int column = block_x; column < std::min(block_x + 4, x_end); column++) {
+						const TemporalSample* sample = temporal_cache_.NeedsRefresh(column, row) ? nullptr : temporal_cache_.Reprojected(column, row);
+						if (sample != nullptr) {
+							reuse_columns[reuse_count] = column;
+							reuse_rows[reuse_count] = row;
+							reuse_samples[reuse_count] = sample;
+							reuse_count++;
+						}
+						else {
+							trace_columns[trace_count] = column;
+							trace_rows[trace_count] = row;
+							trace_count++;
+						}
+					}
+				}
+			}
+		}
+
+		vec3 origin = camera_rays_.GetOrigin();
+		float pixel_width = vec3::Length(camera_rays_.ColumnStep());
+		float max_move = TemporalCache::MAX_CAMERA_MOVE;
+		for (int first = 0; first < reuse_count; first += RayPacket::MAX_RAYS) {
+			int batch = std::min(RayPacket::MAX_RAYS, reuse_count - first);
+			PrimaryHit hits[RayPacket::MAX_RAYS];
+			if (packet_tracing_) {
+				RayPacket packet;
+				for (int k = 0; k < batch; k++) {
+					packet.AddRay(origin, camera_rays_.Direction(reuse_columns[first + k], reuse_rows[first + k]), 1, FLT_MAX);
+				}
+				PacketHits packet_hits;
+				context.stats.intersection_tests += scene.bvh_.IntersectPacket(packet, packet_hits, fast_math_);
+				for (int k = 0; k < batch; k++) {
+					hits[k].sphere = packet_hits.sphere[k];
+					hits[k].t = packet_hits.t[k];
+				}
+			}
+			else {
+				for (int k = 0; k < batch; k++) {
+					vec3 D = camera_rays_.Direction(reuse_columns[first + k], reuse_rows[first + k]);
+					std::tie(hits[k].sphere, hits[k].t) = ClosestIntersection(scene, origin, D, 1, FLT_MAX, context);
+				}
+			}
+
+			for (int k = 0; k < batch; k++) {
+				int column = reuse_columns[first + k];
+				int row = reuse_rows[first + k];
+				const TemporalSample& sample = *reuse_samples[first + k];
+				bool valid = hits[k].sphere == sample.sphere;
+				if (valid && sample.sphere != -1) {
+					float footprint = pixel_width * hits[k].t; // Width of the pixel at the hit
+					vec3 normal = sample.point - scene.sphere_store_.GetCenter(sample.sphere);
+					vec3 moved = origin - sample.origin;
+					valid = normal.dot(origin - sample.point) > 0.0f && moved.dot(moved) <= max_move * max_move * footprint * footprint;
+				}
+				if (!valid) {
+					trace_columns[trace_count] = column;
+					trace_rows[trace_count] = row;
+					trace_count++;
+					continue;
+				}
+				hdr_canvas_.SetPixel(column, row, sample.color);
+				temporal_cache_.Store(column, row, sample);
+				context.stats.reprojected_pixels++;
+			}
+		}
+
+		HdrColor colors[TILE_SIZE * TILE_SIZE];
+		PrimaryHit primary_hits[TILE_SIZE * TILE_SIZE];
+		TracePixels(scene, trace_columns, trace_rows, trace_count, vec3(), colors, primary_hits, context);
+		for (int i = 0; i < trace_count; i++) {
+			vec3 D = camera_rays_.Direction(trace_columns[i], trace_rows[i]);
+			vec3 point = primary_hits[i].sphere == -1 ? D : origin + D * primary_hits[i].t;
+			hdr_canvas_.SetPixel(trace_columns[i], trace_rows[i], colors[i]);
+			temporal_cache_.Store(trace_columns[i], trace_rows[i], { point, primary_hits[i].sphere, colors[i], origin });
+		}
+
+		if (width == canvas_->GetWidth() && height == canvas_->GetHeight()) {
+			for (int row = y_start; row < y_end; row++) {
+				hdr_canvas_.QuantizeRow(row, x_start, x_end, *canvas_);
+			}
+		}
+	}
+	// Pass 0 traces pixels on a 4 pixel grid and fills the 4x4 block below and right of each,
+	// pass 1 does the same on the remaining pixels of a 2 pixel grid, pass 2 traces every pixel left.
+	// After pass 2 the image is the same as Render's, later passes average in one jittered sample per pixel.
+	int RayTracer::RenderProgressiveTile(const Scene& scene, int tile_index, int pass, TraceContext& context) {
+		int width = hdr_canvas_.GetWidth();
+		int height = hdr_canvas_.GetHeight();
+		int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+		int x_start = (tile_index % tiles_x) * TILE_SIZE;
+		int y_start = (tile_index / tiles_x) * TILE_SIZE;
+		int x_end = std::min(x_start + TILE_SIZE, width);
+		int y_end = std::min(y_start + TILE_SIZE, height);
+
+		// Tiles start on multiples of 4, so the grids line up across tiles
+		int stride = pass == 0 ? 4 : (pass == 1 ? 2 : 1);
+		int columns[TILE_SIZE * TILE_SIZE];
+		int rows[TILE_SIZE * TILE_SIZE];
+		int count = 0;
+		for (int row = y_start; row < y_end; row += stride) {
+			for (int column = x_start; column < x_end; column += stride) {
+				if ((pass == 1 && column % 4 == 0 && row % 4 == 0) || (pass == 2 && column % 2 == 0 && row % 2 == 0)) {
+					continue; // Traced by an earlier pass
+				}
+				columns[count] = column;
+				rows[count] = row;
+				count++;
+			}
+		}
+
+		int samples = pass - 1; // Samples per pixel once this pass is done, for passes past 2
+		vec3 jitter;
+		if (pass > 2) {
+			vec2 offset = ProgressiveJitter(samples - 1);
+			jitter = camera_rays_.Offset(offset.x, offset.y);
+		}
+		HdrColor colors[TILE_SIZE * TILE_SIZE];
+		TracePixels(scene, columns, rows, count, jitter, colors, nullptr, context);
+
+		int changed = 0;
+		for (int i = 0; i < count; i++) {
+			int column = columns[i];
+			int row = rows[i];
+			if (pass > 2) {
+				HdrColor old_color = hdr_canvas_.GetPixel(column, row);
+				HdrColor new_color = old_color + (colors[i] - old_color) / (float)samples;
+				hdr_canvas_.SetPixel(column, row, new_color);
+				float change = std::max(fabsf(new_color.x - old_color.x), std::max(fabsf(new_color.y - old_color.y), fabsf(new_color.z - old_color.z)));
+				if (change > 0.5f / 255.0f) {
+					changed++;
+				}
+				continue;
+			}
+			for (int y = row; y < std::min(row + stride, y_end); y++) {
+				for (int x = column; x < std::min(column + stride, x_end); x++) {
+					hdr_canvas_.SetPixel(x, y, colors[i]);
+				}
+			}
+		}
+
+		for (int row = y_start; row < y_end; row++) {
+			hdr_canvas_.QuantizeRow(row, x_start, x_end, *canvas_);
+		}
+		return changed;
+	}
+	u64 RayTracer::SceneStateHash(const Scene& scene) const {
+		// Runs every frame, so the scene is only asked whether it changed instead of hashing it
+		int settings[3] = { max_bounces_, packet_tracing_ ? 1 : 0, fast_math_ ? 1 : 0 };
+		u64 hash = HashBytes(settings, sizeof(settings), scene.ChangeKey());
+		return HashBytes(&dist_to_viewport_, sizeof(dist_to_viewport_), hash);
+	}
+	u64 RayTracer::RenderStateHash(const Scene& scene) const {
+		const Camera& camera = scene.camera_;
+		float pose[6] = { camera.position.x, camera.position.y, camera.position.z, camera.roll, camera.pitch, camera.yaw };
+		u64 hash = HashBytes(pose, sizeof(pose), SceneStateHash(scene));
+		int size[2] = { canvas_->GetWidth(), canvas_->GetHeight() };
+		return HashBytes(size, sizeof(size), hash);
+	}
+	bool RayTracer::RenderProgressive(Scene* scene) {
+		auto frame_start = std::chrono::steady_clock::now();
+		scene_ = scene;
+		u64 state = RenderStateHash(*scene);
+		if (state != progressive_state_) {
+			progressive_state_ = state;
+			progressive_pass_ = 0;
+			converged_ = false;
+		}
+		else if (converged_) {
+			return false;
+		}
+
+		RAYTRACE_PROFILE_SCOPE("RayTracer::RenderProgressive");
+		{
+			RAYTRACE_PROFILE_SCOPE("Bvh::Update");
+			scene->bvh_.Update(scene->sphere_store_);
+		}
+		scene->light_set_.Compile(scene->lights);
+		int width = canvas_->GetWidth();
+		int height = canvas_->GetHeight();
+		if (hdr_canvas_.GetWidth() != width || hdr_canvas_.GetHeight() != height) {
+			hdr_canvas_.Resize(width, height);
+		}
+		SetupCamera(*scene, width, height);
+		int pass = progressive_pass_++;
+		int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+		int tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+		tile_stats_.assign(tiles_x * tiles_y, RenderStats());
+		tile_changes_.assign(tiles_x * tiles_y, 0);
+		thread_pool_->ParallelFor(tiles_x * tiles_y, [&](int tile_index) {
+			RAYTRACE_PROFILE_SCOPE("Tile");
+			TraceContext context;
+			tile_changes_[tile_index] = RenderProgressiveTile(*scene, tile_index, pass, context);
+			tile_stats_[tile_index] = context.stats;
+		});
+		last_frame_stats_ = RenderStats();
+		int changed = 0;
+		for (int i = 0; i < (int)tile_stats_.size(); i++) {
+			last_frame_stats_ += tile_stats_[i];
+			changed += tile_changes_[i];
+		}
+		CountFrameStats();
+
+		int samples = std::max(1, pass - 1);
+		if (pass >= 2 && (samples >= PROGRESSIVE_MAX_SAMPLES || (pass > 2 && (float)changed < PROGRESSIVE_CONVERGED_FRACTION * (float)width * (float)height))) {
+			converged_ = true;
+		}
+
+		auto frame_end = std::chrono::steady_clock::now();
+		last_frame_timing_.total_ms = std::chrono::duration<float, std::milli>(frame_end - frame_start).count();
+		last_frame_timing_.trace_ms = last_frame_timing_.total_ms;
+		last_frame_timing_.upscale_ms = 0.0f;
+		last_frame_timing_.scale = 1.0f;
+		last_frame_timing_.render_width = width;
+		last_frame_timing_.render_height = height;
+		return true;
+	}
+	// The tiles count into their own RenderStats, so the profiler's counters are only touched once per frame
+	void RayTracer::CountFrameStats() const {
+		RAYTRACE_PROFILE_COUNT(kPrimaryRays, last_frame_stats_.primary_rays);
+		RAYTRACE_PROFILE_COUNT(kReflectionRays, last_frame_stats_.reflection_rays);
+		RAYTRACE_PROFILE_COUNT(kShadowRays, last_frame_stats_.shadow_rays);
+		RAYTRACE_PROFILE_COUNT(kSphereTests, last_frame_stats_.intersection_tests);
+	}
+	int RayTracer::GetProgressivePass() const {
+		return progressive_pass_;
+	}
+	bool RayTracer::IsConverged() const {
+		return converged_;
+	}
+	const CameraRayGenerator& RayTracer::SetupCamera(const Scene& scene) {
+		SetupCamera(scene, canvas_->GetWidth(), canvas_->GetHeight());
+		return camera_rays_;
+	}
+	void RayTracer::SetupCamera(const Scene& scene, int width, int height) {
+		camera_rays_.Setup(scene.camera_, width, height, (float)viewport_height_, dist_to_viewport_);
+	}
+	// Only times the CPU side, the GPU draws after this returns
 	void RayTracer::RenderGPU(Scene* scene) {
+		RAYTRACE_PROFILE_SCOPE("RayTracer::RenderGPU");
+		Shader* shader = GetGpuShader(*scene);
+		if (shader == nullptr) {
+			return;
+		}
 		scene_ = scene;
-		scene->WriteLightBuffer();
-		scene->WriteSphereBuffer();
+		bool texture_buffers = GpuBackendFor(*scene) == GpuBackend::kTextureBuffers;
+		gpu_timer_.BeginFrame();
+		gpu_timer_.Begin(GpuTimer::Section::kUpload);
+		if (texture_buffers) {
+			scene->WriteTextureBuffers();
+		}
+		else {
+			scene->WriteLightBuffer();
+			scene->WriteSphereBuffer();
+		}
+		gpu_timer_.End(GpuTimer::Section::kUpload);
+		RAYTRACE_PROFILE_SCOPE("Draw");
+		gpu_timer_.Begin(GpuTimer::Section::kDraw);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		scene->shader_->Enable();
+		shader->Enable();
 		glDrawArrays(GL_QUADS, 0, 4);
+		gpu_timer_.End(GpuTimer::Section::kDraw);
+		if (!texture_buffers) {
+			Scene::FenceBuffers();
+		}
 	}
 	
 	void RayTracer::HandleHeldInputs(float delta_time) {
@@ -257,6 +1045,30 @@ namespace raytrace {
 				scene_->camera_.pitch += 10.0f;
 				std::cout << "Camera pitch: " << scene_->camera_.pitch << std::endl;
 			}
+			else if (key == SDLK_LEFTBRACKET) {
+				SetThreadCount(GetThreadCount() - 1);
+				std::cout << "CPU render threads: " << GetThreadCount() << std::endl;
+			}
+			else if (key == SDLK_RIGHTBRACKET) {
+				SetThreadCount(GetThreadCount() + 1);
+				std::cout << "CPU render threads: " << GetThreadCount() << std::endl;
+			}
+			else if (key == SDLK_p) {
+				SetPacketTracing(!GetPacketTracing());
+				std::cout << "Packet tracing: " << (GetPacketTracing() ? SimdLevelName(DetectSimdLevel()) : "off") << std::endl;
+			}
+			else if (key == SDLK_m) {
+				SetFastMath(!GetFastMath());
+				std::cout << "Fast math: " << (GetFastMath() ? "on" : "off") << std::endl;
+			}
+			else if (key == SDLK_COMMA) {
+				SetMaxBounces(GetMaxBounces() - 1);
+				std::cout << "Max bounces: " << GetMaxBounces() << std::endl;
+			}
+			else if (key == SDLK_PERIOD) {
+				SetMaxBounces(GetMaxBounces() + 1);
+				std::cout << "Max bounces: " << GetMaxBounces() << std::endl;
+			}
 			break;
 		}
 		default:
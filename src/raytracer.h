@@ -6,35 +6,144 @@
 #include <SDL.h>
 
 #include "camera.h"
+#include "camera_ray_generator.h"
+#include "framebuffer.h"
+#include "gpu_timer.h"
+#include "hdr_framebuffer.h"
+#include "ray_packet.h"
+#include "render_stats.h"
+#include "resolution_controller.h"
+#include "temporal_cache.h"
+#include "trace_context.h"
 #include "types.h"
 #include "scene.h"
 #include "shader.h"
+#include "thread_pool.h"
 
 namespace raytrace {
+	// Where RenderGPU keeps the scene: the fixed size uniform blocks of default.frag or the texture buffers of texture_buffer.frag
+	enum class GpuBackend {
+		kUniformBuffers,
+		kTextureBuffers
+	};
+
 	class RayTracer {
 	public:
-		static int putPixel(SDL_Surface* canvas, int x, int y, Color c);
-		static vec2 IntersectRaySphere(vec3 o, vec3 direction, Sphere sphere);
+		static vec2 IntersectRaySphere(vec3 o, vec3 direction, vec3 center, float radius_sq);
 
-		RayTracer(SDL_Surface* canvas, Scene* default_scene);
+		static const int TILE_SIZE = 32; // Width and height of a render tile in pixels
+		// RenderProgressive stops once every pixel has this many samples
+		static const int PROGRESSIVE_MAX_SAMPLES = 16;
+		// or once a pass visibly changed less than this fraction of the pixels
+		static constexpr float PROGRESSIVE_CONVERGED_FRACTION = 0.001f;
+
+		RayTracer(Framebuffer* canvas, Scene* default_scene);
 		void Render(Scene* scene);
 		void RenderGPU(Scene* scene);
-		Color TraceRay(vec3 ray_origin, vec3 direction, float t_min, float t_max, int recursion_depth);
-		std::tuple<Sphere*, float> ClosestIntersection(vec3 ray_origin, vec3 direction, float t_min, float t_max);
-		float ComputeLighting(vec3 point, vec3 normal, vec3 vec_to_camera, int s);
-		vec3 CanvasToViewport(int x, int y);
+		// Renders every 4th pixel right away, then refines the image a pass per call while the scene, camera
+		// and settings stay the same: every 2nd pixel, the rest, then extra jittered samples per pixel.
+		// Returns false without touching the canvas once the image has converged.
+		bool RenderProgressive(Scene* scene);
+		// Pass the next call to RenderProgressive will run, 0 is the coarse pass
+		int GetProgressivePass() const;
+		bool IsConverged() const;
+		// Builds the primary rays of the scene's camera for this frame, Render calls it itself.
+		// The GPU path uses the returned rotations for its camera uniforms.
+		const CameraRayGenerator& SetupCamera(const Scene& scene);
+		// Everything reachable from TraceRay only reads the scene, so it can run on many threads at once
+		// context collects the work done and caches shadow occluders, each thread passes its own
+		// primary_hit, if given, is set to the first thing the ray hit
+		HdrColor TraceRay(const Scene& scene, vec3 ray_origin, vec3 direction, float t_min, float t_max, int max_bounces, TraceContext& context, PrimaryHit* primary_hit = nullptr) const;
+		// Returns the index of the closest sphere in the scene's SphereStore, -1 if nothing was hit
+		std::tuple<int, float> ClosestIntersection(const Scene& scene, vec3 ray_origin, vec3 direction, float t_min, float t_max, TraceContext& context) const;
+		// Index of a sphere within (t_min, t_max) along the ray, -1 if there is none. Stops at the first one it finds.
+		int FindOccluder(const Scene& scene, vec3 ray_origin, vec3 direction, float t_min, float t_max, TraceContext& context) const;
+		// Lights scene.light_set_ as compiled by the last Render, normal has to be unit length
+		float ComputeLighting(const Scene& scene, vec3 point, vec3 normal, vec3 vec_to_camera, int s, TraceContext& context) const;
+		void TracePacket(const Scene& scene, const RayPacket& packet, int max_bounces, HdrColor* colors, TraceContext& context, PrimaryHit* primary_hits = nullptr) const;
+		void ComputeLightingPacket(const Scene& scene, int count, const vec3* points, const vec3* normals, const vec3* vecs_to_camera, const int* specular, float* intensities, TraceContext& context) const;
+		vec3 CanvasToViewport(int x, int y) const;
 
 		void SetFov(float degrees);
 		float GetFov() const;
+		// Number of threads used by Render, including the calling thread
+		void SetThreadCount(int num_threads);
+		int GetThreadCount() const;
+		// Trace primary and shadow rays in SIMD packets instead of one at a time
+		void SetPacketTracing(bool enabled);
+		bool GetPacketTracing() const;
+		// Shade and intersect with the approximations in fast_math.h: pow by squaring, reciprocal square roots and
+		// a quadratic with 1 / a worked out once per ray. Off by default, only affects the CPU path.
+		void SetFastMath(bool enabled);
+		bool GetFastMath() const;
+		// Reflections followed after the first hit, the GPU path reads it as u_Max_Bounces
+		void SetMaxBounces(int max_bounces);
+		int GetMaxBounces() const;
+		// Totals of the last call to Render
+		const RenderStats& GetLastFrameStats() const;
+		// Render traces at a lower resolution and upscales whenever a frame takes longer than this, 0 always renders at full resolution
+		void SetTargetFrameTime(float ms);
+		float GetTargetFrameTime() const;
+		// Resolution scale the next call to Render will trace at
+		float GetResolutionScale() const;
+		const FrameTiming& GetLastFrameTiming() const;
+		// Render reuses pixels of the previous frame that are still valid after the camera moved, see TemporalCache.
+		// Only frames of an unchanged scene can be reused, animated scenes trace every pixel.
+		void SetTemporalReprojection(bool enabled);
+		bool GetTemporalReprojection() const;
+		void SetGpuBackend(GpuBackend backend);
+		GpuBackend GetGpuBackend() const;
+		// Backend RenderGPU draws scene with. Scenes too big for the uniform blocks use the texture buffers
+		// whenever Scene::InitTextureBuffers was called.
+		GpuBackend GpuBackendFor(const Scene& scene) const;
+		// Program RenderGPU draws scene with, the camera uniforms have to be set on it first. With uniform buffers
+		// it is the program specialized for the scene once that is built. nullptr while no program is ready.
+		Shader* GetGpuShader(const Scene& scene) const;
+		// Times the uploads and the draw of RenderGPU with GPU timer queries. Needs the GL context,
+		// returns -1 if the driver has no timer queries.
+		int SetGpuTiming(bool enabled);
+		bool GetGpuTiming() const;
+		// Results arrive a few frames after the frame they belong to, see GpuTimer
+		const GpuFrameTiming& GetLastGpuTiming() const;
 
 		void HandlePressedInputs(SDL_Event& e, float delta_time);
 		void HandleHeldInputs(float delta_time);
 		
 		
 	private:
-		
+		// ComputeLighting and ComputeLightingPacket with the fast math or the exact shading
+		template <bool FAST>
+		float ComputeLightingKernel(const Scene& scene, vec3 point, vec3 normal, vec3 vec_to_camera, int s, TraceContext& context) const;
+		template <bool FAST>
+		void ComputeLightingPacketKernel(const Scene& scene, int count, const vec3* points, const vec3* normals, const vec3* vecs_to_camera, const int* specular, float* intensities, TraceContext& context) const;
+		// ClosestIntersection and FindOccluder with fast math
+		std::tuple<int, float> ClosestIntersectionFast(const Scene& scene, vec3 ray_origin, vec3 direction, float t_min, float t_max, TraceContext& context) const;
+		int FindOccluderFast(const Scene& scene, vec3 ray_origin, vec3 direction, float t_min, float t_max, TraceContext& context) const;
+		// Whether a sphere blocks light_vec before t_max, tries the sphere that last blocked the light first
+		bool InShadow(const Scene& scene, vec3 point, vec3 light_vec, float t_min, float t_max, int light, TraceContext& context) const;
+		void RenderTile(const Scene& scene, int tile_index, TraceContext& context);
+		void RenderTemporalTile(const Scene& scene, int tile_index, TraceContext& context);
+		void TracePixels(const Scene& scene, const int* columns, const int* rows, int count, vec3 jitter, HdrColor* colors, PrimaryHit* primary_hits, TraceContext& context) const;
+		// Returns the number of pixels that changed by more than half a display step, only counted for passes that add samples
+		int RenderProgressiveTile(const Scene& scene, int tile_index, int pass, TraceContext& context);
+		// Everything besides the camera and canvas size that changes what the CPU renders
+		u64 SceneStateHash(const Scene& scene) const;
+		// Everything that changes what the CPU renders, a different value restarts progressive rendering
+		u64 RenderStateHash(const Scene& scene) const;
+		void SetupCamera(const Scene& scene, int width, int height);
+		// Fills canvas_ rows [row_start, row_end) from a hdr_canvas_ smaller than the canvas
+		void UpscaleRows(int row_start, int row_end);
+		// Adds last_frame_stats_ to the profiler's counters
+		void CountFrameStats() const;
 
-		SDL_Surface* canvas_ = NULL;
+		Framebuffer* canvas_ = NULL;
+		// Tiles trace into this and quantize their own pixels into canvas_ when done.
+		// Smaller than canvas_ when the resolution is scaled down, it is upscaled once every tile is done.
+		HdrFramebuffer hdr_canvas_;
+		ResolutionController resolution_;
+		bool temporal_reprojection_ = false;
+		TemporalCache temporal_cache_;
+		FrameTiming last_frame_timing_;
 		Color background_color_ = Color(0x0, 0x0, 0x0);
 		//Color background_color_ = Color(0xFF, 0xFF, 0xFF);
 
@@ -42,6 +151,23 @@ namespace raytrace {
 		int viewport_width_ = 1;
 		int viewport_height_ = 1;
 		float dist_to_viewport_ = 0.5;
+		CameraRayGenerator camera_rays_;
+
+		std::unique_ptr<ThreadPool> thread_pool_;
+
+		GpuBackend gpu_backend_ = GpuBackend::kUniformBuffers;
+		GpuTimer gpu_timer_;
+		bool packet_tracing_ = true;
+		bool fast_math_ = false;
+		int max_bounces_ = 2;
+
+		u64 progressive_state_ = 0;
+		int progressive_pass_ = 0;
+		bool converged_ = false;
+		std::vector<int> tile_changes_;
+
+		std::vector<RenderStats> tile_stats_;
+		RenderStats last_frame_stats_;
 
 	};
 } // namespace raytrace
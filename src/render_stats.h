@@ -0,0 +1,30 @@
+#pragma once
+#ifndef RAYTRACE_RENDER_STATS_H_
+#define	RAYTRACE_RENDER_STATS_H_
+
+#include "types.h"
+
+namespace raytrace {
+	// Work done by the CPU renderer. Every tile counts into its own copy, Render adds them up afterwards.
+	struct RenderStats {
+		u64 primary_rays = 0;
+		u64 shadow_rays = 0;
+		u64 reflection_rays = 0;
+		u64 intersection_tests = 0; // Ray-sphere tests, BVH node tests are not counted
+		u64 occluder_cache_tests = 0; // Shadow rays tested against a cached occluder first
+		u64 occluder_cache_hits = 0; // Shadow rays the cached occluder blocked, no full query needed
+		u64 reprojected_pixels = 0; // Pixels that kept their color from the previous frame instead of being traced
+
+		RenderStats& operator+=(const RenderStats& other) {
+			primary_rays += other.primary_rays;
+			shadow_rays += other.shadow_rays;
+			reflection_rays += other.reflection_rays;
+			intersection_tests += other.intersection_tests;
+			occluder_cache_tests += other.occluder_cache_tests;
+			occluder_cache_hits += other.occluder_cache_hits;
+			reprojected_pixels += other.reprojected_pixels;
+			return *this;
+		}
+	};
+} // namespace raytrace
+#endif // RAYTRACE_RENDER_STATS_H_
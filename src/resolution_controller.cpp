@@ -0,0 +1,37 @@
+#include "resolution_controller.h"
+
+#include <algorithm>
+#include <math.h>
+
+namespace raytrace {
+
+	void ResolutionController::SetTargetFrameTime(float ms) {
+		target_ms_ = std::max(0.0f, ms);
+		if (!IsEnabled()) {
+			scale_ = MAX_SCALE;
+		}
+		smoothed_ms_ = 0.0f;
+	}
+
+	void ResolutionController::Update(float frame_ms) {
+		if (!IsEnabled()) {
+			return;
+		}
+		// The first frame after a reset is taken as is, one slow frame shouldn't swing the scale after that
+		if (smoothed_ms_ <= 0.0f) {
+			smoothed_ms_ = frame_ms;
+		}
+		else {
+			smoothed_ms_ += (frame_ms - smoothed_ms_) * SMOOTHING;
+		}
+		if (smoothed_ms_ <= 0.0f || fabsf(smoothed_ms_ - target_ms_) <= target_ms_ * TOLERANCE) {
+			return;
+		}
+		// Go halfway to the scale that would have hit the target, the time isn't exactly proportional to the pixels
+		float ideal_scale = scale_ * sqrtf(target_ms_ / smoothed_ms_);
+		float new_scale = std::min(std::max(scale_ + (ideal_scale - scale_) * 0.5f, MIN_SCALE), MAX_SCALE);
+		// Guess what the smoothed time would have been at the new scale so the next frames don't overshoot
+		smoothed_ms_ *= (new_scale * new_scale) / (scale_ * scale_);
+		scale_ = new_scale;
+	}
+} // namespace raytrace
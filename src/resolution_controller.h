@@ -0,0 +1,45 @@
+#pragma once
+#ifndef RAYTRACE_RESOLUTION_CONTROLLER_H_
+#define	RAYTRACE_RESOLUTION_CONTROLLER_H_
+
+#include "types.h"
+
+namespace raytrace {
+	// How long the last CPU frame took and at what resolution it was traced
+	struct FrameTiming {
+		float total_ms = 0.0f; // The whole Render call
+		float trace_ms = 0.0f;
+		float upscale_ms = 0.0f; // 0 when the frame was traced at full resolution
+		float scale = 1.0f;
+		int render_width = 0;
+		int render_height = 0;
+	};
+
+	// Picks the resolution scale of the next CPU frame so frames take about the target time.
+	// Tracing cost grows with the number of pixels, which is the square of the scale.
+	class ResolutionController {
+	public:
+		static constexpr float MIN_SCALE = 0.25f;
+		static constexpr float MAX_SCALE = 1.0f;
+		// Weight of the newest frame in the smoothed frame time
+		static constexpr float SMOOTHING = 0.25f;
+		// The scale is left alone while the smoothed time is within this fraction of the target
+		static constexpr float TOLERANCE = 0.1f;
+
+		// Frame time budget in milliseconds, 0 turns the controller off and renders at full resolution
+		void SetTargetFrameTime(float ms);
+		float GetTargetFrameTime() const { return target_ms_; };
+		bool IsEnabled() const { return target_ms_ > 0.0f; };
+
+		float GetScale() const { return scale_; };
+		float GetSmoothedFrameTime() const { return smoothed_ms_; };
+		// Call with the time of every frame rendered at GetScale()
+		void Update(float frame_ms);
+
+	private:
+		float target_ms_ = 0.0f;
+		float scale_ = MAX_SCALE;
+		float smoothed_ms_ = 0.0f;
+	};
+} // namespace raytrace
+#endif // RAYTRACE_RESOLUTION_CONTROLLER_H_
@@ -1,50 +1,135 @@
 
 #include "scene.h"
 
-namespace raytrace {
+#include "profiler.h"
 
-	int Scene::Init(Shader& shader) {
-		glGenBuffers(1, &Scene::ubo_sphere_buffer_);
-		glBindBuffer(GL_UNIFORM_BUFFER, Scene::ubo_sphere_buffer_);
-		glBufferData(GL_UNIFORM_BUFFER, SPHERES_BUFFER_SIZE, NULL, GL_DYNAMIC_DRAW);
+namespace raytrace {
+	static_assert(Sphere::Std140Block::ARRAY_OFFSET == UniformRing::HEADER_SIZE && Light::Std140Block::ARRAY_OFFSET == UniformRing::HEADER_SIZE,
+		"The uniform rings expect the count in the first 16 bytes");
 
-		glGenBuffers(1, &Scene::ubo_light_buffer_);
-		glBindBuffer(GL_UNIFORM_BUFFER, Scene::ubo_light_buffer_);
-		glBufferData(GL_UNIFORM_BUFFER, LIGHTS_BUFFER_SIZE, NULL, GL_STATIC_DRAW);
-		
-		glBindBuffer(GL_UNIFORM_BUFFER, 0);
-		glBindBufferBase(GL_UNIFORM_BUFFER, 0, Scene::ubo_sphere_buffer_);
-		glBindBufferBase(GL_UNIFORM_BUFFER, 1, Scene::ubo_light_buffer_);
+	int Scene::Init(ShaderVariants& programs) {
+		int sphere_ring_error = sphere_ring_.Init(Sphere::SPHERE_SIZE_STD140, MAX_UNIFORM_SPHERES);
+		int light_ring_error = light_ring_.Init(Light::LIGHT_SIZE_STD140, MAX_UNIFORM_LIGHTS);
+		if (sphere_ring_error || light_ring_error) {
+			return -1;
+		}
+		sphere_ring_owner_ = nullptr;
 		// Dependency inject shader
-		shader_ = &shader;
-
+		shader_variants_ = &programs;
+		return 0;
+	}
+	void Scene::BindUniformBlocks(Shader& shader) {
 		// Bind ubos to shader
-		GLuint ubo_sphere_buffer_index = glGetUniformBlockIndex((*shader_).GetProgramID(), "ubo_Spheres");
-		GLuint ubo_light_buffer_index = glGetUniformBlockIndex((*shader_).GetProgramID(), "ubo_Lights");
+		GLuint ubo_sphere_buffer_index = glGetUniformBlockIndex(shader.GetProgramID(), "ubo_Spheres");
+		GLuint ubo_light_buffer_index = glGetUniformBlockIndex(shader.GetProgramID(), "ubo_Lights");
 		// Bind ubo_Spheres to ubo index 0 in shader
-		glUniformBlockBinding((*shader_).GetProgramID(), ubo_sphere_buffer_index, 0);
+		glUniformBlockBinding(shader.GetProgramID(), ubo_sphere_buffer_index, 0);
 		// Bind ubo_Lights to ubo index 1 in shader
-		glUniformBlockBinding((*shader_).GetProgramID(), ubo_light_buffer_index, 1);
-		return 0;
+		glUniformBlockBinding(shader.GetProgramID(), ubo_light_buffer_index, 1);
+	}
+	int Scene::InitTextureBuffers(Shader& shader) {
+		return texture_buffers_.Init(shader);
 	}
 	Scene::Scene() {
 	}
+	Scene::~Scene() {
+		// Another scene could be created at the same address
+		if (sphere_ring_owner_ == this) {
+			sphere_ring_owner_ = nullptr;
+		}
+		texture_buffers_.Forget(this);
+	}
 	
 	int Scene::AddSphere(std::shared_ptr<Sphere>& sphere) {
+		if (sphere->IsBound()) {
+			std::cout << "Sphere already belongs to a scene" << std::endl;
+			return -1;
+		}
+		sphere->Bind(&sphere_store_);
 		spheres.emplace_back(sphere);
 		return 0;
 	};
 	void Scene::WriteSphereBuffer() {
-		Sphere::WriteUniformBuffer(Scene::serialized_spheres_, spheres);
-		glBindBuffer(GL_UNIFORM_BUFFER, Scene::ubo_sphere_buffer_);
-		glBufferSubData(GL_UNIFORM_BUFFER, 0, SPHERES_BUFFER_SIZE, Scene::serialized_spheres_);
-		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		RAYTRACE_PROFILE_SCOPE("Scene::WriteSphereBuffer");
+		int num_spheres = std::min(sphere_store_.Size(), MAX_UNIFORM_SPHERES);
+		u8* entries = serialized_spheres_ + Sphere::Std140Block::ARRAY_OFFSET;
+		if (sphere_ring_owner_ != this) { // Staging holds another scene, compare all of ours against it
+			Sphere::WriteUniformBuffer(serialized_spheres_, sphere_store_);
+			sphere_ring_.WriteEntries(0, num_spheres, entries);
+			sphere_ring_owner_ = this;
+		}
+		else { // Only the spheres the store saw change
+			for (int i : sphere_store_.GetDirty()) {
+				if (i < num_spheres) {
+					u8* entry = entries + i * Sphere::Std140Block::STRIDE;
+					Sphere::SerializeStd140(sphere_store_, i, entry);
+					sphere_ring_.WriteEntry(i, entry);
+				}
+			}
+		}
+		sphere_store_.ClearDirty();
+		sphere_ring_.WriteCount(num_spheres);
+		sphere_ring_.Upload(0);
 	}
 	void Scene::WriteLightBuffer() {
-		Light::WriteUniformBuffer(Scene::serialized_lights_, lights);
-		glBindBuffer(GL_UNIFORM_BUFFER, Scene::ubo_light_buffer_);
-		glBufferSubData(GL_UNIFORM_BUFFER, 0, LIGHTS_BUFFER_SIZE, Scene::serialized_lights_);
-		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		RAYTRACE_PROFILE_SCOPE("Scene::WriteLightBuffer");
+		// Lights are changed in place so there's nothing to mark them dirty, every light is compared to what is staged
+		int num_lights = std::min((int)lights.size(), MAX_UNIFORM_LIGHTS);
+		Light::WriteUniformBuffer(serialized_lights_, lights);
+		light_ring_.WriteEntries(0, num_lights, serialized_lights_ + Light::Std140Block::ARRAY_OFFSET);
+		light_ring_.WriteCount(num_lights);
+		light_ring_.Upload(1);
+	}
+	void Scene::FenceBuffers() {
+		sphere_ring_.Fence();
+		light_ring_.Fence();
+	}
+	bool Scene::FitsUniformBuffers() const {
+		return sphere_store_.Size() <= MAX_UNIFORM_SPHERES && (int)lights.size() <= MAX_UNIFORM_LIGHTS;
+	}
+	void Scene::WriteTextureBuffers() {
+		RAYTRACE_PROFILE_SCOPE("Scene::WriteTextureBuffers");
+		bvh_.Update(sphere_store_);
+		texture_buffers_.Write(*this);
+	}
+	u64 Scene::LightGeneration() const {
+		bool same = seen_lights_.size() == lights.size();
+		for (size_t i = 0; same && i < lights.size(); i++) {
+			same = memcmp(&seen_lights_[i], lights[i].get(), sizeof(Light)) == 0; // Only 4 byte members, no padding
+		}
+		if (!same) {
+			seen_lights_.clear();
+			for (const std::shared_ptr<Light>& light : lights) {
+				seen_lights_.push_back(*light);
+			}
+			light_generation_++;
+		}
+		return light_generation_;
+	}
+	u64 Scene::ChangeKey() const {
+		u64 key[3] = { sphere_store_.GetId(), sphere_store_.GetGeneration(), LightGeneration() };
+		return HashBytes(key, sizeof(key));
+	}
+	ShaderSignature Scene::GetShaderSignature(int max_bounces) const {
+		ShaderSignature signature;
+		signature.num_spheres = std::min(sphere_store_.Size(), MAX_UNIFORM_SPHERES);
+		signature.num_lights = std::min((int)lights.size(), MAX_UNIFORM_LIGHTS);
+		signature.max_bounces = max_bounces;
+		signature.ambient_lights = false;
+		signature.point_lights = false;
+		signature.directional_lights = false;
+		for (int i = 0; i < signature.num_lights; i++) {
+			switch (lights[i]->type) {
+			case LightType::kAmbient: signature.ambient_lights = true; break;
+			case LightType::kPoint: signature.point_lights = true; break;
+			case LightType::kDirectional: signature.directional_lights = true; break;
+			}
+		}
+		signature.specular = false;
+		for (int i = 0; i < signature.num_spheres && !signature.specular; i++) {
+			signature.specular = sphere_store_.GetMaterial(i).specular != -1;
+		}
+		return signature;
 	}
 	int Scene::AddLight(std::shared_ptr<Light>& light) {
 		lights.emplace_back(light);
@@ -6,37 +6,79 @@
 
 #include <SDL.h>
 
+#include "bvh.h"
 #include "camera.h"
+#include "light_set.h"
 #include "sphere.h"
 #include "shader.h"
+#include "texture_buffer_scene.h"
 #include "types.h"
+#include "uniform_ring.h"
 
 namespace raytrace {
 	class Scene {
 	public:
-		static inline const int SPHERES_BUFFER_SIZE = 4816; // Holds 100 spheres
-		static inline const int LIGHTS_BUFFER_SIZE = 4816; // Holds 100 lights
+		static inline const int SPHERES_BUFFER_SIZE = (int)Sphere::Std140Block::SIZE; // Holds 100 spheres
+		static inline const int LIGHTS_BUFFER_SIZE = (int)Light::Std140Block::SIZE; // Holds 100 lights
+		static inline const int MAX_UNIFORM_SPHERES = Sphere::UNIFORM_BLOCK_CAPACITY;
+		static inline const int MAX_UNIFORM_LIGHTS = Light::UNIFORM_BLOCK_CAPACITY;
 
-		static int Init(Shader& shader);
+		// programs are built from default.frag, every one of them gets its uniform blocks bound by BindUniformBlocks
+		static int Init(ShaderVariants& programs);
+		static void BindUniformBlocks(Shader& shader);
+		// Optional backend for scenes of any size, shader is built from texture_buffer.frag
+		static int InitTextureBuffers(Shader& shader);
 		Scene();
+		~Scene();
+		// Sphere handles point at sphere_store_, so a scene stays where it was made
+		Scene(const Scene&) = delete;
+		Scene& operator=(const Scene&) = delete;
+		Scene(Scene&&) = delete;
+		Scene& operator=(Scene&&) = delete;
 
 		int AddSphere(std::shared_ptr<Sphere>& sphere);
 		int AddLight(std::shared_ptr<Light>& light);
 		int RemoveLight(std::shared_ptr<Light>& light);
+		// Upload the spheres/lights that changed since the GPU buffer of this frame was last written
 		void WriteSphereBuffer();
 		void WriteLightBuffer();
-		virtual void Update(float delta_time) {};
+		// Call after the draw that reads the buffers
+		static void FenceBuffers();
+		// Whether every sphere and light fits in the uniform blocks, the rest past their capacity is dropped
+		bool FitsUniformBuffers() const;
+		// Brings the BVH up to date and uploads the scene to the texture buffers if it changed
+		void WriteTextureBuffers();
+		// time_ms is the animation time in milliseconds, animations only depend on it so frames can be reproduced
+		virtual void Update(float delta_time, u64 time_ms) {};
+		// Goes up whenever a light is added, removed or changed. Lights are changed in place through their handles,
+		// there are only a few so they are compared to a copy taken on the last call. Main thread only.
+		u64 LightGeneration() const;
+		// Changes whenever a sphere or light changes and is never the same for two scenes, the camera isn't included.
+		// Doesn't go over the spheres, so spheres set to the values they already had count as a change.
+		u64 ChangeKey() const;
+		// What the uniform buffer program can be specialized for, counts and lights as they are uploaded
+		ShaderSignature GetShaderSignature(int max_bounces) const;
 
-		// All scenes share the same buffer on GPU
-		static inline GLuint ubo_sphere_buffer_;
-		static inline GLuint ubo_light_buffer_;
+		// All scenes share the same buffers on GPU, sphere_ring_owner_ is the scene whose spheres are staged
+		static inline UniformRing sphere_ring_;
+		static inline UniformRing light_ring_;
+		static inline const Scene* sphere_ring_owner_ = nullptr;
+		// Blocks are serialized here before they are staged, kept around so a frame allocates nothing
 		static inline u8 serialized_spheres_[SPHERES_BUFFER_SIZE];
 		static inline u8 serialized_lights_[LIGHTS_BUFFER_SIZE];
-		static inline Shader* shader_ = nullptr;
+		static inline ShaderVariants* shader_variants_ = nullptr;
+		static inline TextureBufferScene texture_buffers_;
 
-		std::vector<std::shared_ptr<Sphere>> spheres;
+		std::vector<std::shared_ptr<Sphere>> spheres; // Handles of the spheres added with AddSphere, scene files add spheres without one
+		SphereStore sphere_store_;
+		Bvh bvh_; // Over sphere_store_, brought up to date by RayTracer::Render
 		std::vector<std::shared_ptr<Light>> lights;
+		LightSet light_set_; // Compiled from lights by RayTracer::Render
 		Camera camera_ = Camera(vec3(0.0f, 0.0f, 0.0f));
+
+	private:
+		mutable std::vector<Light> seen_lights_; // Lights as of the last LightGeneration
+		mutable u64 light_generation_ = 0;
 	};
 } // namespace raytrace
 #endif // RAYTRACE_SCENE_H_
@@ -0,0 +1,311 @@
+#include "scene_file.h"
+
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "mapped_file.h"
+#include "profiler.h"
+
+namespace raytrace {
+	static_assert(sizeof(SceneFileHeader) == 128, "SceneFileHeader is written as is");
+	static_assert(sizeof(SceneFileLight) == 32, "SceneFileLight is written as is");
+	static_assert(sizeof(SphereMaterial) == 12, "Materials are copied straight out of the file");
+
+	namespace {
+		const char SCENE_FILE_MAGIC[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', 0 };
+
+		u64 AlignUp(u64 offset) {
+			return (offset + SCENE_FILE_ALIGNMENT - 1) / SCENE_FILE_ALIGNMENT * SCENE_FILE_ALIGNMENT;
+		}
+
+		// Size in bytes of each section
+		void SectionSizes(u64 num_spheres, u64 num_lights, u64 sizes[(int)SceneFileSection::kCount]) {
+			for (int i = 0; i < (int)SceneFileSection::kCount; i++) {
+				sizes[i] = num_spheres * sizeof(float);
+			}
+			sizes[(int)SceneFileSection::kMaterials] = num_spheres * sizeof(SphereMaterial);
+			sizes[(int)SceneFileSection::kLights] = num_lights * sizeof(SceneFileLight);
+		}
+
+		// Whole token has to be a number
+		bool ParseFloat(const std::string& token, float& value) {
+			char* end = nullptr;
+			value = strtof(token.c_str(), &end);
+			return end != token.c_str() && *end == 0;
+		}
+
+		bool ParseInt(const std::string& token, int& value) {
+			char* end = nullptr;
+			long parsed = strtol(token.c_str(), &end, 10);
+			value = (int)parsed;
+			return end != token.c_str() && *end == 0 && parsed >= INT_MIN && parsed <= INT_MAX;
+		}
+
+		bool ParseVec3(const std::vector<std::string>& tokens, size_t first, vec3& value) {
+			return ParseFloat(tokens[first], value.x) && ParseFloat(tokens[first + 1], value.y) && ParseFloat(tokens[first + 2], value.z);
+		}
+
+		bool ParseChannel(const std::string& token, u8& value) {
+			int channel = 0;
+			if (!ParseInt(token, channel) || channel < 0 || channel > 255) {
+				return false;
+			}
+			value = (u8)channel;
+			return true;
+		}
+	} // namespace
+
+	int LoadSceneFile(const std::string& path, Scene& scene) {
+		RAYTRACE_PROFILE_SCOPE("LoadSceneFile");
+		MappedFile file;
+		if (file.Open(path) < 0) {
+			return -1;
+		}
+		const u8* data = file.Data();
+		SceneFileHeader header;
+		if (file.Size() < sizeof(header)) {
+			std::cerr << path << " is too small to be a scene file" << std::endl;
+			return -1;
+		}
+		memcpy(&header, data, sizeof(header));
+		if (memcmp(header.magic, SCENE_FILE_MAGIC, sizeof(SCENE_FILE_MAGIC)) != 0) {
+			std::cerr << path << " is not a scene file" << std::endl;
+			return -1;
+		}
+		if (header.version != SCENE_FILE_VERSION) {
+			std::cerr << path << " is scene file version " << header.version << ", expected " << SCENE_FILE_VERSION << std::endl;
+			return -1;
+		}
+		if (header.header_size != sizeof(header) || header.file_size != file.Size()) {
+			std::cerr << path << " is truncated or its header is corrupt" << std::endl;
+			return -1;
+		}
+		if (header.num_spheres > (u32)INT_MAX - (u32)scene.sphere_store_.Size()) {
+			std::cerr << path << " has too many spheres" << std::endl;
+			return -1;
+		}
+		u64 sizes[(int)SceneFileSection::kCount];
+		SectionSizes(header.num_spheres, header.num_lights, sizes);
+		for (int i = 0; i < (int)SceneFileSection::kCount; i++) {
+			u64 offset = header.offsets[i];
+			if (offset % SCENE_FILE_ALIGNMENT != 0 || offset > file.Size() || sizes[i] > file.Size() - offset) {
+				std::cerr << path << " has a section outside of the file" << std::endl;
+				return -1;
+			}
+		}
+		const SceneFileLight* file_lights = (const SceneFileLight*)(data + header.offsets[(int)SceneFileSection::kLights]);
+		for (u32 i = 0; i < header.num_lights; i++) {
+			if (file_lights[i].type > (u32)LightType::kDirectional) {
+				std::cerr << path << " has a light of unknown type " << file_lights[i].type << std::endl;
+				return -1;
+			}
+		}
+
+		// The mapping is page aligned and every section starts on SCENE_FILE_ALIGNMENT, the arrays can be used in place
+		PackedSpheres spheres;
+		spheres.center_x = (const float*)(data + header.offsets[(int)SceneFileSection::kCenterX]);
+		spheres.center_y = (const float*)(data + header.offsets[(int)SceneFileSection::kCenterY]);
+		spheres.center_z = (const float*)(data + header.offsets[(int)SceneFileSection::kCenterZ]);
+		spheres.radius = (const float*)(data + header.offsets[(int)SceneFileSection::kRadius]);
+		spheres.radius_sq = (const float*)(data + header.offsets[(int)SceneFileSection::kRadiusSquared]);
+		// radius_sq is stored to skip recomputing it, it has to be exactly what SphereStore would compute
+		for (u32 i = 0; i < header.num_spheres; i++) {
+			float radius = spheres.radius[i];
+			if (!(radius > 0.0f) || !std::isfinite(radius) || spheres.radius_sq[i] != radius * radius) {
+				std::cerr << path << " has a bad radius for sphere " << i << std::endl;
+				return -1;
+			}
+		}
+		spheres.materials = (const SphereMaterial*)(data + header.offsets[(int)SceneFileSection::kMaterials]);
+		spheres.count = (int)header.num_spheres;
+		scene.sphere_store_.AddPacked(spheres);
+
+		for (u32 i = 0; i < header.num_lights; i++) {
+			const SceneFileLight& file_light = file_lights[i];
+			vec3 position(file_light.position[0], file_light.position[1], file_light.position[2]);
+			vec3 direction(file_light.direction[0], file_light.direction[1], file_light.direction[2]);
+			Light light = Light::AmbientLight(file_light.intensity);
+			switch ((LightType)file_light.type) {
+			case LightType::kAmbient: break;
+			case LightType::kPoint: light = Light::PointLight(file_light.intensity, position); break;
+			case LightType::kDirectional: light = Light::DirectionalLight(file_light.intensity, direction); break;
+			}
+			std::shared_ptr<Light> light_ref = std::make_shared<Light>(light);
+			scene.AddLight(light_ref);
+		}
+		vec3 camera_position(header.camera_position[0], header.camera_position[1], header.camera_position[2]);
+		scene.camera_ = Camera(camera_position, header.camera_roll, header.camera_pitch, header.camera_yaw);
+		return 0;
+	}
+
+	int WriteSceneFile(const std::string& path, const Scene& scene) {
+		PackedSpheres spheres = scene.sphere_store_.Packed();
+		SceneFileHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(SCENE_FILE_MAGIC));
+		header.version = SCENE_FILE_VERSION;
+		header.header_size = sizeof(header);
+		header.num_spheres = (u32)spheres.count;
+		header.num_lights = (u32)scene.lights.size();
+		header.camera_position[0] = scene.camera_.position.x;
+		header.camera_position[1] = scene.camera_.position.y;
+		header.camera_position[2] = scene.camera_.position.z;
+		header.camera_roll = scene.camera_.roll;
+		header.camera_pitch = scene.camera_.pitch;
+		header.camera_yaw = scene.camera_.yaw;
+		u64 sizes[(int)SceneFileSection::kCount];
+		SectionSizes(header.num_spheres, header.num_lights, sizes);
+		u64 offset = sizeof(header);
+		for (int i = 0; i < (int)SceneFileSection::kCount; i++) {
+			offset = AlignUp(offset);
+			header.offsets[i] = offset;
+			offset += sizes[i];
+		}
+		header.file_size = offset;
+
+		std::vector<SceneFileLight> file_lights(scene.lights.size());
+		for (size_t i = 0; i < scene.lights.size(); i++) {
+			const Light& light = *scene.lights[i];
+			SceneFileLight& file_light = file_lights[i];
+			file_light.position[0] = light.position.x;
+			file_light.position[1] = light.position.y;
+			file_light.position[2] = light.position.z;
+			file_light.direction[0] = light.direction.x;
+			file_light.direction[1] = light.direction.y;
+			file_light.direction[2] = light.direction.z;
+			file_light.type = (u32)light.type;
+			file_light.intensity = light.intensity;
+		}
+		const void* sections[(int)SceneFileSection::kCount] = {
+			spheres.center_x, spheres.center_y, spheres.center_z, spheres.radius, spheres.radius_sq, spheres.materials, file_lights.data()
+		};
+
+		std::ofstream file(path, std::ios::binary);
+		if (!file) {
+			std::cerr << "Could not open " << path << " for writing" << std::endl;
+			return -1;
+		}
+		const char padding[SCENE_FILE_ALIGNMENT] = {};
+		file.write((const char*)&header, sizeof(header));
+		u64 written = sizeof(header);
+		for (int i = 0; i < (int)SceneFileSection::kCount; i++) {
+			file.write(padding, (std::streamsize)(header.offsets[i] - written));
+			if (sizes[i] > 0) {
+				file.write((const char*)sections[i], (std::streamsize)sizes[i]);
+			}
+			written = header.offsets[i] + sizes[i];
+		}
+		if (!file) {
+			std::cerr << "Could not write " << path << std::endl;
+			return -1;
+		}
+		return 0;
+	}
+
+	int LoadSceneText(const std::string& path, Scene& scene) {
+		std::ifstream file(path);
+		if (!file) {
+			std::cerr << "Could not open " << path << std::endl;
+			return -1;
+		}
+		std::string text;
+		std::vector<std::string> tokens;
+		int line_number = 0;
+		while (std::getline(file, text)) {
+			line_number++;
+			size_t comment = text.find('#');
+			if (comment != std::string::npos) {
+				text.resize(comment);
+			}
+			std::istringstream line(text);
+			tokens.clear();
+			for (std::string token; line >> token;) {
+				tokens.push_back(token);
+			}
+			if (tokens.empty()) {
+				continue;
+			}
+			const std::string& item = tokens[0];
+			size_t num_values = tokens.size() - 1;
+			bool valid = false;
+			if (item == "camera") {
+				vec3 position;
+				float roll = 0.0f;
+				float pitch = 0.0f;
+				float yaw = 0.0f;
+				valid = (num_values == 3 || num_values == 6) && ParseVec3(tokens, 1, position);
+				if (valid && num_values == 6) {
+					valid = ParseFloat(tokens[4], roll) && ParseFloat(tokens[5], pitch) && ParseFloat(tokens[6], yaw);
+				}
+				if (valid) {
+					scene.camera_ = Camera(position, roll, pitch, yaw);
+				}
+			}
+			else if (item == "sphere") {
+				vec3 center;
+				float radius = 0.0f;
+				SphereMaterial material = { Color(), Sphere::DEFAULT_SPECULAR, Sphere::DEFAULT_REFLECTIVE };
+				valid = num_values >= 7 && num_values <= 9 && ParseVec3(tokens, 1, center) && ParseFloat(tokens[4], radius) && radius > 0.0f && std::isfinite(radius)
+					&& ParseChannel(tokens[5], material.color.r) && ParseChannel(tokens[6], material.color.g) && ParseChannel(tokens[7], material.color.b);
+				if (valid && num_values >= 8) {
+					valid = ParseInt(tokens[8], material.specular);
+				}
+				if (valid && num_values == 9) {
+					valid = ParseFloat(tokens[9], material.reflective);
+				}
+				if (valid) {
+					scene.sphere_store_.Add(center, radius, material);
+				}
+			}
+			else if (item == "ambient") {
+				float intensity = 0.0f;
+				valid = num_values == 1 && ParseFloat(tokens[1], intensity);
+				if (valid) {
+					std::shared_ptr<Light> light = std::make_shared<Light>(Light::AmbientLight(intensity));
+					scene.AddLight(light);
+				}
+			}
+			else if (item == "point" || item == "directional") {
+				float intensity = 0.0f;
+				vec3 v;
+				valid = num_values == 4 && ParseFloat(tokens[1], intensity) && ParseVec3(tokens, 2, v);
+				if (valid) {
+					std::shared_ptr<Light> light = std::make_shared<Light>(item == "point" ? Light::PointLight(intensity, v) : Light::DirectionalLight(intensity, v));
+					scene.AddLight(light);
+				}
+			}
+			else {
+				std::cerr << path << ":" << line_number << ": unknown item \"" << item << "\"" << std::endl;
+				return -1;
+			}
+			if (!valid) {
+				std::cerr << path << ":" << line_number << ": bad " << item << ", see scene_file.h for the format" << std::endl;
+				return -1;
+			}
+		}
+		return 0;
+	}
+
+	int ConvertSceneText(const std::string& text_path, const std::string& scene_path) {
+		Scene scene;
+		if (LoadSceneText(text_path, scene) < 0 || WriteSceneFile(scene_path, scene) < 0) {
+			return -1;
+		}
+		std::cout << "Wrote " << scene.sphere_store_.Size() << " spheres and " << scene.lights.size() << " lights to " << scene_path << std::endl;
+		return 0;
+	}
+
+	int LoadScene(const std::string& path, Scene& scene) {
+		const std::string extension = SCENE_FILE_EXTENSION;
+		if (path.size() >= extension.size() && path.compare(path.size() - extension.size(), extension.size(), extension) == 0) {
+			return LoadSceneFile(path, scene);
+		}
+		return LoadSceneText(path, scene);
+	}
+} // namespace raytrace
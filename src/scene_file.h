@@ -0,0 +1,69 @@
+#pragma once
+#ifndef RAYTRACE_SCENE_FILE_H_
+#define	RAYTRACE_SCENE_FILE_H_
+
+#include <string>
+
+#include "scene.h"
+#include "types.h"
+
+// Binary scene files (.rtscene), little endian. A SceneFileHeader, then one array per SceneFileSection at the
+// offset the header gives for it, each starting on a 64 byte boundary. The sphere arrays are laid out exactly like
+// SphereStore's so loading maps the file and copies each array in one go, nothing is parsed per sphere.
+// Files with another version are rejected, bump SCENE_FILE_VERSION whenever the layout changes.
+namespace raytrace {
+	const u32 SCENE_FILE_VERSION = 1;
+	const u64 SCENE_FILE_ALIGNMENT = 64;
+	const char SCENE_FILE_EXTENSION[] = ".rtscene";
+
+	enum class SceneFileSection {
+		kCenterX = 0, // num_spheres floats
+		kCenterY,
+		kCenterZ,
+		kRadius,
+		kRadiusSquared,
+		kMaterials, // num_spheres SphereMaterial
+		kLights, // num_lights SceneFileLight
+		kCount
+	};
+
+	struct SceneFileHeader {
+		char magic[8]; // "RTSCENE" and a 0
+		u32 version;
+		u32 header_size; // sizeof(SceneFileHeader)
+		u32 num_spheres;
+		u32 num_lights;
+		float camera_position[3];
+		float camera_roll;
+		float camera_pitch;
+		float camera_yaw;
+		u64 offsets[(int)SceneFileSection::kCount]; // From the start of the file
+		u64 file_size;
+		u8 reserved[16];
+	};
+
+	struct SceneFileLight {
+		float position[3];
+		float direction[3];
+		u32 type; // LightType
+		float intensity;
+	};
+
+	// Both return 0 on success, -1 with the reason printed. Loading adds to whatever scene already holds and replaces
+	// its camera, the spheres get no Sphere handles.
+	int LoadSceneFile(const std::string& path, Scene& scene);
+	int WriteSceneFile(const std::string& path, const Scene& scene);
+
+	// Text scenes, one item per line, # starts a comment:
+	//   camera x y z [roll pitch yaw]
+	//   sphere x y z radius r g b [specular [reflective]]  (color 0-255, specular -1 for matte)
+	//   ambient intensity
+	//   point intensity x y z
+	//   directional intensity x y z
+	int LoadSceneText(const std::string& path, Scene& scene);
+	// Reads a text scene and writes it as a scene file
+	int ConvertSceneText(const std::string& text_path, const std::string& scene_path);
+	// Files ending in SCENE_FILE_EXTENSION are loaded as scene files, anything else as text
+	int LoadScene(const std::string& path, Scene& scene);
+} // namespace raytrace
+#endif // RAYTRACE_SCENE_FILE_H_
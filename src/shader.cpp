@@ -1,177 +1,296 @@
 #include "shader.h"
 
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <tuple>
 #include <vector>
 
 #include <GL/glew.h>
 
-namespace raytrace {
-	std::string readFile(std::string file_name) {
-		std::filesystem::path shader_path = "src\\shaders\\";
-		std::filesystem::path full_path = shader_path / file_name;
-		std::cout << full_path << std::endl;
-		// open file in binary mode
-		std::ifstream file(full_path, std::ios::in | std::ios::ate | std::ios::binary);
+#include "shaders/embedded_shaders.h"
+#include "util.h"
 
-		// continue if successfully opened
-		if (file.is_open()) {
+namespace raytrace {
+	namespace {
+		// Start of every file in the binary cache
+		struct BinaryHeader {
+			u32 magic;
+			u32 format; // Driver specific, as returned by glGetProgramBinary
+			u64 cache_key;
+		};
+		const u32 BINARY_MAGIC = 0x42505452; // "RTPB"
 
-			// get size of file (std::ios::ate starts the get pointer at end of file)
-			std::streampos file_size = file.tellg();
-			
-			std::string file_contents;
-			file_contents.resize(file_size);
-			// read file contents into string
-			file.seekg(0, std::ios::beg);
-			file.read(&file_contents[0], file_size);
-			// clean up and return
-			file.close();
-			return file_contents;
-		}
-		abort();
-	}
-
-	// Detaches the shader of type type from the program object
-	// Returns 0 if no shader of type type was attached
-	int Shader::DetachSource(GLenum type)
-	{
-		if (type != GL_VERTEX_SHADER && type != GL_FRAGMENT_SHADER) {
-			std::cout << "Shader type not valid" << std::endl;
-			return -1;
+		bool HasParallelCompile() {
+			return GLEW_ARB_parallel_shader_compile;
 		}
-		if (type == GL_VERTEX_SHADER) {
-			if (vertex_shader_id_) {
-				glDetachShader(program_id_, vertex_shader_id_);
-				return 1;
+		// glGetProgramBinary needs at least one binary format
+		bool HasProgramBinary() {
+			if (!GLEW_ARB_get_program_binary) {
+				return false;
 			}
+			GLint num_formats = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+			return num_formats > 0;
 		}
-		if (type == GL_FRAGMENT_SHADER) {
-			if (fragment_shader_id_) {
-				glDetachShader(program_id_, fragment_shader_id_);
-				return 1;
+	} // namespace
+
+	int ReadShaderSource(const std::string& file_name, std::string& source) {
+		std::filesystem::path full_path = std::filesystem::path(Shader::SHADER_DIRECTORY) / file_name;
+		// open file in binary mode
+		std::ifstream file(full_path, std::ios::in | std::ios::binary);
+		if (file.is_open()) {
+			std::ostringstream contents;
+			contents << file.rdbuf();
+			source = contents.str();
+			return 0;
+		}
+		// Without the source tree next to the executable, use the copy built into it
+		for (const EmbeddedShader& embedded : EMBEDDED_SHADERS) {
+			if (file_name == embedded.file_name) {
+				source = embedded.source;
+				return 0;
 			}
 		}
-		return 0; // No shaders were attached
+		std::cout << "Shader \"" << file_name << "\" not found" << std::endl;
+		return -1;
 	}
-	
-	// Creates and attaches shader of type type from a path
-	// Returns the shader's handle on success, GL_FALSE on failure
-	GLuint Shader::AddSource(std::string shader_source, GLenum type) {
-		if (type != GL_VERTEX_SHADER && type != GL_FRAGMENT_SHADER) {
-			std::cout << "Shader type not valid" << std::endl;
-			return GL_FALSE;
+
+	Shader::Shader(const char* vertex_shader_file_name, const char* fragment_shader_file_name, const std::string& defines) {
+		// Lets the driver compile on its own threads, compile and link calls then return right away
+		static bool parallel_compile_enabled = false;
+		if (!parallel_compile_enabled && HasParallelCompile()) {
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+			parallel_compile_enabled = true;
+		}
+		vertex_shader_file_ = vertex_shader_file_name;
+		fragment_shader_file_ = fragment_shader_file_name;
+		defines_ = defines;
+		if (StartBuild() != 0) {
+			failed_ = true;
 		}
-		
-		// Read the shader from disk
-		std::string temp = readFile(shader_source);
-		const char* shader_code = temp.c_str();
+	}
 
-		// Create the shader object
-		GLuint shader_id = glCreateShader(type);
-		glShaderSource(shader_id, 1, &shader_code, NULL);
-		glCompileShader(shader_id);
+	// Creates pending_ from the cache, or starts compiling and linking it
+	int Shader::StartBuild() {
+		std::string vertex_source;
+		std::string fragment_source;
+		if (ReadShaderSource(vertex_shader_file_, vertex_source) != 0 || ReadShaderSource(fragment_shader_file_, fragment_source) != 0) {
+			return -1;
+		}
+		InsertDefines(vertex_source);
+		InsertDefines(fragment_source);
 
-		// Show compiler errors
-		GLint is_compiled = 0;
-		glGetShaderiv(shader_id, GL_COMPILE_STATUS, &is_compiled);
-		if (is_compiled == GL_FALSE) {
-			GLint log_len = 0;
-			glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &log_len);
+		pending_.program = glCreateProgram();
+		if (pending_.program == 0) {
+			std::cout << "Failed to create a shader program" << std::endl;
+			return -1;
+		}
+		pending_.cache_key = CacheKey(vertex_source, fragment_source);
+		if (LoadBinary(pending_.program, pending_.cache_key)) {
+			pending_.from_cache = true;
+			return 0;
+		}
 
-			std::string error_log(log_len, 'x');
-			glGetShaderInfoLog(shader_id, log_len, &log_len, &error_log[0]);
-			std::cout << "Shader \"" << shader_source << "\" failed to compile." << std::endl;
-			std::cout << error_log << std::endl;
-			return GL_FALSE;
+		pending_.vertex_shader = CompileSource(vertex_source, GL_VERTEX_SHADER);
+		pending_.fragment_shader = CompileSource(fragment_source, GL_FRAGMENT_SHADER);
+		glAttachShader(pending_.program, pending_.vertex_shader);
+		glAttachShader(pending_.program, pending_.fragment_shader);
+		if (HasProgramBinary()) {
+			glProgramParameteri(pending_.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 		}
+		// Compile errors show up as a failed link, the logs are read once it is done
+		glLinkProgram(pending_.program);
+		return 0;
+	}
 
-		glAttachShader(program_id_, shader_id);
-		
-		return shader_id;
+	bool Shader::IsBuildDone() const {
+		if (pending_.from_cache || !HasParallelCompile()) {
+			return true;
+		}
+		GLint done = GL_FALSE;
+		glGetProgramiv(pending_.program, GL_COMPLETION_STATUS_ARB, &done);
+		return done == GL_TRUE;
 	}
-	Shader::Shader(const char* vertex_shader_file_name, const char* fragment_shader_file_name) {
-		// Create program first, AddSource depends on it
-		program_id_ = glCreateProgram();
-		if (program_id_ == GL_FALSE) {
-			abort();
+
+	int Shader::FinishBuild() {
+		GLint link_status = GL_FALSE;
+		glGetProgramiv(pending_.program, GL_LINK_STATUS, &link_status);
+		if (link_status == GL_FALSE) {
+			PrintShaderLog(pending_.vertex_shader, vertex_shader_file_);
+			PrintShaderLog(pending_.fragment_shader, fragment_shader_file_);
+			PrintProgramLog(pending_.program);
+			DeleteBuild(pending_);
+			// A reload that fails keeps the program that was working
+			failed_ = program_id_ == 0;
+			return -1;
 		}
-		vertex_shader_id_ = AddSource(vertex_shader_file_name, GL_VERTEX_SHADER);
-		if (GL_FALSE == vertex_shader_id_) {
-			abort();
-		};
-		fragment_shader_id_ = AddSource(fragment_shader_file_name, GL_FRAGMENT_SHADER);
-		if (GL_FALSE == fragment_shader_id_) {
-			abort();
-		};
-		vertex_shader_file_ = vertex_shader_file_name;
-		fragment_shader_file_ = fragment_shader_file_name;
-		glLinkProgram(program_id_);
-		// Do not delete shaders after linking, this is legal but 
-		//	they can be used to recover state when hotloading new shaders.
-		// This may change in the future if too complex in favor of creating
-		//	new programs on hot reload
-		
-	}
-	
-	// Reloads shader programs from source files.
-	// Called when source files are modified.
-	// Will recover on failure to compile/link.
+		if (!pending_.from_cache) {
+			SaveBinary(pending_.program, pending_.cache_key);
+		}
+		if (program_id_) {
+			glDeleteProgram(program_id_);
+		}
+		program_id_ = pending_.program;
+		from_cache_ = pending_.from_cache;
+		failed_ = false;
+		// The linked program doesn't need its shaders anymore
+		pending_.program = 0;
+		DeleteBuild(pending_);
+		return 0;
+	}
+
+	void Shader::DeleteBuild(Build& build) {
+		if (build.vertex_shader) {
+			glDeleteShader(build.vertex_shader);
+		}
+		if (build.fragment_shader) {
+			glDeleteShader(build.fragment_shader);
+		}
+		if (build.program) {
+			glDeleteProgram(build.program);
+		}
+		build = Build();
+	}
+
+	bool Shader::IsReady() {
+		if (pending_.program && IsBuildDone()) {
+			FinishBuild();
+		}
+		return program_id_ != 0;
+	}
+
+	int Shader::Wait() {
+		if (pending_.program) {
+			FinishBuild();
+		}
+		return program_id_ != 0 ? 0 : -1;
+	}
+
 	int Shader::Reload() {
-		// Remove current shaders
-		DetachSource(GL_VERTEX_SHADER);
-		DetachSource(GL_FRAGMENT_SHADER);
-
-		// Add new shaders to program
-		GLuint temp_vertex_shader_id = AddSource(vertex_shader_file_.c_str(), GL_VERTEX_SHADER);
-		if (GL_FALSE == temp_vertex_shader_id) {
-			glDetachShader(program_id_, temp_vertex_shader_id);
-			glDeleteShader(temp_vertex_shader_id);
-			Recover();
-			return -1;
+		if (pending_.program) {
+			DeleteBuild(pending_);
 		}
-		GLuint temp_fragment_shader_id = AddSource(fragment_shader_file_.c_str(), GL_FRAGMENT_SHADER);
-		if (GL_FALSE == temp_fragment_shader_id) {
-			glDetachShader(program_id_, temp_vertex_shader_id);
-			glDeleteShader(temp_vertex_shader_id);
-			glDeleteShader(temp_fragment_shader_id);
-			Recover();
+		if (StartBuild() != 0) {
+			DeleteBuild(pending_);
+			failed_ = program_id_ == 0;
 			return -1;
 		}
+		return 0;
+	}
 
-		// Attempt to link
-		glLinkProgram(program_id_);
+	// #defines have to come after #version, #line keeps the line numbers in compile errors those of the file
+	void Shader::InsertDefines(std::string& source) const {
+		if (defines_.empty()) {
+			return;
+		}
+		size_t version_end = source.find('\n');
+		if (version_end == std::string::npos) {
+			version_end = source.size();
+		}
+		source.insert(version_end, "\n" + defines_ + "#line 2");
+	}
 
-		// Check for success
+	GLuint Shader::CompileSource(const std::string& source, GLenum type) {
+		const char* shader_code = source.c_str();
+		GLuint shader_id = glCreateShader(type);
+		glShaderSource(shader_id, 1, &shader_code, NULL);
+		glCompileShader(shader_id);
+		return shader_id;
+	}
+
+	void Shader::PrintShaderLog(GLuint shader, const std::string& file_name) {
+		GLint is_compiled = GL_FALSE;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &is_compiled);
+		if (is_compiled == GL_TRUE) {
+			return;
+		}
+		GLint log_len = 0;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_len);
+		std::string error_log(std::max(log_len, 1), '\0');
+		glGetShaderInfoLog(shader, log_len, &log_len, &error_log[0]);
+		std::cout << "Shader \"" << file_name << "\" failed to compile." << std::endl;
+		std::cout << error_log << std::endl;
+	}
+
+	void Shader::PrintProgramLog(GLuint program) {
+		GLint log_length = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_length);
+		std::string info_log(std::max(log_length, 1), '\0');
+		glGetProgramInfoLog(program, log_length, NULL, &info_log[0]);
+		std::cout << "Shader program failed to link." << std::endl;
+		std::cout << info_log << std::endl;
+	}
+
+	// Binaries only load on the driver that made them, so the driver is part of the key
+	u64 Shader::CacheKey(const std::string& vertex_source, const std::string& fragment_source) {
+		u64 key = HashBytes(vertex_source.data(), vertex_source.size());
+		key = HashBytes(fragment_source.data(), fragment_source.size(), key);
+		const GLenum driver_strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+		for (GLenum name : driver_strings) {
+			const char* value = (const char*)glGetString(name);
+			if (value) {
+				key = HashBytes(value, strlen(value), key);
+			}
+		}
+		return key;
+	}
+
+	std::string Shader::CachePath(u64 cache_key) {
+		std::ostringstream file_name;
+		file_name << std::hex << cache_key << ".bin";
+		return (std::filesystem::path(CACHE_DIRECTORY) / file_name.str()).string();
+	}
+
+	bool Shader::LoadBinary(GLuint program, u64 cache_key) {
+		if (!HasProgramBinary()) {
+			return false;
+		}
+		std::ifstream file(CachePath(cache_key), std::ios::in | std::ios::binary);
+		if (!file.is_open()) {
+			return false;
+		}
+		BinaryHeader header;
+		if (!file.read((char*)&header, sizeof(header)) || header.magic != BINARY_MAGIC || header.cache_key != cache_key) {
+			return false;
+		}
+		std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+		// Drivers reject binaries of other versions, then the program is built from source
 		GLint link_status = GL_FALSE;
-		glGetProgramiv(program_id_, GL_LINK_STATUS, &link_status);
-		if (GL_FALSE == link_status) {
-			GLsizei log_length;
-			glGetProgramiv(program_id_, GL_INFO_LOG_LENGTH, &log_length);
-			GLchar* info_log = new GLchar[log_length];
-			glGetProgramInfoLog(program_id_, log_length, NULL, info_log);
-			std::cout << info_log << std::endl;
-			delete []info_log;
-			// Delete temporary shaders
-			glDeleteShader(temp_vertex_shader_id);
-			glDeleteShader(temp_fragment_shader_id);
-
-			Recover();
-			return -1;
+		glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+		return link_status == GL_TRUE;
+	}
+
+	void Shader::SaveBinary(GLuint program, u64 cache_key) {
+		if (!HasProgramBinary()) {
+			return;
+		}
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0) {
+			return;
 		}
-		else { // Successful link
-			// Delete old shaders
-			glDeleteShader(vertex_shader_id_);
-			glDeleteShader(fragment_shader_id_);
+		std::vector<char> binary(length);
+		GLenum format = 0;
+		glGetProgramBinary(program, length, &length, &format, binary.data());
 
-			// Overwrite old shader ids
-			vertex_shader_id_ = temp_vertex_shader_id;
-			fragment_shader_id_ = temp_fragment_shader_id;
+		std::error_code error;
+		std::filesystem::create_directories(CACHE_DIRECTORY, error);
+		std::ofstream file(CachePath(cache_key), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (error || !file.is_open()) {
+			std::cout << "Can't write the shader cache to " << CACHE_DIRECTORY << std::endl;
+			return;
 		}
-		return 0;
+		BinaryHeader header = { BINARY_MAGIC, format, cache_key };
+		file.write((const char*)&header, sizeof(header));
+		file.write(binary.data(), length);
 	}
+
 	int Shader::Enable() {
 		glUseProgram(program_id_);
 		return 0;
@@ -181,40 +300,80 @@ namespace raytrace {
 		return 0;
 	}
 	int Shader::Delete() {
-		glDeleteShader(vertex_shader_id_);
-		glDeleteShader(fragment_shader_id_);
+		DeleteBuild(pending_);
 		glDeleteProgram(program_id_);
-		vertex_shader_id_ = 0;
-		fragment_shader_id_ = 0;
 		program_id_ = 0;
 		return 0;
 	}
-	int Shader::Recover() {
-		// Detach bad sources
-		DetachSource(GL_VERTEX_SHADER);
-		DetachSource(GL_FRAGMENT_SHADER);
 
-		// Re-Attach known good shaders
-		glAttachShader(program_id_, vertex_shader_id_);
-		glAttachShader(program_id_, fragment_shader_id_);
+	std::string ShaderSignature::Defines() const {
+		std::ostringstream defines;
+		if (num_spheres != ANY) {
+			defines << "#define NUM_SPHERES " << num_spheres << "\n";
+		}
+		if (num_lights != ANY) {
+			defines << "#define NUM_LIGHTS " << num_lights << "\n";
+		}
+		if (max_bounces != ANY) {
+			defines << "#define MAX_BOUNCES " << max_bounces << "\n";
+		}
+		defines << "#define HAS_AMBIENT_LIGHTS " << (ambient_lights ? "true" : "false") << "\n";
+		defines << "#define HAS_POINT_LIGHTS " << (point_lights ? "true" : "false") << "\n";
+		defines << "#define HAS_DIRECTIONAL_LIGHTS " << (directional_lights ? "true" : "false") << "\n";
+		defines << "#define HAS_SPECULAR " << (specular ? "true" : "false") << "\n";
+		return defines.str();
+	}
+	bool ShaderSignature::operator<(const ShaderSignature& other) const {
+		return std::tie(num_spheres, num_lights, ambient_lights, point_lights, directional_lights, max_bounces, specular) <
+			std::tie(other.num_spheres, other.num_lights, other.ambient_lights, other.point_lights, other.directional_lights, other.max_bounces, other.specular);
+	}
 
-		// ?Recover Uniforms?
+	ShaderVariants::ShaderVariants(const char* vertex_shader_file_name, const char* fragment_shader_file_name, void (*setup)(Shader&)) {
+		vertex_shader_file_ = vertex_shader_file_name;
+		fragment_shader_file_ = fragment_shader_file_name;
+		setup_ = setup;
+		generic_.shader = std::make_unique<Shader>(vertex_shader_file_name, fragment_shader_file_name);
+	}
 
-		// Re-Link
-		glLinkProgram(program_id_);
-		// Check for success
-		GLint link_status = GL_FALSE;
-		glGetProgramiv(program_id_, GL_LINK_STATUS, &link_status);
-		if (GL_FALSE == link_status) {
-			GLsizei log_length;
-			glGetProgramiv(program_id_, GL_INFO_LOG_LENGTH, &log_length);
-			GLchar* info_log = new GLchar[log_length];
-			glGetProgramInfoLog(program_id_, log_length, NULL, info_log);
-			std::cout << info_log << std::endl;
-			delete []info_log;
+	Shader* ShaderVariants::ReadyShader(Variant& variant) {
+		if (!variant.shader->IsReady()) {
+			return nullptr;
 		}
-		return 0;
+		// Also runs again after a reload swapped in a new program
+		if (variant.shader->GetProgramID() != variant.setup_program) {
+			setup_(*variant.shader);
+			variant.setup_program = variant.shader->GetProgramID();
+		}
+		return variant.shader.get();
+	}
+
+	Shader* ShaderVariants::Get(const ShaderSignature& signature) {
+		Shader* generic = ReadyShader(generic_);
+		auto found = variants_.find(signature);
+		if (found == variants_.end()) {
+			if ((int)variants_.size() >= MAX_VARIANTS) {
+				return generic;
+			}
+			Variant variant;
+			variant.shader = std::make_unique<Shader>(vertex_shader_file_.c_str(), fragment_shader_file_.c_str(), signature.Defines());
+			found = variants_.emplace(signature, std::move(variant)).first;
+		}
+		Shader* specialized = ReadyShader(found->second);
+		return specialized ? specialized : generic;
+	}
 
+	void ShaderVariants::Reload() {
+		generic_.shader->Reload();
+		for (auto& variant : variants_) {
+			variant.second.shader->Reload();
+		}
 	}
 
-}
\ No newline at end of file
+	void ShaderVariants::Delete() {
+		generic_.shader->Delete();
+		for (auto& variant : variants_) {
+			variant.second.shader->Delete();
+		}
+		variants_.clear();
+	}
+}
@@ -2,36 +2,128 @@
 #define	RAYTRACE_SHADER_H_
 
 #include <fstream>
+#include <map>
+#include <memory>
 #include <string>
 
 #include "GL/glew.h"
 
+#include "types.h"
+
 namespace raytrace {
 
-std::string readFile(const char* fileName);
+// Reads a shader from SHADER_DIRECTORY, falls back to the copy built into the executable.
+// Returns -1 if neither exists.
+int ReadShaderSource(const std::string& file_name, std::string& source);
+
 class Shader {
 public:
-	
-	Shader(const char* vertex_shader_file_name, const char* fragment_shader_file_name);
+	static inline const char* SHADER_DIRECTORY = "src\\shaders\\";
+	// Linked programs are saved here and loaded instead of compiling when the sources and driver are the same
+	static inline const char* CACHE_DIRECTORY = "shader_cache";
+
+	// Starts building the program, from the binary cache when possible. Drivers with parallel shader compile
+	// keep compiling and linking in the background, IsReady tells when the program can be used.
+	// defines are #define lines inserted after the #version line of both shaders.
+	Shader(const char* vertex_shader_file_name, const char* fragment_shader_file_name, const std::string& defines = "");
 	int Enable();
 	int Disable();
+	// Starts building the program again from the shader files, the current program stays in use until
+	// the new one is linked and is kept if the new one fails. Uniforms have to be set up again once
+	// GetProgramID changes.
 	int Reload();
 	int Delete();
+	// Never blocks while the driver compiles in the background, swaps in a reloaded program once it is linked
+	bool IsReady();
+	// Blocks until the build is done, returns -1 if there is no usable program
+	int Wait();
+	// No usable program, the sources were missing or didn't compile or link
+	bool HasFailed() const { return failed_; };
+	// Whether the program in use came from the binary cache
+	bool IsFromCache() const { return from_cache_; };
 	constexpr GLuint GetProgramID() const { return program_id_; };
 
 private:
-	GLuint AddSource(std::string shader_source, GLenum type);
-	int DetachSource(GLenum type);
-	int Recover();
-	GLuint program_id_ = 0;
+	// A program being compiled and linked, or loaded from the cache
+	struct Build {
+		GLuint program = 0;
+		GLuint vertex_shader = 0;
+		GLuint fragment_shader = 0;
+		u64 cache_key = 0;
+		bool from_cache = false;
+	};
+	int StartBuild();
+	bool IsBuildDone() const;
+	void InsertDefines(std::string& source) const;
+	// Checks the result of pending_ and makes it the program in use if it linked
+	int FinishBuild();
+	void DeleteBuild(Build& build);
+	static GLuint CompileSource(const std::string& source, GLenum type);
+	static void PrintShaderLog(GLuint shader, const std::string& file_name);
+	static void PrintProgramLog(GLuint program);
+	static u64 CacheKey(const std::string& vertex_source, const std::string& fragment_source);
+	static std::string CachePath(u64 cache_key);
+	static bool LoadBinary(GLuint program, u64 cache_key);
+	static void SaveBinary(GLuint program, u64 cache_key);
 
-	// vertex_shader_id_ and fragment_shader_id_ are used to 
-	// recover state if the modified shader source code fails to compile or link
-	GLuint vertex_shader_id_ = 0, fragment_shader_id_ = 0;
+	GLuint program_id_ = 0;
+	bool from_cache_ = false;
+	bool failed_ = false;
+	Build pending_;
 
 	std::string vertex_shader_file_ = "";
 	std::string fragment_shader_file_ = "";
+	std::string defines_ = "";
+
+};
+
+// What a specialized program is built for. Each field becomes a #define in front of the shaders, so the
+// GLSL compiler can unroll the sphere, light and bounce loops and drop the branches nothing in the scene uses.
+struct ShaderSignature {
+	static const int ANY = -1; // Read from the uniforms at runtime
+	int num_spheres = ANY;
+	int num_lights = ANY;
+	bool ambient_lights = true;
+	bool point_lights = true;
+	bool directional_lights = true;
+	int max_bounces = ANY;
+	bool specular = true; // Some sphere has a specular exponent
+
+	std::string Defines() const;
+	bool operator<(const ShaderSignature& other) const;
+};
+
+// Programs built from the same shader files for different ShaderSignatures, next to the generic program
+// every signature falls back to. A variant starts building the first time it is asked for.
+class ShaderVariants {
+public:
+	// Drawing with the generic program while a few bounce counts and scenes are tried is fine, an unbounded
+	// number of programs isn't
+	static const int MAX_VARIANTS = 32;
+
+	// setup is called for every program once it is linked, before it is first returned
+	ShaderVariants(const char* vertex_shader_file_name, const char* fragment_shader_file_name, void (*setup)(Shader&));
+	// The program specialized for signature once it is ready, until then or if it failed the generic program.
+	// nullptr while the generic program isn't ready either.
+	Shader* Get(const ShaderSignature& signature);
+	Shader& GetGeneric() { return *generic_.shader; };
+	int GetVariantCount() const { return (int)variants_.size(); };
+	// Starts rebuilding every program from the shader files, see Shader::Reload
+	void Reload();
+	void Delete();
+
+private:
+	struct Variant {
+		std::unique_ptr<Shader> shader;
+		GLuint setup_program = 0; // Program setup_ last ran for
+	};
+	Shader* ReadyShader(Variant& variant);
 
+	std::string vertex_shader_file_;
+	std::string fragment_shader_file_;
+	void (*setup_)(Shader&);
+	Variant generic_;
+	std::map<ShaderSignature, Variant> variants_;
 };
 } // namespace opengl_imp_1
 #endif // RAYTRACE_SHADER_H_
@@ -5,7 +5,31 @@ uniform float u_Time;
 uniform mat4 u_Camera_Rotation_Matrix_X;
 uniform mat4 u_Camera_Rotation_Matrix_Y;
 uniform vec4 u_Camera_Position;
-
+uniform int u_Max_Bounces; // Reflections followed after the first hit
+
+// Scene constants. A program specialized for a scene gets them as #defines from ShaderSignature,
+// the generic program reads the counts and bounces at runtime and handles every kind of light.
+#ifndef NUM_SPHERES
+#define NUM_SPHERES num_spheres
+#endif
+#ifndef NUM_LIGHTS
+#define NUM_LIGHTS num_lights
+#endif
+#ifndef MAX_BOUNCES
+#define MAX_BOUNCES u_Max_Bounces
+#endif
+#ifndef HAS_AMBIENT_LIGHTS
+#define HAS_AMBIENT_LIGHTS true
+#endif
+#ifndef HAS_POINT_LIGHTS
+#define HAS_POINT_LIGHTS true
+#endif
+#ifndef HAS_DIRECTIONAL_LIGHTS
+#define HAS_DIRECTIONAL_LIGHTS true
+#endif
+#ifndef HAS_SPECULAR
+#define HAS_SPECULAR true
+#endif
 
 in vec3 posColor;
 // ================================================================================
@@ -71,7 +95,7 @@ void ClosestIntersection(vec3 ray_origin, vec3 direction, float t_min, float t_m
 	float closest_t = FLT_MAX;
 	Sphere closest_sphere = NULL_SPHERE;
 
-	for (int i = 0; i < num_spheres; i++){
+	for (int i = 0; i < NUM_SPHERES; i++){
 		vec2 intersects = IntersectRaySphere(ray_origin, direction, spheres_[i]);
 
 		// Check for closer intersections 
@@ -87,28 +111,39 @@ void ClosestIntersection(vec3 ray_origin, vec3 direction, float t_min, float t_m
 	out_closest_sphere = closest_sphere;
 	out_closest_t = closest_t;
 }
+// Any-hit version of ClosestIntersection for shadow rays, returns at the first sphere within (t_min, t_max)
+bool Occluded(vec3 ray_origin, vec3 direction, float t_min, float t_max){
+	for (int i = 0; i < NUM_SPHERES; i++){
+		vec2 intersects = IntersectRaySphere(ray_origin, direction, spheres_[i]);
+		if (((intersects.x > t_min) && (intersects.x < t_max)) || ((intersects.y > t_min) && (intersects.y < t_max))) {
+			return true;
+		}
+	}
+	return false;
+}
 // s is specular
 float ComputeLighting(vec3 point, vec3 normal, vec3 vec_to_camera, int s){
 	float intensity = 0.0f;
-	for (int i = 0; i < num_lights; i++){
+	for (int i = 0; i < NUM_LIGHTS; i++){
 		Light light = lights_[i];
-		if(light.type == 0){ // Ambient
+		// The HAS_ flags are constants, branches for lights the scene doesn't have are compiled out
+		if(HAS_AMBIENT_LIGHTS && light.type == 0){ // Ambient
 			intensity += light.intensity;
 		}
-		else{
+		else if (HAS_POINT_LIGHTS || HAS_DIRECTIONAL_LIGHTS){
 			vec3 light_vec;
-			if (light.type == 1){ // point
+			float t_max;
+			if (HAS_POINT_LIGHTS && (!HAS_DIRECTIONAL_LIGHTS || light.type == 1)){ // point
 				light_vec = Vec3FromVec4(light.position) - point;
+				t_max = 1.0f; // light_vec ends on the light, spheres behind it don't cast shadows
 			}
 			else{ // directional
 				light_vec = Vec3FromVec4(light.direction);
+				t_max = FLT_MAX;
 			}
 
 			// Check for shadow
-			float closest_t = FLT_MAX;
-			Sphere closest_sphere = NULL_SPHERE;
-			ClosestIntersection(point,light_vec,0.01f,FLT_MAX,closest_t,closest_sphere);
-			if (closest_sphere.center.w != 0){ // Hit another sphere, obscured
+			if (Occluded(point,light_vec,0.01f,t_max)){
 				continue;
 			}
 
@@ -119,7 +154,7 @@ float ComputeLighting(vec3 point, vec3 normal, vec3 vec_to_camera, int s){
 			}
 
 			// Specular
-			if (s != -1) {
+			if (HAS_SPECULAR && s != -1) {
 				vec3 reflection = ReflectRay(light_vec, normal);
 				float r_dot_v = dot(reflection,vec_to_camera);
 				
@@ -133,30 +168,11 @@ float ComputeLighting(vec3 point, vec3 normal, vec3 vec_to_camera, int s){
 	}
 	return intensity;
 
-}
-vec3 TraceRay(vec3 ray_origin, vec3 direction, float t_min, float t_max, int recursion_depth, out bool hit, out vec3 hit_point, out Sphere hit_sphere){
-	float closest_t = FLT_MAX;
-	Sphere closest_sphere = NULL_SPHERE;
-
-	ClosestIntersection(ray_origin,direction,t_min,t_max,closest_t,closest_sphere);
-	if (closest_sphere.center.w == 0){ // Got NULL_SPHERE, no hits
-		hit = false;
-		hit_sphere = NULL_SPHERE;
-		return BACKGROUND_COLOR;
-	}
-	hit = true;
-	vec3 point = ray_origin + direction * closest_t;
-	hit_point = point;
-	hit_sphere = closest_sphere;
-	vec3 point_normal = point - Vec3FromVec4(closest_sphere.center);
-	point_normal = point_normal/length(point_normal);
-	vec3 local_color = Vec3FromVec4(closest_sphere.color) * ComputeLighting(point, point_normal, -direction, closest_sphere.specular);
-	return local_color;
-	
 }
 vec2 CoordConversion(){
-	float x = gl_FragCoord.x;
-	float y = gl_FragCoord.y;
+	// gl_FragCoord is the pixel center, the CPU tracer samples the pixel's corner
+	float x = gl_FragCoord.x - 0.5f;
+	float y = gl_FragCoord.y - 0.5f;
 	x -= 250.0f;
 	y -= 250.0f;
 	x/=500.0f;
@@ -165,62 +181,42 @@ vec2 CoordConversion(){
 }
 void main()
 {
-	
 	vec3 origin = Vec3FromVec4(u_Camera_Position);
-	int recursion_depth = 1;
 	float dist_to_canvas = 0.5f;
 	vec3 direction = vec3(CoordConversion(),dist_to_canvas);
 	direction = Vec3FromVec4(vec4(direction,1.0f) * u_Camera_Rotation_Matrix_X * u_Camera_Rotation_Matrix_Y);
-	
-	bool hit = false;
-	vec3 point_hit;
-	Sphere hit_sphere;
 
-	vec3 local_color = TraceRay(origin, direction, 1.0f, FLT_MAX, recursion_depth,hit,point_hit,hit_sphere);
-	if (hit == true) // hit sphere
-	{ 
-		hit = false;
-		if(hit_sphere.reflective <= 0.0f){ // this sphere is not reflective
-			gl_FragColor = vec4(local_color,1.0f);
+	// Same bounce loop as RayTracer::TraceRay. Every hit adds its local color scaled by the throughput,
+	// the light still reaching the camera along the path, and the reflective part carries on to the next hit.
+	vec3 color = vec3(0.0f,0.0f,0.0f);
+	float throughput = 1.0f;
+	float t_min = 1.0f;
+	for (int bounce = 0; bounce <= MAX_BOUNCES; bounce++){
+		float closest_t = FLT_MAX;
+		Sphere closest_sphere = NULL_SPHERE;
+		ClosestIntersection(origin,direction,t_min,FLT_MAX,closest_t,closest_sphere);
+		if (closest_sphere.center.w == 0){ // Got NULL_SPHERE, no hits
+			color += BACKGROUND_COLOR * throughput;
+			break;
 		}
-		else{ // sphere is reflective, so trace reflection
-			vec3 point1_normal = point_hit - Vec3FromVec4(hit_sphere.center);
-			point1_normal = point1_normal/length(point1_normal);
-			vec3 reflected_ray = ReflectRay(-direction,point1_normal);
-			float old_reflective = hit_sphere.reflective;
-			vec3 reflected_color = TraceRay(point_hit, reflected_ray, 0.1f, FLT_MAX, recursion_depth,hit,point_hit,hit_sphere);
-
-			// Update color 
-			vec3 current_color = (local_color * (1.0f - old_reflective)) + reflected_color * old_reflective;
-
-			if (hit == true){ // reflection got hit, so trace reflection
-				hit = false;
-				if(hit_sphere.reflective <= 0.0f){ // sphere is not reflective
-					gl_FragColor = vec4(current_color,1.0f);
-				}
-				else
-				{
-					vec3 point2_normal = point_hit - Vec3FromVec4(hit_sphere.center);
-					point2_normal = point2_normal/length(point2_normal);
-					vec3 reflected_ray2 = ReflectRay(-reflected_ray, point2_normal);
-					float old_reflective2 = hit_sphere.reflective;
-
-					vec3 color3 = TraceRay(point_hit, reflected_ray2, 0.1f, FLT_MAX, recursion_depth,hit,point_hit,hit_sphere);
-					vec3 sub_color = (reflected_color * (1.0f - old_reflective2)) + color3 * old_reflective2;
-					current_color = (local_color * (1.0f - old_reflective)) + sub_color * old_reflective;
-					gl_FragColor = vec4(current_color,1.0f);
-				}
-
-			}
-			else // reflection yeilded no hits
-			{ 
-				gl_FragColor = vec4(current_color,1.0f);
-			}
+		vec3 point = origin + direction * closest_t;
+		vec3 point_normal = point - Vec3FromVec4(closest_sphere.center);
+		point_normal = point_normal/length(point_normal);
+		vec3 local_color = Vec3FromVec4(closest_sphere.color) * ComputeLighting(point, point_normal, -direction, closest_sphere.specular);
+
+		// If out of bounces or sphere is not reflective, exit
+		float r = closest_sphere.reflective;
+		if (bounce >= MAX_BOUNCES || r <= 0.0f){
+			color += local_color * throughput;
+			break;
 		}
+		color += local_color * (throughput * (1.0f - r));
+		throughput *= r;
+
+		// Continue with the reflected ray
+		direction = ReflectRay(-direction,point_normal);
+		origin = point;
+		t_min = 0.1f;
 	}
-	else
-	{
-		gl_FragColor = vec4(local_color,1.0f);
-	}
-	
-}
\ No newline at end of file
+	gl_FragColor = vec4(color,1.0f);
+}
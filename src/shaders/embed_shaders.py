@@ -0,0 +1,50 @@
+# Writes embedded_shaders.h, the copies of the shaders in this directory that are built into the executable.
+# Run it after changing a shader: python embed_shaders.py
+import os
+
+DIRECTORY = os.path.dirname(os.path.abspath(__file__))
+# MSVC limits a single string literal, longer sources are split into adjacent literals
+MAX_PIECE = 8000
+
+def pieces(source):
+    piece = ''
+    for line in source.splitlines(keepends=True):
+        if piece and len(piece) + len(line) > MAX_PIECE:
+            yield piece
+            piece = ''
+        piece += line
+    yield piece
+
+def main():
+    names = sorted(n for n in os.listdir(DIRECTORY) if n.endswith(('.vert', '.frag')))
+    out = [
+        '// Generated by embed_shaders.py from the shaders in this directory, run it again after changing one.',
+        '#pragma once',
+        '#ifndef RAYTRACE_EMBEDDED_SHADERS_H_',
+        '#define\tRAYTRACE_EMBEDDED_SHADERS_H_',
+        '',
+        'namespace raytrace {',
+        '\tstruct EmbeddedShader {',
+        '\t\tconst char* file_name;',
+        '\t\tconst char* source;',
+        '\t};',
+        '\tinline const EmbeddedShader EMBEDDED_SHADERS[] = {',
+    ]
+    for name in names:
+        with open(os.path.join(DIRECTORY, name), newline='') as f:
+            source = f.read().replace('\r\n', '\n')
+        out.append('\t\t{ "%s",' % name)
+        for piece in pieces(source):
+            out.append('R"GLSL(' + piece + ')GLSL"')
+        out.append('\t\t},')
+    out += [
+        '\t};',
+        '} // namespace raytrace',
+        '#endif // RAYTRACE_EMBEDDED_SHADERS_H_',
+        '',
+    ]
+    with open(os.path.join(DIRECTORY, 'embedded_shaders.h'), 'w', newline='\n') as f:
+        f.write('\n'.join(out))
+
+if __name__ == '__main__':
+    main()
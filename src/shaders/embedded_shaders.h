@@ -0,0 +1,492 @@
+// Generated by embed_shaders.py from the shaders in this directory, run it again after changing one.
+#pragma once
+#ifndef RAYTRACE_EMBEDDED_SHADERS_H_
+#define	RAYTRACE_EMBEDDED_SHADERS_H_
+
+namespace raytrace {
+	struct EmbeddedShader {
+		const char* file_name;
+		const char* source;
+	};
+	inline const EmbeddedShader EMBEDDED_SHADERS[] = {
+		{ "default.frag",
+R"GLSL(#version 330 core
+#define FLT_MAX 3.402823466e+38
+
+uniform float u_Time;
+uniform mat4 u_Camera_Rotation_Matrix_X;
+uniform mat4 u_Camera_Rotation_Matrix_Y;
+uniform vec4 u_Camera_Position;
+uniform int u_Max_Bounces; // Reflections followed after the first hit
+
+// Scene constants. A program specialized for a scene gets them as #defines from ShaderSignature,
+// the generic program reads the counts and bounces at runtime and handles every kind of light.
+#ifndef NUM_SPHERES
+#define NUM_SPHERES num_spheres
+#endif
+#ifndef NUM_LIGHTS
+#define NUM_LIGHTS num_lights
+#endif
+#ifndef MAX_BOUNCES
+#define MAX_BOUNCES u_Max_Bounces
+#endif
+#ifndef HAS_AMBIENT_LIGHTS
+#define HAS_AMBIENT_LIGHTS true
+#endif
+#ifndef HAS_POINT_LIGHTS
+#define HAS_POINT_LIGHTS true
+#endif
+#ifndef HAS_DIRECTIONAL_LIGHTS
+#define HAS_DIRECTIONAL_LIGHTS true
+#endif
+#ifndef HAS_SPECULAR
+#define HAS_SPECULAR true
+#endif
+
+in vec3 posColor;
+// ================================================================================
+struct Sphere{ // 44 bytes, padded to 48 to be multiple of vec4
+	vec4 center; // 16 bytes 
+	vec4 color; // 16
+	float radius; // 4
+	int specular; // 4 
+	float reflective; // 4
+};
+struct Light{
+	vec4 position;
+	vec4 direction;
+	int type;
+	float intensity;
+};
+// ================================================================================
+layout (row_major,std140) uniform ubo_Spheres
+{
+	int num_spheres;
+	Sphere spheres_[100]; // starts at offset 16
+};
+layout (row_major,std140) uniform ubo_Lights
+{
+	int num_lights;
+	Light lights_[100]; // starts at offset 16
+};
+// ================================================================================
+const Sphere NULL_SPHERE = Sphere(vec4(0,0,0,0), vec4(1.0f,0.0f,1.0f,1.0f),0.0f, 500, 0.2f);
+const vec3 BACKGROUND_COLOR = vec3(0.0f,0.0f,0.0f);
+// ================================================================================
+vec3 Vec3FromVec4(vec4 val){
+	return vec3(val.x,val.y,val.z);
+}
+vec3 ReflectRay(vec3 ray_to_reflect, vec3 normal_to_reflect_over) {
+	return normal_to_reflect_over * (2.0f * dot(normal_to_reflect_over,ray_to_reflect)) - ray_to_reflect;
+}
+vec2 IntersectRaySphere(vec3 ray_origin, vec3 direction, Sphere sphere){
+	float r = sphere.radius;
+	vec3 CO = ray_origin - Vec3FromVec4(sphere.center);
+
+	// Set up quadratic formula
+	float a = dot(direction, direction);
+	float b = 2 * dot(CO, direction);
+	float c = dot(CO,CO) - r * r;
+
+	// The discriminant determines how many solutions to the sphere intersection there are
+	// discriminat > 0, two real roots
+	// discriminant == 0, one repeated root
+	// discrimant < 0, no real roots
+	float discriminant = b * b - 4 * a * c;
+	if (discriminant < 0) {
+		return vec2(FLT_MAX, FLT_MAX);
+	}
+	// Solve quadratic equation
+	float t1 = (-b + sqrt(discriminant)) / (2 * a);
+	float t2 = (-b - sqrt(discriminant)) / (2 * a);
+
+	return vec2(t1, t2);
+}
+// ================================================================================
+void ClosestIntersection(vec3 ray_origin, vec3 direction, float t_min, float t_max, out float out_closest_t, out Sphere out_closest_sphere){
+	float closest_t = FLT_MAX;
+	Sphere closest_sphere = NULL_SPHERE;
+
+	for (int i = 0; i < NUM_SPHERES; i++){
+		vec2 intersects = IntersectRaySphere(ray_origin, direction, spheres_[i]);
+
+		// Check for closer intersections 
+		if (((intersects.x > t_min) && (intersects.x < t_max)) && intersects.x < closest_t) {
+			closest_t = intersects.x;
+			closest_sphere = spheres_[i];
+		}
+		if (((intersects.y > t_min) && (intersects.y < t_max)) && intersects.y < closest_t) {
+			closest_t = intersects.y;
+			closest_sphere = spheres_[i];
+		}
+	}
+	out_closest_sphere = closest_sphere;
+	out_closest_t = closest_t;
+}
+// Any-hit version of ClosestIntersection for shadow rays, returns at the first sphere within (t_min, t_max)
+bool Occluded(vec3 ray_origin, vec3 direction, float t_min, float t_max){
+	for (int i = 0; i < NUM_SPHERES; i++){
+		vec2 intersects = IntersectRaySphere(ray_origin, direction, spheres_[i]);
+		if (((intersects.x > t_min) && (intersects.x < t_max)) || ((intersects.y > t_min) && (intersects.y < t_max))) {
+			return true;
+		}
+	}
+	return false;
+}
+// s is specular
+float ComputeLighting(vec3 point, vec3 normal, vec3 vec_to_camera, int s){
+	float intensity = 0.0f;
+	for (int i = 0; i < NUM_LIGHTS; i++){
+		Light light = lights_[i];
+		// The HAS_ flags are constants, branches for lights the scene doesn't have are compiled out
+		if(HAS_AMBIENT_LIGHTS && light.type == 0){ // Ambient
+			intensity += light.intensity;
+		}
+		else if (HAS_POINT_LIGHTS || HAS_DIRECTIONAL_LIGHTS){
+			vec3 light_vec;
+			float t_max;
+			if (HAS_POINT_LIGHTS && (!HAS_DIRECTIONAL_LIGHTS || light.type == 1)){ // point
+				light_vec = Vec3FromVec4(light.position) - point;
+				t_max = 1.0f; // light_vec ends on the light, spheres behind it don't cast shadows
+			}
+			else{ // directional
+				light_vec = Vec3FromVec4(light.direction);
+				t_max = FLT_MAX;
+			}
+
+			// Check for shadow
+			if (Occluded(point,light_vec,0.01f,t_max)){
+				continue;
+			}
+
+			// Diffuse
+			float n_dot_l = dot(normal,light_vec);
+			if (n_dot_l > 0.0f){
+				intensity += light.intensity * n_dot_l / (length(normal)*length(light_vec));
+			}
+
+			// Specular
+			if (HAS_SPECULAR && s != -1) {
+				vec3 reflection = ReflectRay(light_vec, normal);
+				float r_dot_v = dot(reflection,vec_to_camera);
+				
+				// Reflection is facing the camera.
+				// angle between reflection and camera is less than 90 degrees
+				if (r_dot_v > 0.05f) { 
+					intensity += light.intensity * pow(r_dot_v / (length(reflection) * length(vec_to_camera)), s);
+				}
+			}
+		}
+	}
+	return intensity;
+
+}
+vec2 CoordConversion(){
+	// gl_FragCoord is the pixel center, the CPU tracer samples the pixel's corner
+	float x = gl_FragCoord.x - 0.5f;
+	float y = gl_FragCoord.y - 0.5f;
+	x -= 250.0f;
+	y -= 250.0f;
+	x/=500.0f;
+	y/=500.0f;
+	return vec2(x,y);
+}
+void main()
+{
+	vec3 origin = Vec3FromVec4(u_Camera_Position);
+	float dist_to_canvas = 0.5f;
+	vec3 direction = vec3(CoordConversion(),dist_to_canvas);
+	direction = Vec3FromVec4(vec4(direction,1.0f) * u_Camera_Rotation_Matrix_X * u_Camera_Rotation_Matrix_Y);
+
+	// Same bounce loop as RayTracer::TraceRay. Every hit adds its local color scaled by the throughput,
+	// the light still reaching the camera along the path, and the reflective part carries on to the next hit.
+	vec3 color = vec3(0.0f,0.0f,0.0f);
+	float throughput = 1.0f;
+	float t_min = 1.0f;
+	for (int bounce = 0; bounce <= MAX_BOUNCES; bounce++){
+		float closest_t = FLT_MAX;
+		Sphere closest_sphere = NULL_SPHERE;
+		ClosestIntersection(origin,direction,t_min,FLT_MAX,closest_t,closest_sphere);
+		if (closest_sphere.center.w == 0){ // Got NULL_SPHERE, no hits
+			color += BACKGROUND_COLOR * throughput;
+			break;
+		}
+		vec3 point = origin + direction * closest_t;
+		vec3 point_normal = point - Vec3FromVec4(closest_sphere.center);
+		point_normal = point_normal/length(point_normal);
+		vec3 local_color = Vec3FromVec4(closest_sphere.color) * ComputeLighting(point, point_normal, -direction, closest_sphere.specular);
+
+		// If out of bounces or sphere is not reflective, exit
+		float r = closest_sphere.reflective;
+		if (bounce >= MAX_BOUNCES || r <= 0.0f){
+			color += local_color * throughput;
+			break;
+		}
+		color += local_color * (throughput * (1.0f - r));
+		throughput *= r;
+
+		// Continue with the reflected ray
+		direction = ReflectRay(-direction,point_normal);
+		origin = point;
+		t_min = 0.1f;
+	}
+	gl_FragColor = vec4(color,1.0f);
+}
+)GLSL"
+		},
+		{ "default.vert",
+R"GLSL(#version 330 core
+
+uniform float u_Time;
+
+in vec3 in_position;
+out vec3 posColor;
+void main()
+{
+	gl_Position = vec4(in_position,1.0f);
+	posColor = in_position;
+})GLSL"
+		},
+		{ "texture_buffer.frag",
+R"GLSL(#version 330 core
+#define FLT_MAX 3.402823466e+38
+
+uniform float u_Time;
+uniform mat4 u_Camera_Rotation_Matrix_X;
+uniform mat4 u_Camera_Rotation_Matrix_Y;
+uniform vec4 u_Camera_Position;
+uniform int u_Max_Bounces; // Reflections followed after the first hit
+
+
+in vec3 posColor;
+// ================================================================================
+// Same scene as default.frag, but read from buffer textures without a size limit. See TextureBufferScene.
+uniform samplerBuffer u_Sphere_Geometry; // center.xyz, radius. In BVH leaf order
+uniform samplerBuffer u_Sphere_Materials; // r * 65536 + g * 256 + b, specular, reflective
+uniform usamplerBuffer u_Bvh_Nodes; // 2 texels per node, depth first
+uniform samplerBuffer u_Lights; // 2 texels per light
+uniform int u_Num_Nodes;
+uniform int u_Num_Lights;
+// ================================================================================
+struct Material{
+	vec3 color;
+	int specular;
+	float reflective;
+};
+struct Light{
+	vec3 position;
+	vec3 direction;
+	int type;
+	float intensity;
+};
+// ================================================================================
+const vec3 BACKGROUND_COLOR = vec3(0.0f,0.0f,0.0f);
+// ================================================================================
+Material FetchMaterial(int sphere){
+	vec4 texel = texelFetch(u_Sphere_Materials, sphere);
+	uint packed_color = uint(texel.x);
+	vec3 color = vec3(float((packed_color >> 16) & 255u), float((packed_color >> 8) & 255u), float(packed_color & 255u)) / 255.0f;
+	return Material(color, int(texel.y), texel.z);
+}
+Light FetchLight(int light){
+	vec4 position = texelFetch(u_Lights, light * 2);
+	vec4 direction = texelFetch(u_Lights, light * 2 + 1);
+	return Light(position.xyz, direction.xyz, int(direction.w), position.w);
+}
+vec3 ReflectRay(vec3 ray_to_reflect, vec3 normal_to_reflect_over) {
+	return normal_to_reflect_over * (2.0f * dot(normal_to_reflect_over,ray_to_reflect)) - ray_to_reflect;
+}
+// sphere is center.xyz, radius
+vec2 IntersectRaySphere(vec3 ray_origin, vec3 direction, vec4 sphere){
+	float r = sphere.w;
+	vec3 CO = ray_origin - sphere.xyz;
+
+	float a = dot(direction, direction);
+	float b = 2 * dot(CO, direction);
+	float c = dot(CO,CO) - r * r;
+
+	float discriminant = b * b - 4 * a * c;
+	if (discriminant < 0) {
+		return vec2(FLT_MAX, FLT_MAX);
+	}
+	float t1 = (-b + sqrt(discriminant)) / (2 * a);
+	float t2 = (-b - sqrt(discriminant)) / (2 * a);
+
+	return vec2(t1, t2);
+}
+bool HitsBounds(vec3 ray_origin, vec3 inv_direction, float t_min, float t_max, vec3 bounds_min, vec3 bounds_max){
+	vec3 t0 = (bounds_min - ray_origin) * inv_direction;
+	vec3 t1 = (bounds_max - ray_origin) * inv_direction;
+	vec3 t_near = min(t0, t1);
+	vec3 t_far = max(t0, t1);
+	t_min = max(t_min, max(t_near.x, max(t_near.y, t_near.z)));
+	t_max = min(t_max, min(t_far.x, min(t_far.y, t_far.z)));
+	return t_min <= t_max;
+}
+// ================================================================================
+// Walks the BVH in depth first order. A node whose bounds are hit continues with the next node,
+// its first child or the node after a leaf, a missed node jumps past its subtree.
+// Returns the closest sphere within (t_min, t_max) or -1.
+int ClosestIntersection(vec3 ray_origin, vec3 direction, float t_min, float t_max, out float out_closest_t){
+	float closest_t = FLT_MAX;
+	int closest_sphere = -1;
+	vec3 inv_direction = 1.0f / direction;
+
+	int node = 0;
+	while (node < u_Num_Nodes){
+		uvec4 low = texelFetch(u_Bvh_Nodes, node * 2);
+		uvec4 high = texelFetch(u_Bvh_Nodes, node * 2 + 1);
+		if (!HitsBounds(ray_origin, inv_direction, t_min, min(t_max, closest_t), uintBitsToFloat(low.xyz), uintBitsToFloat(high.xyz))){
+			node = int(low.w);
+			continue;
+		}
+		if (high.w != 0u){ // Leaf
+			int first = int(high.w >> 8);
+			int count = int(high.w & 255u);
+			for (int i = first; i < first + count; i++){
+				vec2 intersects = IntersectRaySphere(ray_origin, direction, texelFetch(u_Sphere_Geometry, i));
+
+				// Check for closer intersections
+				if (((intersects.x > t_min) && (intersects.x < t_max)) && intersects.x < closest_t) {
+					closest_t = intersects.x;
+					closest_sphere = i;
+				}
+				if (((intersects.y > t_min) && (intersects.y < t_max)) && intersects.y < closest_t) {
+					closest_t = intersects.y;
+					closest_sphere = i;
+				}
+			}
+		}
+		node++;
+	}
+	out_closest_t = closest_t;
+	return closest_sphere;
+}
+// Any-hit version of ClosestIntersection for shadow rays, returns at the first sphere within (t_min, t_max)
+bool Occluded(vec3 ray_origin, vec3 direction, float t_min, float t_max){
+	vec3 inv_direction = 1.0f / direction;
+	int node = 0;
+	while (node < u_Num_Nodes){
+		uvec4 low = texelFetch(u_Bvh_Nodes, node * 2);
+		uvec4 high = texelFetch(u_Bvh_Nodes, node * 2 + 1);
+		if (!HitsBounds(ray_origin, inv_direction, t_min, t_max, uintBitsToFloat(low.xyz), uintBitsToFloat(high.xyz))){
+			node = int(low.w);
+			continue;
+		}
+		if (high.w != 0u){
+			int first = int(high.w >> 8);
+			int count = int(high.w & 255u);
+			for (int i = first; i < first + count; i++){
+				vec2 intersects = IntersectRaySphere(ray_origin, direction, texelFetch(u_Sphere_Geometry, i));
+				if (((intersects.x > t_min) && (intersects.x < t_max)) || ((intersects.y > t_min) && (intersects.y < t_max))) {
+					return true;
+				}
+			}
+		}
+		node++;
+	}
+	return false;
+}
+// s is specular
+float ComputeLighting(vec3 point, vec3 normal, vec3 vec_to_camera, int s){
+	float intensity = 0.0f;
+	for (int i = 0; i < u_Num_Lights; i++){
+		Light light = FetchLight(i);
+		if(light.type == 0){ // Ambient
+			intensity += light.intensity;
+		}
+		else{
+			vec3 light_vec;
+			float t_max;
+			if (light.type == 1){ // point
+				light_vec = light.position - point;
+				t_max = 1.0f; // light_vec ends on the light, spheres behind it don't cast shadows
+			}
+			else{ // directional
+				light_vec = light.direction;
+				t_max = FLT_MAX;
+			}
+
+			// Check for shadow
+			if (Occluded(point,light_vec,0.01f,t_max)){
+				continue;
+			}
+
+			// Diffuse
+			float n_dot_l = dot(normal,light_vec);
+			if (n_dot_l > 0.0f){
+				intensity += light.intensity * n_dot_l / (length(normal)*length(light_vec));
+			}
+
+			// Specular
+			if (s != -1) {
+				vec3 reflection = ReflectRay(light_vec, normal);
+				float r_dot_v = dot(reflection,vec_to_camera);
+
+				// Reflection is facing the camera.
+				// angle between reflection and camera is less than 90 degrees
+				if (r_dot_v > 0.05f) {
+					intensity += light.intensity * pow(r_dot_v / (length(reflection) * length(vec_to_camera)), s);
+				}
+			}
+		}
+	}
+	return intensity;
+
+}
+vec2 CoordConversion(){
+	// gl_FragCoord is the pixel center, the CPU tracer samples the pixel's corner
+	float x = gl_FragCoord.x - 0.5f;
+	float y = gl_FragCoord.y - 0.5f;
+	x -= 250.0f;
+	y -= 250.0f;
+	x/=500.0f;
+	y/=500.0f;
+	return vec2(x,y);
+}
+void main()
+{
+	vec3 origin = u_Camera_Position.xyz;
+	float dist_to_canvas = 0.5f;
+	vec3 direction = vec3(CoordConversion(),dist_to_canvas);
+	direction = (vec4(direction,1.0f) * u_Camera_Rotation_Matrix_X * u_Camera_Rotation_Matrix_Y).xyz;
+
+	// Same bounce loop as default.frag
+	vec3 color = vec3(0.0f,0.0f,0.0f);
+	float throughput = 1.0f;
+	float t_min = 1.0f;
+	for (int bounce = 0; bounce <= u_Max_Bounces; bounce++){
+		float closest_t = FLT_MAX;
+		int closest_sphere = ClosestIntersection(origin,direction,t_min,FLT_MAX,closest_t);
+		if (closest_sphere == -1){
+			color += BACKGROUND_COLOR * throughput;
+			break;
+		}
+		vec3 point = origin + direction * closest_t;
+		vec3 point_normal = point - texelFetch(u_Sphere_Geometry, closest_sphere).xyz;
+		point_normal = point_normal/length(point_normal);
+		Material material = FetchMaterial(closest_sphere);
+		vec3 local_color = material.color * ComputeLighting(point, point_normal, -direction, material.specular);
+
+		// If out of bounces or sphere is not reflective, exit
+		float r = material.reflective;
+		if (bounce >= u_Max_Bounces || r <= 0.0f){
+			color += local_color * throughput;
+			break;
+		}
+		color += local_color * (throughput * (1.0f - r));
+		throughput *= r;
+
+)GLSL"
+R"GLSL(		// Continue with the reflected ray
+		direction = ReflectRay(-direction,point_normal);
+		origin = point;
+		t_min = 0.1f;
+	}
+	gl_FragColor = vec4(color,1.0f);
+}
+)GLSL"
+		},
+	};
+} // namespace raytrace
+#endif // RAYTRACE_EMBEDDED_SHADERS_H_
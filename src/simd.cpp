@@ -0,0 +1,33 @@
+#include "simd.h"
+
+#include <SDL.h>
+
+namespace raytrace {
+
+	SimdLevel DetectSimdLevel() {
+#ifdef RAYTRACE_X86
+		if (SDL_HasAVX512F()) {
+			return SimdLevel::kAVX512;
+		}
+		if (SDL_HasAVX2()) {
+			return SimdLevel::kAVX2;
+		}
+		if (SDL_HasSSE41()) {
+			return SimdLevel::kSSE41;
+		}
+#endif
+		return SimdLevel::kScalar;
+	}
+	const char* SimdLevelName(SimdLevel level) {
+		switch (level) {
+		case SimdLevel::kSSE41:
+			return "SSE4.1";
+		case SimdLevel::kAVX2:
+			return "AVX2";
+		case SimdLevel::kAVX512:
+			return "AVX-512";
+		default:
+			return "scalar";
+		}
+	}
+} // namespace raytrace
@@ -0,0 +1,28 @@
+#pragma once
+#ifndef RAYTRACE_SIMD_H_
+#define	RAYTRACE_SIMD_H_
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define RAYTRACE_X86 1
+#include <immintrin.h>
+#endif
+
+// MSVC lets any intrinsic through, gcc and clang need to be told per function
+#if defined(__GNUC__) || defined(__clang__)
+#define RAYTRACE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define RAYTRACE_TARGET(isa)
+#endif
+
+namespace raytrace {
+	// Widest instruction set the SIMD kernels can use on this machine, picked at runtime
+	enum class SimdLevel {
+		kScalar = 0,
+		kSSE41, // 4 floats per instruction
+		kAVX2, // 8 floats per instruction
+		kAVX512 // 16 floats per instruction
+	};
+	SimdLevel DetectSimdLevel();
+	const char* SimdLevelName(SimdLevel level);
+} // namespace raytrace
+#endif // RAYTRACE_SIMD_H_
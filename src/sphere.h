@@ -6,92 +6,91 @@
 
 #include <SDL.h>
 
+#include "sphere_store.h"
+#include "std140.h"
 #include "types.h"
 
 namespace raytrace {
+	// Handle to a sphere. Until it is added to a scene the sphere keeps its own values,
+	// afterwards it is a view into the scene's SphereStore.
 	class Sphere {
 	public:
-		const int DEFAULT_SPECULAR = 50;
-		const float DEFAULT_REFLECTIVE = 0.3f;
-		const static int SPHERE_SIZE_STD140 =
-			sizeof(vec4) // Center position			- offset - 0
-			+ sizeof(vec4) // Color					- offset - 16
-			+ sizeof(float) // Radius 20
-			+ sizeof(int) // Specular
-			+ sizeof(float) // Reflective
-			+ 4 // bring offset to 48, getting to base alignment 4N (???????????? maybe not needed)????
-			;
-		static void WriteUniformBuffer(u8* buffer_start, std::vector<std::shared_ptr<Sphere>> spheres) { // Caller is responsible for buffer size
-			int offset = 0;
-			// num_entries
-			int num_spheres = (int)spheres.size();
-			memcpy(buffer_start, &num_spheres, sizeof(int));
-			offset += 16; // pad to 16, requirement of struct
-			// spheres
-			for (int i = 0; i < (int)spheres.size(); i++) {
-				(*spheres[i]).std140_serialize(buffer_start + offset + i * SPHERE_SIZE_STD140);
+		static constexpr int DEFAULT_SPECULAR = 50;
+		static constexpr float DEFAULT_REFLECTIVE = 0.3f;
+		static const int UNIFORM_BLOCK_CAPACITY = 100; // spheres_[100] in default.frag
+		// struct Sphere in default.frag
+		using Std140 = std140::Struct<vec4, vec4, float, int, float>; // center, color, radius, specular, reflective
+		using Std140Block = std140::CountedArray<Std140, UNIFORM_BLOCK_CAPACITY>; // ubo_Spheres
+		const static int SPHERE_SIZE_STD140 = (int)Std140::SIZE;
+		// Writes the count and the spheres straight from the store's packed arrays, no more than the block holds.
+		// buffer_start must hold Std140Block::SIZE bytes.
+		static void WriteUniformBuffer(u8* buffer_start, const SphereStore& store) {
+			int num_spheres = std::min(store.Size(), UNIFORM_BLOCK_CAPACITY);
+			memcpy(buffer_start + Std140Block::COUNT_OFFSET, &num_spheres, sizeof(int));
+			for (int i = 0; i < num_spheres; i++) {
+				SerializeStd140(store, i, buffer_start + Std140Block::ARRAY_OFFSET + i * Std140Block::STRIDE);
 			}
 		}
-		// Order is as listed in SPHERE_SIZE_STD140
-		void std140_serialize(u8* dst) {
-			int offset = 0;
-
-			// Copy center position
-			vec4 center4(center);
-			memcpy(dst + offset, &center4.x, sizeof(center4.x));
-			offset += sizeof(center4.x);
-			memcpy(dst + offset, &center4.y, sizeof(center4.y));
-			offset += sizeof(center4.y);
-			memcpy(dst + offset, &center4.z, sizeof(center4.z));
-			offset += sizeof(center4.z);
-			memcpy(dst + offset, &center4.w, sizeof(center4.w));
-			offset += sizeof(center4.w);
-
-			// Color
-			vec4 color4 = color.ToFloat();
-			memcpy(dst + offset, &color4.x, sizeof(color4.x));
-			offset += sizeof(color4.x);
-			memcpy(dst + offset, &color4.y, sizeof(color4.y));
-			offset += sizeof(color4.y);
-			memcpy(dst + offset, &color4.z, sizeof(color4.z));
-			offset += sizeof(color4.z);
-			memcpy(dst + offset, &color4.w, sizeof(color4.w));
-			offset += sizeof(color4.w);
+		// Writes all Std140::SIZE bytes of sphere i, padding included
+		static void SerializeStd140(const SphereStore& store, int i, u8* dst) {
+			const SphereMaterial& material = store.GetMaterial(i);
+			memset(dst, 0, Std140::SIZE);
+			Std140::Write<0>(dst, vec4(store.GetCenter(i)));
+			Std140::Write<1>(dst, material.color.ToFloat());
+			Std140::Write<2>(dst, store.GetRadius(i));
+			Std140::Write<3>(dst, material.specular);
+			Std140::Write<4>(dst, material.reflective);
+		}
 
-			// Radius
-			memcpy(dst + offset, &radius, sizeof(radius));
-			offset += sizeof(radius);
+		Sphere(vec3 center, float radius) :Sphere(center, radius, Color(0xFF, 0x0, 0x0)) {};
+		Sphere(vec3 center, float radius, Color color) :Sphere(center, radius, color, DEFAULT_SPECULAR) {};
+		Sphere(vec3 center, float radius, Color color, int specular) :Sphere(center, radius, color, specular, DEFAULT_REFLECTIVE) {};
+		Sphere(vec3 center, float radius, Color color, int specular, float reflective) :center_(center), radius_(radius), material_({ color, specular, reflective }) {};
 
-			// Specular
-			memcpy(dst + offset, &specular, sizeof(specular));
-			offset += sizeof(specular);
 
-			// Reflective
-			memcpy(dst + offset, &reflective, sizeof(reflective));
-			offset += sizeof(reflective);
+		Sphere(float x, float y, float z, float radius) :Sphere(vec3(x, y, z), radius) {};
+		Sphere(float x, float y, float z, float radius, Color color) :Sphere(vec3(x, y, z), radius, color) {};
+		Sphere(float x, float y, float z, float radius, Color color, int specular) :Sphere(vec3(x, y, z), radius, color, specular) {};
+		Sphere(float x, float y, float z, float radius, Color color, int specular, float reflective) :Sphere(vec3(x, y, z), radius, color, specular, reflective) {};
 
+		// Moves the sphere's values into store, from then on every access goes through the store
+		void Bind(SphereStore* store) {
+			index_ = store->Add(GetCenter(), GetRadius(), GetMaterial());
+			store_ = store;
 		}
-		
-		Sphere(vec3 center, float radius) :center(center), radius(radius), color(Color(0xFF,0x0,0x0)), specular(DEFAULT_SPECULAR), reflective(DEFAULT_REFLECTIVE) {};
-		Sphere(vec3 center, float radius, Color color) :center(center), radius(radius), color(color), specular(DEFAULT_SPECULAR), reflective(DEFAULT_REFLECTIVE) {};
-		Sphere(vec3 center, float radius, Color color, int specular) :center(center), radius(radius), color(color), specular(specular), reflective(DEFAULT_REFLECTIVE) {};
-		Sphere(vec3 center, float radius, Color color, int specular, float reflective) :center(center), radius(radius), color(color), specular(specular), reflective(reflective) {};
-
-
-		Sphere(float x, float y, float z, float radius) :center(vec3(x,y,z)), radius(radius), color(Color(0xFF, 0x0, 0x0)), specular(DEFAULT_SPECULAR), reflective(DEFAULT_REFLECTIVE) {};
-		Sphere(float x, float y, float z, float radius, Color color) :center(vec3(x, y, z)), radius(radius), color(color), specular(DEFAULT_SPECULAR), reflective(DEFAULT_REFLECTIVE) {};
-		Sphere(float x, float y, float z, float radius, Color color, int specular) :center(vec3(x, y, z)), radius(radius), color(color), specular(specular), reflective(DEFAULT_REFLECTIVE) {};
-		Sphere(float x, float y, float z, float radius, Color color, int specular, float reflective) :center(vec3(x, y, z)), radius(radius), color(color), specular(specular), reflective(reflective) {};
-
+		bool IsBound() const { return store_ != nullptr; };
+		int GetIndex() const { return index_; };
 
+		vec3 GetCenter() const { return store_ ? store_->GetCenter(index_) : center_; };
+		void SetCenter(vec3 center) {
+			if (store_) { store_->SetCenter(index_, center); }
+			else { center_ = center; }
+		}
+		float GetRadius() const { return store_ ? store_->GetRadius(index_) : radius_; };
+		void SetRadius(float radius) {
+			if (store_) { store_->SetRadius(index_, radius); }
+			else { radius_ = radius; }
+		}
+		const SphereMaterial& GetMaterial() const { return store_ ? store_->GetMaterial(index_) : material_; };
+		Color GetColor() const { return GetMaterial().color; };
+		void SetColor(Color color) { MutableMaterial().color = color; };
+		int GetSpecular() const { return GetMaterial().specular; };
+		void SetSpecular(int specular) { MutableMaterial().specular = specular; };
+		float GetReflective() const { return GetMaterial().reflective; };
+		void SetReflective(float reflective) { MutableMaterial().reflective = reflective; };
 
-		vec3 center; // position of the sphere
-		Color color;
-		float radius;
-		int specular; // Specular exponent, ~500 is shiny, ~10 is a little bit shiny.
-		float reflective; // How much the sphere reflects light [0.0, 1.0]
 	private:
+		SphereMaterial& MutableMaterial() { return store_ ? store_->MutableMaterial(index_) : material_; };
+
+		SphereStore* store_ = nullptr;
+		int index_ = -1;
 
+		// Only used until the sphere is bound to a store
+		vec3 center_; // position of the sphere
+		float radius_;
+		SphereMaterial material_;
 	};
+	static_assert(Sphere::Std140::OFFSETS[1] == 16 && Sphere::Std140::OFFSETS[2] == 32 && Sphere::Std140::OFFSETS[3] == 36 && Sphere::Std140::OFFSETS[4] == 40
+		&& Sphere::Std140::SIZE == 48 && Sphere::Std140Block::ARRAY_OFFSET == 16, "Sphere layout doesn't match default.frag");
 } // namespace raytrace
 #endif // RAYTRACE_SPHERE_H_
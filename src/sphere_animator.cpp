@@ -0,0 +1,89 @@
+#include "sphere_animator.h"
+
+#include <algorithm>
+
+#include "fast_math.h"
+#include "profiler.h"
+
+namespace raytrace {
+
+	void SphereAnimator::Add(float orbit_radius, float orbit_angle, float orbit_speed, float height, float bob_phase, float color_weight) {
+		orbit_radius_.push_back(orbit_radius);
+		orbit_angle_.push_back(orbit_angle);
+		orbit_speed_.push_back(orbit_speed);
+		height_.push_back(height);
+		bob_phase_.push_back(bob_phase);
+		color_weight_.push_back(color_weight);
+	}
+
+	void SphereAnimator::SetThreadCount(int num_threads) {
+		num_threads_ = std::max(1, num_threads);
+		if (thread_pool_ && thread_pool_->GetThreadCount() != num_threads_) {
+			thread_pool_.reset();
+		}
+	}
+
+	void SphereAnimator::Evaluate(const Frame& frame, SphereStore& store) {
+		RAYTRACE_PROFILE_SCOPE("SphereAnimator::Evaluate");
+		MutableSpheres spheres = store.MutableRange(first_sphere_, Size());
+		if (Size() < PARALLEL_MIN_SPHERES || num_threads_ == 1) {
+			EvaluateRange(frame, spheres, 0, Size());
+			return;
+		}
+		if (!thread_pool_) {
+			thread_pool_ = std::make_unique<ThreadPool>(num_threads_);
+		}
+		int num_chunks = (Size() + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK;
+		thread_pool_->ParallelFor(num_chunks, [&](int chunk) {
+			int begin = chunk * PARALLEL_CHUNK;
+			EvaluateRange(frame, spheres, begin, std::min(begin + PARALLEL_CHUNK, Size()));
+		});
+	}
+
+	void SphereAnimator::EvaluateRange(const Frame& frame, const MutableSpheres& spheres, int begin, int end) const {
+		int i = begin;
+#ifdef RAYTRACE_X86
+		const __m128 orbit_angle = _mm_set1_ps(frame.orbit_angle);
+		const __m128 bob_angle = _mm_set1_ps(frame.bob_angle);
+		const __m128 bob_phase_scale = _mm_set1_ps(frame.bob_phase_scale);
+		const __m128 bob_amplitude = _mm_set1_ps(frame.bob_amplitude);
+		const __m128 center_x = _mm_set1_ps(frame.orbit_center.x);
+		const __m128 center_y = _mm_set1_ps(frame.orbit_center.y);
+		const __m128 center_z = _mm_set1_ps(frame.orbit_center.z);
+		for (; i + 4 <= end; i += 4) {
+			__m128 angle = _mm_add_ps(_mm_loadu_ps(&orbit_angle_[i]), _mm_mul_ps(_mm_loadu_ps(&orbit_speed_[i]), orbit_angle));
+			__m128 sin_angle;
+			__m128 cos_angle;
+			SinCosFast4(angle, sin_angle, cos_angle);
+			__m128 radius = _mm_loadu_ps(&orbit_radius_[i]);
+			__m128 bob = SinFast4(_mm_add_ps(bob_angle, _mm_mul_ps(bob_phase_scale, _mm_loadu_ps(&bob_phase_[i]))));
+			__m128 y = _mm_add_ps(_mm_add_ps(center_y, _mm_loadu_ps(&height_[i])), _mm_mul_ps(bob_amplitude, bob));
+			_mm_storeu_ps(spheres.center_x + i, _mm_add_ps(center_x, _mm_mul_ps(radius, cos_angle)));
+			_mm_storeu_ps(spheres.center_y + i, y);
+			_mm_storeu_ps(spheres.center_z + i, _mm_add_ps(center_z, _mm_mul_ps(radius, sin_angle)));
+		}
+#endif
+		// What's left past the last group of 4, or everything without SSE
+		for (; i < end; i++) {
+			float sin_angle;
+			float cos_angle;
+			SinCosFast(orbit_angle_[i] + orbit_speed_[i] * frame.orbit_angle, sin_angle, cos_angle);
+			float bob = SinFast(frame.bob_angle + frame.bob_phase_scale * bob_phase_[i]);
+			spheres.center_x[i] = frame.orbit_center.x + orbit_radius_[i] * cos_angle;
+			spheres.center_y[i] = (frame.orbit_center.y + height_[i]) + frame.bob_amplitude * bob;
+			spheres.center_z[i] = frame.orbit_center.z + orbit_radius_[i] * sin_angle;
+		}
+		// Materials are 12 byte structs, there's nothing to gain from SIMD writing them
+		if (frame.set_color) {
+			for (int j = begin; j < end; j++) {
+				float weight = color_weight_[j];
+				spheres.materials[j].color = Color((u8)(frame.color.x * weight), (u8)(frame.color.y * weight), (u8)(frame.color.z * weight));
+			}
+		}
+		if (frame.set_reflective) {
+			for (int j = begin; j < end; j++) {
+				spheres.materials[j].reflective = frame.reflective;
+			}
+		}
+	}
+} // namespace raytrace
@@ -0,0 +1,68 @@
+#pragma once
+#ifndef RAYTRACE_SPHERE_ANIMATOR_H_
+#define	RAYTRACE_SPHERE_ANIMATOR_H_
+
+#include <memory>
+#include <vector>
+
+#include "sphere_store.h"
+#include "thread_pool.h"
+#include "types.h"
+
+namespace raytrace {
+	// Animates a run of spheres that circle the Y axis and bob up and down, all of them in one pass over packed
+	// per-sphere parameters instead of a Mat4 and a few sin/cos calls per sphere. Sphere i ends up at
+	//   angle = orbit_angle[i] + orbit_speed[i] * frame.orbit_angle
+	//   x = frame.orbit_center.x + orbit_radius[i] * cos(angle)
+	//   y = frame.orbit_center.y + height[i] + frame.bob_amplitude * sin(frame.bob_angle + frame.bob_phase_scale * bob_phase[i])
+	//   z = frame.orbit_center.z + orbit_radius[i] * sin(angle)
+	// and can get a color of frame.color * color_weight[i] and frame.reflective. The trig is SinCosFast 4 spheres at a
+	// time, big runs are split over a thread pool.
+	class SphereAnimator {
+	public:
+		// Runs shorter than this stay on the calling thread, work is handed out PARALLEL_CHUNK spheres at a time
+		static const int PARALLEL_MIN_SPHERES = 16384;
+		static const int PARALLEL_CHUNK = 4096;
+
+		// What changes every frame, shared by all the spheres. Angles are in radians.
+		struct Frame {
+			vec3 orbit_center = vec3(0.0f, 0.0f, 0.0f);
+			float orbit_angle = 0.0f;
+			float bob_angle = 0.0f;
+			float bob_phase_scale = 1.0f;
+			float bob_amplitude = 0.0f;
+			bool set_color = false;
+			vec3 color = vec3(255.0f, 255.0f, 255.0f); // 0-255 per channel, times each sphere's color_weight
+			bool set_reflective = false;
+			float reflective = 0.0f;
+		};
+
+		// Animates spheres [first_sphere, first_sphere + Size()) of a store
+		explicit SphereAnimator(int first_sphere = 0) :first_sphere_(first_sphere) {};
+
+		// Parameters of the next sphere
+		void Add(float orbit_radius, float orbit_angle, float orbit_speed = 1.0f, float height = 0.0f, float bob_phase = 0.0f, float color_weight = 1.0f);
+		int Size() const { return (int)orbit_radius_.size(); };
+		// The pool is only made once a run of PARALLEL_MIN_SPHERES is evaluated, 1 keeps everything on the calling thread
+		void SetThreadCount(int num_threads);
+
+		// Writes the spheres' centers, and colors or reflectiveness if the frame sets them, into store
+		void Evaluate(const Frame& frame, SphereStore& store);
+
+	private:
+		// Spheres [begin, end) of the run
+		void EvaluateRange(const Frame& frame, const MutableSpheres& spheres, int begin, int end) const;
+
+		int first_sphere_;
+		std::vector<float> orbit_radius_;
+		std::vector<float> orbit_angle_;
+		std::vector<float> orbit_speed_;
+		std::vector<float> height_;
+		std::vector<float> bob_phase_;
+		std::vector<float> color_weight_;
+
+		int num_threads_ = ThreadPool::DefaultThreadCount();
+		std::unique_ptr<ThreadPool> thread_pool_;
+	};
+} // namespace raytrace
+#endif // RAYTRACE_SPHERE_ANIMATOR_H_
@@ -0,0 +1,177 @@
+#pragma once
+#ifndef RAYTRACE_SPHERE_STORE_H_
+#define	RAYTRACE_SPHERE_STORE_H_
+
+#include <atomic>
+#include <vector>
+
+#include "ray_packet.h"
+#include "types.h"
+#include "util.h"
+
+namespace raytrace {
+	// Everything about a sphere that is only needed once it has been hit
+	struct SphereMaterial {
+		Color color;
+		int specular; // Specular exponent, ~500 is shiny, ~10 is a little bit shiny.
+		float reflective; // How much the sphere reflects light [0.0, 1.0]
+	};
+
+	// A store's arrays as plain pointers, all count long. Scene files hold spheres in this layout.
+	struct PackedSpheres {
+		const float* center_x = nullptr;
+		const float* center_y = nullptr;
+		const float* center_z = nullptr;
+		const float* radius = nullptr;
+		const float* radius_sq = nullptr;
+		const SphereMaterial* materials = nullptr;
+		int count = 0;
+	};
+
+	// Writable centers and materials of a run of spheres, count long
+	struct MutableSpheres {
+		float* center_x = nullptr;
+		float* center_y = nullptr;
+		float* center_z = nullptr;
+		SphereMaterial* materials = nullptr;
+		int count = 0;
+	};
+
+	// Packed storage for every sphere in a scene.
+	// Geometry lives in separate contiguous arrays so intersection loops only stream
+	// the centers and squared radii, materials are kept off to the side.
+	class SphereStore {
+	public:
+		SphereStore() :id_(next_id_++) {};
+		SphereStore(const SphereStore&) = delete;
+		SphereStore& operator=(const SphereStore&) = delete;
+
+		// Returns the index of the new sphere
+		int Add(vec3 center, float radius, const SphereMaterial& material) {
+			center_x_.push_back(center.x);
+			center_y_.push_back(center.y);
+			center_z_.push_back(center.z);
+			radius_.push_back(radius);
+			radius_sq_.push_back(radius * radius);
+			materials_.push_back(material);
+			dirty_.push_back(0);
+			MarkDirty((int)materials_.size() - 1);
+			return (int)materials_.size() - 1;
+		}
+		// Appends spheres with one copy per array, returns the index of the first one
+		int AddPacked(const PackedSpheres& spheres) {
+			int first = Size();
+			center_x_.insert(center_x_.end(), spheres.center_x, spheres.center_x + spheres.count);
+			center_y_.insert(center_y_.end(), spheres.center_y, spheres.center_y + spheres.count);
+			center_z_.insert(center_z_.end(), spheres.center_z, spheres.center_z + spheres.count);
+			radius_.insert(radius_.end(), spheres.radius, spheres.radius + spheres.count);
+			radius_sq_.insert(radius_sq_.end(), spheres.radius_sq, spheres.radius_sq + spheres.count);
+			materials_.insert(materials_.end(), spheres.materials, spheres.materials + spheres.count);
+			dirty_.resize(materials_.size(), 1);
+			generation_++;
+			dirty_list_.reserve(dirty_list_.size() + spheres.count);
+			for (int i = first; i < Size(); i++) {
+				dirty_list_.push_back(i);
+			}
+			return first;
+		}
+		int Size() const { return (int)materials_.size(); };
+		// View of every array, invalidated when spheres are added
+		PackedSpheres Packed() const {
+			PackedSpheres spheres;
+			spheres.center_x = center_x_.data();
+			spheres.center_y = center_y_.data();
+			spheres.center_z = center_z_.data();
+			spheres.radius = radius_.data();
+			spheres.radius_sq = radius_sq_.data();
+			spheres.materials = materials_.data();
+			spheres.count = Size();
+			return spheres;
+		}
+
+		vec3 GetCenter(int i) const { return vec3(center_x_[i], center_y_[i], center_z_[i]); };
+		void SetCenter(int i, vec3 center) {
+			center_x_[i] = center.x;
+			center_y_[i] = center.y;
+			center_z_[i] = center.z;
+			MarkDirty(i);
+		}
+		float GetRadius(int i) const { return radius_[i]; };
+		float GetRadiusSquared(int i) const { return radius_sq_[i]; };
+		void SetRadius(int i, float radius) {
+			radius_[i] = radius;
+			radius_sq_[i] = radius * radius;
+			MarkDirty(i);
+		}
+		const SphereMaterial& GetMaterial(int i) const { return materials_[i]; };
+		SphereMaterial& MutableMaterial(int i) {
+			MarkDirty(i);
+			return materials_[i];
+		}
+
+		// Spheres [first, first + count) for code that changes many of them at once, all of them are marked changed.
+		// Radii aren't in it since radius_sq has to follow them.
+		MutableSpheres MutableRange(int first, int count) {
+			for (int i = first; i < first + count; i++) {
+				MarkDirty(i);
+			}
+			MutableSpheres spheres;
+			spheres.center_x = center_x_.data() + first;
+			spheres.center_y = center_y_.data() + first;
+			spheres.center_z = center_z_.data() + first;
+			spheres.materials = materials_.data() + first;
+			spheres.count = count;
+			return spheres;
+		}
+
+		// Spheres added or changed since the last ClearDirty, each listed once
+		const std::vector<int>& GetDirty() const { return dirty_list_; };
+		void ClearDirty() {
+			for (int i : dirty_list_) {
+				dirty_[i] = 0;
+			}
+			dirty_list_.clear();
+		}
+
+		// Goes up whenever a sphere is added, moved, resized or gets a different material, even if the values stay the same.
+		// Unlike the dirty list nothing clears it, so anything can remember the generation it last saw.
+		u64 GetGeneration() const { return generation_; };
+		// Never the same for two stores, a store at the address of a deleted one still looks different
+		u64 GetId() const { return id_; };
+
+		// View used by the intersection kernels, invalidated when spheres are added
+		SphereGeometry Geometry() const { return Geometry(0, Size()); };
+		// View of spheres [first, first + count)
+		SphereGeometry Geometry(int first, int count) const {
+			SphereGeometry geometry;
+			geometry.center_x = center_x_.data() + first;
+			geometry.center_y = center_y_.data() + first;
+			geometry.center_z = center_z_.data() + first;
+			geometry.radius_sq = radius_sq_.data() + first;
+			geometry.count = count;
+			return geometry;
+		}
+
+	private:
+		std::vector<float> center_x_;
+		std::vector<float> center_y_;
+		std::vector<float> center_z_;
+		std::vector<float> radius_;
+		std::vector<float> radius_sq_;
+		std::vector<SphereMaterial> materials_;
+
+		void MarkDirty(int i) {
+			generation_++;
+			if (!dirty_[i]) {
+				dirty_[i] = 1;
+				dirty_list_.push_back(i);
+			}
+		}
+		std::vector<u8> dirty_;
+		std::vector<int> dirty_list_;
+		u64 generation_ = 0;
+		u64 id_;
+		static inline std::atomic<u64> next_id_ = 1;
+	};
+} // namespace raytrace
+#endif // RAYTRACE_SPHERE_STORE_H_
@@ -0,0 +1,70 @@
+#pragma once
+#ifndef RAYTRACE_STD140_H_
+#define	RAYTRACE_STD140_H_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+
+template <typename T> struct Tuple4;
+
+namespace raytrace {
+	// std140 layouts worked out at compile time. A GLSL struct is described by its member types in declaration order
+	// and the offsets, padding and size follow from the std140 rules, so nothing is counted by hand.
+	namespace std140 {
+		// Base alignment and size of the GLSL types the shaders use
+		template <typename T> struct Type;
+		template <> struct Type<float> { static constexpr size_t SIZE = 4; static constexpr size_t ALIGNMENT = 4; };
+		template <> struct Type<int> { static constexpr size_t SIZE = 4; static constexpr size_t ALIGNMENT = 4; };
+		template <> struct Type<Tuple4<float>> { static constexpr size_t SIZE = 16; static constexpr size_t ALIGNMENT = 16; }; // vec4
+
+		constexpr size_t AlignUp(size_t offset, size_t alignment) {
+			return (offset + alignment - 1) / alignment * alignment;
+		}
+
+		// A GLSL struct with the given members. Every member starts at the next multiple of its alignment,
+		// the struct itself is aligned, and padded, to a multiple of 16 bytes.
+		template <typename... Members>
+		struct Struct {
+			static constexpr size_t COUNT = sizeof...(Members);
+			static constexpr std::array<size_t, COUNT> OFFSETS = [] {
+				constexpr size_t sizes[] = { Type<Members>::SIZE... };
+				constexpr size_t alignments[] = { Type<Members>::ALIGNMENT... };
+				std::array<size_t, COUNT> offsets = {};
+				size_t offset = 0;
+				for (size_t i = 0; i < COUNT; i++) {
+					offset = AlignUp(offset, alignments[i]);
+					offsets[i] = offset;
+					offset += sizes[i];
+				}
+				return offsets;
+			}();
+			static constexpr size_t ALIGNMENT = AlignUp(std::max({ Type<Members>::ALIGNMENT... }), 16);
+			static constexpr size_t SIZE = AlignUp(OFFSETS[COUNT - 1] + std::get<COUNT - 1>(std::make_tuple(Type<Members>::SIZE...)), ALIGNMENT);
+
+			template <size_t I>
+			using Member = std::tuple_element_t<I, std::tuple<Members...>>;
+
+			// Writes member I of the struct starting at dst
+			template <size_t I>
+			static void Write(unsigned char* dst, const Member<I>& value) {
+				static_assert(sizeof(value) == Type<Member<I>>::SIZE, "C++ type doesn't match the GLSL size");
+				memcpy(dst + OFFSETS[I], &value, sizeof(value));
+			}
+		};
+
+		// A uniform block of an int count followed by an array of Capacity Entry structs, like ubo_Spheres
+		template <typename Entry, size_t Capacity>
+		struct CountedArray {
+			static constexpr size_t CAPACITY = Capacity;
+			static constexpr size_t COUNT_OFFSET = 0;
+			static constexpr size_t ARRAY_OFFSET = AlignUp(Type<int>::SIZE, Entry::ALIGNMENT);
+			static constexpr size_t STRIDE = Entry::SIZE; // Already a multiple of 16
+			static constexpr size_t SIZE = ARRAY_OFFSET + CAPACITY * STRIDE;
+		};
+	} // namespace std140
+} // namespace raytrace
+#endif // RAYTRACE_STD140_H_
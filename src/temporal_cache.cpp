@@ -0,0 +1,66 @@
+#include "temporal_cache.h"
+
+#include <cfloat>
+#include <cstring>
+#include <math.h>
+
+namespace raytrace {
+
+	void TemporalCache::BeginFrame(u64 key, int width, int height) {
+		size_t size = (size_t)width * height;
+		has_previous_ = has_previous_ && key == key_ && width == width_ && height == height_;
+		key_ = key;
+		width_ = width;
+		height_ = height;
+		frame_++;
+		if (current_.size() != size) {
+			previous_.resize(size);
+			current_.resize(size);
+		}
+		if (nearest_size_ != size) {
+			nearest_ = std::make_unique<std::atomic<u64>[]>(size);
+			nearest_size_ = size;
+		}
+		for (size_t i = 0; i < size; i++) {
+			nearest_[i].store(EMPTY, std::memory_order_relaxed);
+		}
+	}
+
+	void TemporalCache::Reproject(const CameraRayGenerator& camera, int row_start, int row_end) {
+		if (!has_previous_) {
+			return;
+		}
+		for (int row = row_start; row < row_end; row++) {
+			for (int column = 0; column < width_; column++) {
+				u32 source = (u32)((size_t)row * width_ + column);
+				const TemporalSample& sample = previous_[source];
+				// Misses are infinitely far away, only the direction matters and they lose against any surface
+				vec3 direction = sample.sphere == -1 ? sample.point : sample.point - camera.GetOrigin();
+				float x, y, depth;
+				if (!camera.Project(direction, x, y, depth)) {
+					continue;
+				}
+				int target_x = (int)floorf(x + 0.5f);
+				int target_y = (int)floorf(y + 0.5f);
+				if (target_x < 0 || target_x >= width_ || target_y < 0 || target_y >= height_) {
+					continue;
+				}
+				if (sample.sphere == -1) {
+					depth = FLT_MAX;
+				}
+				u32 depth_bits;
+				memcpy(&depth_bits, &depth, sizeof(depth_bits));
+				u64 packed = ((u64)depth_bits << 32) | source;
+				std::atomic<u64>& nearest = nearest_[(size_t)target_y * width_ + target_x];
+				u64 current = nearest.load(std::memory_order_relaxed);
+				while (packed < current && !nearest.compare_exchange_weak(current, packed, std::memory_order_relaxed)) {
+				}
+			}
+		}
+	}
+
+	void TemporalCache::EndFrame() {
+		std::swap(previous_, current_);
+		has_previous_ = true;
+	}
+} // namespace raytrace
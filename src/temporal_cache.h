@@ -0,0 +1,80 @@
+#pragma once
+#ifndef RAYTRACE_TEMPORAL_CACHE_H_
+#define	RAYTRACE_TEMPORAL_CACHE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "camera_ray_generator.h"
+#include "types.h"
+
+namespace raytrace {
+	// What the camera ray of one pixel saw, kept around for the next frame
+	// Reused samples are copied as they are, so point and origin stay where the color was traced
+	struct TemporalSample {
+		vec3 point; // World space hit point, the ray direction for a miss
+		int sphere; // SphereStore index, -1 for a miss
+		HdrColor color;
+		vec3 origin; // Camera position the color was traced from
+	};
+
+	// Lets a CPU frame reuse the pixels of the previous one after the camera moved.
+	// Every sample of the last frame is projected into the new camera and the nearest one landing on a pixel
+	// is kept for it. The renderer decides whether the pixel can really reuse it, anything else is traced.
+	class TemporalCache {
+	public:
+		// A pixel is traced again after at most this many frames even if it could be reused,
+		// so view dependent shading like highlights and reflections doesn't lag behind for long
+		static const int REFRESH_INTERVAL = 8;
+		// A sample is traced again once the camera moved this many pixel widths, measured at the sample's
+		// distance, away from where it was traced
+		static constexpr float MAX_CAMERA_MOVE = 4.0f;
+
+		// key covers everything besides the camera that changes how pixels look, the previous
+		// frame is only kept if it was rendered with the same key at the same size
+		void BeginFrame(u64 key, int width, int height);
+		bool HasPrevious() const { return has_previous_; };
+		void Clear() { has_previous_ = false; };
+		// Projects the previous frame's samples from rows [row_start, row_end) into this frame's camera.
+		// Different row ranges can be projected on different threads at the same time.
+		void Reproject(const CameraRayGenerator& camera, int row_start, int row_end);
+		// The previous sample that landed on pixel (x, y). Samples spread apart where the camera got closer,
+		// a pixel nothing landed on gets the nearest sample of its four neighbours. nullptr if there is none.
+		const TemporalSample* Reprojected(int x, int y) const {
+			u64 nearest = Nearest(x, y);
+			if (nearest == EMPTY) {
+				nearest = std::min(std::min(Nearest(x - 1, y), Nearest(x + 1, y)), std::min(Nearest(x, y - 1), Nearest(x, y + 1)));
+			}
+			return nearest == EMPTY ? nullptr : &previous_[(u32)nearest];
+		}
+		bool NeedsRefresh(int x, int y) const { return (x + y * 3 + frame_) % REFRESH_INTERVAL == 0; };
+		void Store(int x, int y, const TemporalSample& sample) { current_[(size_t)y * width_ + x] = sample; };
+		// The samples stored during this frame become the previous frame
+		void EndFrame();
+
+	private:
+		static const u64 EMPTY = ~0ull;
+
+		u64 Nearest(int x, int y) const {
+			if (x < 0 || x >= width_ || y < 0 || y >= height_) {
+				return EMPTY;
+			}
+			return nearest_[(size_t)y * width_ + x].load(std::memory_order_relaxed);
+		}
+
+		u64 key_ = 0;
+		int width_ = 0;
+		int height_ = 0;
+		int frame_ = 0;
+		bool has_previous_ = false;
+		std::vector<TemporalSample> previous_;
+		std::vector<TemporalSample> current_;
+		// Per pixel of this frame the view depth bits of the nearest sample in the high half and its index
+		// in previous_ in the low half, so an atomic min keeps the nearest one. Positive floats sort like their bits.
+		std::unique_ptr<std::atomic<u64>[]> nearest_;
+		size_t nearest_size_ = 0;
+	};
+} // namespace raytrace
+#endif // RAYTRACE_TEMPORAL_CACHE_H_
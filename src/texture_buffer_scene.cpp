@@ -0,0 +1,169 @@
+#include "texture_buffer_scene.h"
+
+#include <iostream>
+
+#include "scene.h"
+
+namespace raytrace {
+
+	int TextureBufferScene::Init(Shader& shader) {
+		shader_ = &shader;
+		GLuint program = shader_->GetProgramID();
+		u_num_nodes_ = glGetUniformLocation(program, "u_Num_Nodes");
+		u_num_lights_ = glGetUniformLocation(program, "u_Num_Lights");
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels_);
+
+		// Called again whenever the program is rebuilt, the texture buffers and what they hold outlive it
+		if (sphere_geometry_.texture == 0) {
+			sphere_geometry_ = CreateTextureBuffer(GL_RGBA32F);
+			sphere_materials_ = CreateTextureBuffer(GL_RGBA32F);
+			bvh_nodes_ = CreateTextureBuffer(GL_RGBA32UI);
+			lights_ = CreateTextureBuffer(GL_RGBA32F);
+			uploaded_scene_ = nullptr;
+		}
+
+		// Samplers only need to be pointed at their units once
+		shader_->Enable();
+		glUniform1i(glGetUniformLocation(program, "u_Sphere_Geometry"), SPHERE_GEOMETRY_UNIT);
+		glUniform1i(glGetUniformLocation(program, "u_Sphere_Materials"), SPHERE_MATERIAL_UNIT);
+		glUniform1i(glGetUniformLocation(program, "u_Bvh_Nodes"), BVH_NODE_UNIT);
+		glUniform1i(glGetUniformLocation(program, "u_Lights"), LIGHT_UNIT);
+		return 0;
+	}
+
+	TextureBufferScene::TextureBuffer TextureBufferScene::CreateTextureBuffer(GLenum format) {
+		TextureBuffer texture_buffer;
+		glGenBuffers(1, &texture_buffer.buffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, texture_buffer.buffer);
+		glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_DYNAMIC_DRAW); // One texel so an empty scene still has storage
+		glGenTextures(1, &texture_buffer.texture);
+		glBindTexture(GL_TEXTURE_BUFFER, texture_buffer.texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, texture_buffer.buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		return texture_buffer;
+	}
+
+	// Reallocating orphans the old storage, a frame still reading it doesn't hold up the upload
+	void TextureBufferScene::Upload(const TextureBuffer& texture_buffer, const void* data, size_t size) {
+		glBindBuffer(GL_TEXTURE_BUFFER, texture_buffer.buffer);
+		glBufferData(GL_TEXTURE_BUFFER, size > 0 ? size : 16, size > 0 ? data : NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	void TextureBufferScene::Write(const Scene& scene) {
+		// Runs every GPU frame, the scene is only asked whether it changed
+		u64 key = scene.ChangeKey();
+		if (&scene != uploaded_scene_ || key != uploaded_key_) {
+			const SphereStore& store = scene.sphere_store_;
+			const Bvh& bvh = scene.bvh_;
+			int num_spheres = store.Size();
+			if (num_spheres > MAX_SPHERES) {
+				std::cout << "Scene has more than " << MAX_SPHERES << " spheres, they aren't drawn" << std::endl;
+				num_spheres = 0;
+			}
+
+			// Spheres in leaf order, a leaf is one run of texels
+			geometry_data_.resize((size_t)num_spheres * 4);
+			material_data_.resize((size_t)num_spheres * 4);
+			for (int p = 0; p < num_spheres; p++) {
+				int sphere = bvh.SphereIndex(p);
+				vec3 center = store.GetCenter(sphere);
+				const SphereMaterial& material = store.GetMaterial(sphere);
+				float* geometry = &geometry_data_[(size_t)p * 4];
+				geometry[0] = center.x;
+				geometry[1] = center.y;
+				geometry[2] = center.z;
+				geometry[3] = store.GetRadius(sphere);
+				float* packed_material = &material_data_[(size_t)p * 4];
+				packed_material[0] = (float)(material.color.r * 65536 + material.color.g * 256 + material.color.b); // Below 2^24, exact
+				packed_material[1] = (float)material.specular;
+				packed_material[2] = material.reflective;
+				packed_material[3] = 0.0f;
+			}
+
+			node_data_.clear();
+			num_nodes_ = 0;
+			if (num_spheres > 0 && !bvh.GetNodes().empty()) {
+				FlattenNode(bvh.GetNodes(), 0);
+			}
+
+			num_lights_ = (int)scene.lights.size();
+			light_data_.resize((size_t)num_lights_ * 8);
+			for (int i = 0; i < num_lights_; i++) {
+				const Light& light = *scene.lights[i];
+				float* texels = &light_data_[(size_t)i * 8];
+				texels[0] = light.position.x;
+				texels[1] = light.position.y;
+				texels[2] = light.position.z;
+				texels[3] = light.intensity;
+				texels[4] = light.direction.x;
+				texels[5] = light.direction.y;
+				texels[6] = light.direction.z;
+				texels[7] = (float)light.type;
+			}
+
+			// Out of range texels read as 0, the shader would walk a cut off tree, so like MAX_SPHERES nothing is drawn
+			if (num_spheres > max_texels_ || num_nodes_ * 2 > max_texels_) {
+				std::cout << "Scene is larger than GL_MAX_TEXTURE_BUFFER_SIZE (" << max_texels_ << " texels), its spheres aren't drawn" << std::endl;
+				geometry_data_.clear();
+				material_data_.clear();
+				node_data_.clear();
+				num_nodes_ = 0;
+			}
+			if (num_lights_ * 2 > max_texels_) {
+				std::cout << "Scene has more lights than GL_MAX_TEXTURE_BUFFER_SIZE (" << max_texels_ << " texels) holds, they aren't used" << std::endl;
+				light_data_.clear();
+				num_lights_ = 0;
+			}
+			Upload(sphere_geometry_, geometry_data_.data(), geometry_data_.size() * sizeof(float));
+			Upload(sphere_materials_, material_data_.data(), material_data_.size() * sizeof(float));
+			Upload(bvh_nodes_, node_data_.data(), node_data_.size() * sizeof(u32));
+			Upload(lights_, light_data_.data(), light_data_.size() * sizeof(float));
+			uploaded_scene_ = &scene;
+			uploaded_key_ = key;
+		}
+
+		shader_->Enable();
+		glUniform1i(u_num_nodes_, num_nodes_);
+		glUniform1i(u_num_lights_, num_lights_);
+		const TextureBuffer* units[] = { &sphere_geometry_, &sphere_materials_, &bvh_nodes_, &lights_ };
+		const int unit_indices[] = { SPHERE_GEOMETRY_UNIT, SPHERE_MATERIAL_UNIT, BVH_NODE_UNIT, LIGHT_UNIT };
+		for (int i = 0; i < 4; i++) {
+			glActiveTexture(GL_TEXTURE0 + unit_indices[i]);
+			glBindTexture(GL_TEXTURE_BUFFER, units[i]->texture);
+		}
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	void TextureBufferScene::Forget(const Scene* scene) {
+		if (uploaded_scene_ == scene) {
+			uploaded_scene_ = nullptr;
+		}
+	}
+
+	void TextureBufferScene::FlattenNode(const std::vector<BvhNode>& bvh_nodes, int node) {
+		const BvhNode& source = bvh_nodes[node];
+		auto append = [&](u32 leaf) {
+			size_t texel = node_data_.size();
+			node_data_.resize(texel + 8);
+			memcpy(&node_data_[texel], source.bounds_min, sizeof(source.bounds_min));
+			memcpy(&node_data_[texel + 4], source.bounds_max, sizeof(source.bounds_max));
+			node_data_[texel + 7] = leaf;
+			return num_nodes_++;
+		};
+		if (source.count > 0) {
+			for (int first = source.first; first < source.first + source.count; first += MAX_LEAF_COUNT) {
+				int count = std::min(MAX_LEAF_COUNT, source.first + source.count - first);
+				int index = append(((u32)first << 8) | (u32)count);
+				node_data_[(size_t)index * 8 + 3] = (u32)(index + 1);
+			}
+			return;
+		}
+		int index = append(0);
+		// The left child follows its parent, the right child follows the left subtree
+		FlattenNode(bvh_nodes, source.first);
+		FlattenNode(bvh_nodes, source.first + 1);
+		node_data_[(size_t)index * 8 + 3] = (u32)num_nodes_;
+	}
+} // namespace raytrace
@@ -0,0 +1,74 @@
+#pragma once
+#ifndef RAYTRACE_TEXTURE_BUFFER_SCENE_H_
+#define	RAYTRACE_TEXTURE_BUFFER_SCENE_H_
+
+#include <vector>
+
+#include "GL/glew.h"
+
+#include "bvh.h"
+#include "shader.h"
+#include "types.h"
+
+namespace raytrace {
+	class Scene;
+
+	// GPU scene data without a fixed entry count, for texture_buffer.frag.
+	// Spheres, their materials, the lights and the scene's BVH live in buffer textures the shader reads with texelFetch.
+	// Spheres are stored in BVH leaf order and the BVH is flattened depth first, every node knows the node that follows
+	// its subtree, so the shader walks the tree without a stack:
+	//   texel 0: bounds min, node after this subtree (taken when the bounds are missed)
+	//   texel 1: bounds max, (first sphere << 8) | sphere count for leaves, 0 for interior nodes
+	class TextureBufferScene {
+	public:
+		static const int MAX_LEAF_COUNT = 255; // Bigger leaves are split into several nodes with the same bounds
+		static const int MAX_SPHERES = 1 << 24; // First sphere of a leaf has 24 bits
+
+		// Texture units the buffers are bound to
+		static const int SPHERE_GEOMETRY_UNIT = 0;
+		static const int SPHERE_MATERIAL_UNIT = 1;
+		static const int BVH_NODE_UNIT = 2;
+		static const int LIGHT_UNIT = 3;
+
+		int Init(Shader& shader);
+		bool IsInitialized() const { return shader_ != nullptr; };
+		Shader* GetShader() const { return shader_; };
+		// Uploads the scene if it changed since the last call and binds the textures, the scene's BVH must be up to date.
+		// Leaves shader enabled with its scene uniforms set.
+		void Write(const Scene& scene);
+		// Call when scene goes away, another scene could be created at the same address
+		void Forget(const Scene* scene);
+
+	private:
+		struct TextureBuffer {
+			GLuint buffer = 0;
+			GLuint texture = 0;
+		};
+		static TextureBuffer CreateTextureBuffer(GLenum format);
+		static void Upload(const TextureBuffer& texture_buffer, const void* data, size_t size);
+		// Appends node and its subtree from bvh_nodes in depth first order
+		void FlattenNode(const std::vector<BvhNode>& bvh_nodes, int node);
+
+		Shader* shader_ = nullptr;
+		GLint u_num_nodes_ = -1;
+		GLint u_num_lights_ = -1;
+		GLint max_texels_ = 0;
+
+		TextureBuffer sphere_geometry_; // RGBA32F center.xyz, radius
+		TextureBuffer sphere_materials_; // RGBA32F r * 65536 + g * 256 + b, specular, reflective, 0
+		TextureBuffer bvh_nodes_; // RGBA32UI, two texels per node
+		TextureBuffer lights_; // RGBA32F position.xyz, intensity and direction.xyz, type
+
+		// CPU copies, kept to avoid reallocating every upload
+		std::vector<float> geometry_data_;
+		std::vector<float> material_data_;
+		std::vector<u32> node_data_;
+		std::vector<float> light_data_;
+		int num_nodes_ = 0;
+		int num_lights_ = 0;
+
+		const Scene* uploaded_scene_ = nullptr;
+		u64 uploaded_key_ = 0; // Scene::ChangeKey of uploaded_scene_ when it was uploaded
+	};
+} // namespace raytrace
+#endif // RAYTRACE_TEXTURE_BUFFER_SCENE_H_
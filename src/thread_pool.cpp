@@ -0,0 +1,118 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace raytrace {
+
+	ThreadPool::ThreadPool(int num_threads) {
+		num_threads = std::max(1, num_threads);
+		for (int i = 0; i < num_threads; i++) {
+			queues_.emplace_back(std::make_unique<WorkQueue>());
+		}
+		// The calling thread owns the last queue, so spawn one less worker
+		for (int i = 0; i < num_threads - 1; i++) {
+			workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+		}
+	}
+	ThreadPool::~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		wake_workers_.notify_all();
+		for (std::thread& worker : workers_) {
+			worker.join();
+		}
+	}
+	int ThreadPool::DefaultThreadCount() {
+		int hardware_threads = (int)std::thread::hardware_concurrency();
+		return std::max(1, hardware_threads);
+	}
+
+	void ThreadPool::ParallelFor(int num_tasks, const std::function<void(int)>& task) {
+		if (num_tasks <= 0) {
+			return;
+		}
+		if (workers_.empty()) {
+			for (int i = 0; i < num_tasks; i++) {
+				task(i);
+			}
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			// task_ has to be visible before any index can be popped
+			task_ = &task;
+			tasks_remaining_ = num_tasks;
+
+			// Hand out contiguous runs so neighbouring tasks start on the same thread,
+			// stealing evens it out from there.
+			int num_queues = (int)queues_.size();
+			for (int q = 0; q < num_queues; q++) {
+				int begin = (int)((u64)num_tasks * q / num_queues);
+				int end = (int)((u64)num_tasks * (q + 1) / num_queues);
+				std::lock_guard<std::mutex> queue_lock(queues_[q]->mutex);
+				for (int i = begin; i < end; i++) {
+					queues_[q]->tasks.push_back(i);
+				}
+			}
+			generation_++;
+		}
+		wake_workers_.notify_all();
+
+		RunTasks((int)queues_.size() - 1);
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		work_done_.wait(lock, [this] { return tasks_remaining_ == 0; });
+	}
+
+	void ThreadPool::WorkerLoop(int queue_index) {
+		u64 seen_generation = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				wake_workers_.wait(lock, [&] { return stop_ || generation_ != seen_generation; });
+				if (stop_) {
+					return;
+				}
+				seen_generation = generation_;
+			}
+			RunTasks(queue_index);
+		}
+	}
+
+	void ThreadPool::RunTasks(int queue_index) {
+		int task_index = 0;
+		while (PopTask(queue_index, task_index)) {
+			(*task_)(task_index);
+			if (tasks_remaining_.fetch_sub(1) == 1) {
+				std::lock_guard<std::mutex> lock(mutex_);
+				work_done_.notify_all();
+			}
+		}
+	}
+
+	// Takes from the front of our own queue first, then steals from the back of the others
+	bool ThreadPool::PopTask(int queue_index, int& task_index) {
+		{
+			WorkQueue& own = *queues_[queue_index];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.tasks.empty()) {
+				task_index = own.tasks.front();
+				own.tasks.pop_front();
+				return true;
+			}
+		}
+		int num_queues = (int)queues_.size();
+		for (int i = 1; i < num_queues; i++) {
+			WorkQueue& victim = *queues_[(queue_index + i) % num_queues];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tasks.empty()) {
+				task_index = victim.tasks.back();
+				victim.tasks.pop_back();
+				return true;
+			}
+		}
+		return false;
+	}
+} // namespace raytrace
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef RAYTRACE_THREAD_POOL_H_
+#define	RAYTRACE_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "types.h"
+
+namespace raytrace {
+	// Persistent pool of worker threads that share work through per-thread queues.
+	// Each thread pops tasks from the front of its own queue and steals from the back
+	// of the other queues once it runs dry, so uneven tiles still balance out.
+	class ThreadPool {
+	public:
+		// num_threads includes the calling thread, so 1 means no worker threads are spawned
+		explicit ThreadPool(int num_threads);
+		~ThreadPool();
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// Runs task(i) for every i in [0, num_tasks) and blocks until all of them finished.
+		// The calling thread takes part in the work.
+		void ParallelFor(int num_tasks, const std::function<void(int)>& task);
+		int GetThreadCount() const { return (int)queues_.size(); };
+
+		static int DefaultThreadCount();
+
+	private:
+		struct WorkQueue {
+			std::mutex mutex;
+			std::deque<int> tasks;
+		};
+		void WorkerLoop(int queue_index);
+		bool PopTask(int queue_index, int& task_index);
+		void RunTasks(int queue_index);
+
+		std::vector<std::unique_ptr<WorkQueue>> queues_; // Last queue belongs to the calling thread
+		std::vector<std::thread> workers_;
+		const std::function<void(int)>* task_ = nullptr;
+		std::atomic<int> tasks_remaining_ = 0;
+
+		std::mutex mutex_;
+		std::condition_variable wake_workers_;
+		std::condition_variable work_done_;
+		u64 generation_ = 0;
+		bool stop_ = false;
+	};
+} // namespace raytrace
+#endif // RAYTRACE_THREAD_POOL_H_
@@ -0,0 +1,43 @@
+#pragma once
+#ifndef RAYTRACE_TRACE_CONTEXT_H_
+#define	RAYTRACE_TRACE_CONTEXT_H_
+
+#include <algorithm>
+#include <cfloat>
+
+#include "render_stats.h"
+#include "types.h"
+
+namespace raytrace {
+	// Remembers the sphere that last blocked a shadow ray toward each light. Neighbouring pixels
+	// are usually blocked by the same sphere, so it is tested on its own before the full query.
+	class OccluderCache {
+	public:
+		static const int MAX_LIGHTS = 16; // Lights past this are never cached
+
+		OccluderCache() { std::fill(sphere_, sphere_ + MAX_LIGHTS, -1); };
+		// Returns -1 if nothing has blocked this light yet
+		int Get(int light) const { return light < MAX_LIGHTS ? sphere_[light] : -1; };
+		void Set(int light, int sphere) {
+			if (light < MAX_LIGHTS) {
+				sphere_[light] = sphere;
+			}
+		}
+
+	private:
+		int sphere_[MAX_LIGHTS];
+	};
+
+	// The first thing a camera ray hit, for callers that need more than its color
+	struct PrimaryHit {
+		int sphere = -1; // -1 when the ray missed everything
+		float t = FLT_MAX;
+	};
+
+	// Scratch state of one thread while it renders a tile, never shared between threads
+	struct TraceContext {
+		RenderStats stats;
+		OccluderCache occluder_cache;
+	};
+} // namespace raytrace
+#endif // RAYTRACE_TRACE_CONTEXT_H_
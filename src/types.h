@@ -1,9 +1,15 @@
 #pragma once
 #ifndef RAYTRACE_TYPES_H_
 #define	RAYTRACE_TYPES_H_
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <vector>
+
+#include "std140.h"
 using u8 = std::uint8_t;
 using u16 = std::uint16_t;
 using u32 = std::uint32_t;
@@ -15,39 +21,39 @@ template <typename T> struct Tuple3 {
 	T z;
 	Tuple3() :x(0), y(0), z(0) {  }
 	Tuple3(T x_, T y_, T z_) :x(x_), y(y_), z(z_) {};
-	Tuple3 operator+(Tuple3 const& obj) {
+	Tuple3 operator+(Tuple3 const& obj) const {
 		Tuple3 res;
 		res.x = x + obj.x;
 		res.y = y + obj.y;
 		res.z = z + obj.z;
 		return res;
 	}
-	Tuple3 operator-() {
+	Tuple3 operator-() const {
 		Tuple3 res;
 		res.x = x * -1.0f;
 		res.y = y * -1.0f;
 		res.z = z * -1.0f;
 		return res;
 	}
-	Tuple3 operator-(Tuple3 const& obj) {
+	Tuple3 operator-(Tuple3 const& obj) const {
 		Tuple3 res;
 		res.x = x - obj.x;
 		res.y = y - obj.y;
 		res.z = z - obj.z;
 		return res;
 	}
-	Tuple3 operator*(float const& f) {
+	Tuple3 operator*(float const& f) const {
 		Tuple3 res;
 		res.x = x * f;
 		res.y = y * f;
 		res.z = z * f;
 		return res;
 	}
-	friend Tuple3 operator*(const float& s, Tuple3& t) {
+	friend Tuple3 operator*(const float& s, Tuple3 const& t) {
 		return t * s;
 	}
 	
-	Tuple3 operator/(float const& f) {
+	Tuple3 operator/(float const& f) const {
 		Tuple3 res;
 		res.x = x / f;
 		res.y = y / f;
@@ -55,10 +61,10 @@ template <typename T> struct Tuple3 {
 		return res;
 	}
 	
-	T dot(Tuple3 const& obj){
+	T dot(Tuple3 const& obj) const {
 		return x * obj.x + y * obj.y + z * obj.z;
 	}
-	Tuple3 Normalized() {
+	Tuple3 Normalized() const {
 		return *this / Length(*this);
 	}
 	static float Length(Tuple3 t) {
@@ -91,6 +97,15 @@ public:
 	Mat4(float values[4][4]){
 		std::memcpy(values_, values, (u64)4*(u64)4*sizeof(float));
 	}
+	static Mat4 Identity() {
+		float identity[4][4] = {
+			{1, 0, 0, 0},
+			{0, 1, 0, 0},
+			{0, 0, 1, 0},
+			{0, 0, 0, 1}
+		};
+		return Mat4(identity);
+	}
 	
 	void Print() const{
 		std::cout << "=========================================\n";
@@ -107,7 +122,7 @@ public:
 		std::cout << "=========================================\n";
 
 	}
-	vec3 operator*(const vec3& v) {
+	vec3 operator*(const vec3& v) const {
 		vec3 res;
 		res.x = v.x * values_[0][0] + v.y * values_[0][1] + v.z * values_[0][2];
 		res.y = v.x * values_[1][0] + v.y * values_[1][1] + v.z * values_[1][2];
@@ -127,22 +142,17 @@ struct Light {
 	LightType type;
 	float intensity;
 	Light() = delete;
-	const static int LIGHT_SIZE_STD140 =
-		sizeof(vec4) // position			- offset - 0
-		+ sizeof(vec4) // direction			- offset - 16
-		+ sizeof(type) //
-		+ sizeof(intensity) // 
-		+ 8 // bring offset to 48, getting to base alignment 4N (???????????? maybe not needed)????
-		;
-	static void WriteUniformBuffer(u8* buffer_start, std::vector<std::shared_ptr<Light>> lights) { // Caller is responsible for buffer size
-		int offset = 0;
-		// num_entries
-		int num_lights = (int)lights.size();
-		memcpy(buffer_start, &num_lights, sizeof(int));
-		offset += 16; // pad to 16, requirement of struct
-		// lights
-		for (int i = 0; i < lights.size(); i++) {
-			(*lights[i]).std140_serialize(buffer_start + offset + i * Light::LIGHT_SIZE_STD140);
+	static const int UNIFORM_BLOCK_CAPACITY = 100; // lights_[100] in default.frag
+	// struct Light in default.frag
+	using Std140 = raytrace::std140::Struct<vec4, vec4, int, float>; // position, direction, type, intensity
+	using Std140Block = raytrace::std140::CountedArray<Std140, UNIFORM_BLOCK_CAPACITY>; // ubo_Lights
+	const static int LIGHT_SIZE_STD140 = (int)Std140::SIZE;
+	// Writes the count and the lights, no more than the block holds. buffer_start must hold Std140Block::SIZE bytes.
+	static void WriteUniformBuffer(u8* buffer_start, const std::vector<std::shared_ptr<Light>>& lights) {
+		int num_lights = (int)std::min(lights.size(), Std140Block::CAPACITY);
+		memcpy(buffer_start + Std140Block::COUNT_OFFSET, &num_lights, sizeof(int));
+		for (int i = 0; i < num_lights; i++) {
+			lights[i]->std140_serialize(buffer_start + Std140Block::ARRAY_OFFSET + i * Std140Block::STRIDE);
 		}
 	}
 	static Light AmbientLight(float intensity) {
@@ -154,55 +164,33 @@ struct Light {
 	static Light DirectionalLight(float intensity, vec3 direction) {
 		return Light(LightType::kDirectional, intensity, vec3(0, 0, 0), direction);
 	}
-	void std140_serialize(u8* dst) {
-		int offset = 0;
-
-		// Position
-		vec4 position4(position);
-		memcpy(dst + offset, &position4.x, sizeof(position4.x));
-		offset += sizeof(position4.x);
-		memcpy(dst + offset, &position4.y, sizeof(position4.y));
-		offset += sizeof(position4.y);
-		memcpy(dst + offset, &position4.z, sizeof(position4.z));
-		offset += sizeof(position4.z);
-		memcpy(dst + offset, &position4.w, sizeof(position4.w));
-		offset += sizeof(position4.w);
-
-		// Direction
-		vec4 direction4(direction);
-		memcpy(dst + offset, &direction4.x, sizeof(direction4.x));
-		offset += sizeof(direction4.x);
-		memcpy(dst + offset, &direction4.y, sizeof(direction4.y));
-		offset += sizeof(direction4.y);
-		memcpy(dst + offset, &direction4.z, sizeof(direction4.z));
-		offset += sizeof(direction4.z);
-		memcpy(dst + offset, &direction4.w, sizeof(direction4.w));
-		offset += sizeof(direction4.w);
-
-		// Light type
-		memcpy(dst + offset, &type, sizeof(type));
-		offset += sizeof(type);
-
-		// Intensity
-		memcpy(dst + offset, &intensity, sizeof(intensity));
-		offset += sizeof(intensity);
+	// Writes all Std140::SIZE bytes, padding included
+	void std140_serialize(u8* dst) const {
+		memset(dst, 0, Std140::SIZE);
+		Std140::Write<0>(dst, vec4(position));
+		Std140::Write<1>(dst, vec4(direction));
+		Std140::Write<2>(dst, (int)type);
+		Std140::Write<3>(dst, intensity);
 	}
 
 private:
 	Light(LightType type, float intensity, vec3 position, vec3 direction) :type(type), intensity(intensity), position(position), direction(direction) {}
 };
+static_assert(Light::Std140::OFFSETS[1] == 16 && Light::Std140::OFFSETS[2] == 32 && Light::Std140::OFFSETS[3] == 36
+	&& Light::Std140::SIZE == 48 && Light::Std140Block::ARRAY_OFFSET == 16, "Light layout doesn't match default.frag");
 struct Color {
 	u8 r;
 	u8 g;
 	u8 b;
 	u8 a;
 
+	Color() :r(0), g(0), b(0), a(0xFF) {};
 	Color(u8 red, u8 green, u8 blue, u8 alpha) :r(red), g(green), b(blue), a(alpha) {};
 	Color(u8 red, u8 green, u8 blue) :r(red), g(green), b(blue), a(0xFF) {};
-	u8 Clamp(int val) {
+	u8 Clamp(int val) const {
 		return (u8)std::max(0, std::min(val, 255));
 	}
-	Color operator*(float const& f) {
+	Color operator*(float const& f) const {
 		u8 nr = Clamp((int)((float)r * f));
 		u8 ng = Clamp((int)((float)g * f));
 		u8 nb = Clamp((int)((float)b * f));
@@ -210,13 +198,17 @@ struct Color {
 
 		return Color((u8)nr, (u8)ng, (u8)nb, (u8)na);
 	}
-	Color operator+(Color const& c) {
-
-		return Color(r + c.r, g + c.g, b + c.b, a);
+	Color operator+(Color const& c) const {
+		return Color(Clamp(r + c.r), Clamp(g + c.g), Clamp(b + c.b), a);
 	}
-	vec4 ToFloat() {
+	vec4 ToFloat() const {
 		return vec4((float)r / 255.0f, (float)g / 255.0f, (float)b / 255.0f);
 	}
-	u32 xrgb_pixel = ((u32)a << 24) | ((u32)r << 16) | ((u32)g << 8) | ((u32)b);
+	Tuple3<float> ToHdr() const {
+		return Tuple3<float>((float)r / 255.0f, (float)g / 255.0f, (float)b / 255.0f);
+	}
 };
+// Linear RGB the CPU renderer accumulates light in, 1.0 is full brightness and nothing is clamped
+// until the frame is quantized to 8 bits
+using HdrColor = Tuple3<float>;
 #endif
\ No newline at end of file
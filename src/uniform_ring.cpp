@@ -0,0 +1,110 @@
+#include "uniform_ring.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace raytrace {
+
+	int UniformRing::Init(int entry_size, int max_entries) {
+		if (entry_size <= 0 || max_entries <= 0) {
+			std::cout << "Uniform ring needs a positive entry size and count" << std::endl;
+			return -1;
+		}
+		entry_size_ = entry_size;
+		max_entries_ = max_entries;
+		staging_.assign(GetSize(), 0);
+		entry_frame_.assign(max_entries, 0);
+
+		glGenBuffers(RING_SIZE, buffers_);
+		for (int i = 0; i < RING_SIZE; i++) {
+			glBindBuffer(GL_UNIFORM_BUFFER, buffers_[i]);
+			glBufferData(GL_UNIFORM_BUFFER, GetSize(), NULL, GL_DYNAMIC_DRAW);
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		Invalidate();
+		return 0;
+	}
+
+	void UniformRing::WriteCount(int count) {
+		if (memcmp(staging_.data(), &count, sizeof(int)) != 0) {
+			memcpy(staging_.data(), &count, sizeof(int));
+			header_frame_ = frame_;
+		}
+	}
+
+	void UniformRing::WriteEntry(int index, const u8* entry) {
+		u8* staged = staging_.data() + HEADER_SIZE + index * entry_size_;
+		if (index >= entries_used_) {
+			entries_used_ = index + 1;
+		}
+		else if (memcmp(staged, entry, entry_size_) == 0) {
+			return;
+		}
+		memcpy(staged, entry, entry_size_);
+		entry_frame_[index] = frame_;
+	}
+
+	void UniformRing::WriteEntries(int first, int count, const u8* entries) {
+		for (int i = 0; i < count; i++) {
+			WriteEntry(first + i, entries + i * entry_size_);
+		}
+	}
+
+	void UniformRing::Invalidate() {
+		header_frame_ = frame_;
+		for (int i = 0; i < max_entries_; i++) {
+			entry_frame_[i] = frame_;
+		}
+	}
+
+	void UniformRing::Upload(GLuint binding_point) {
+		current_ = (current_ + 1) % RING_SIZE;
+		// With RING_SIZE buffers this frame's buffer was last drawn from RING_SIZE - 1 frames ago,
+		// so the fence has almost always passed by now
+		if (fences_[current_]) {
+			glClientWaitSync(fences_[current_], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+			glDeleteSync(fences_[current_]);
+			fences_[current_] = 0;
+		}
+
+		// Coalesce runs of changed entries into one upload each, the header sits right before entry 0
+		glBindBuffer(GL_UNIFORM_BUFFER, buffers_[current_]);
+		last_upload_bytes_ = 0;
+		u64 since = buffer_frame_[current_];
+		int run_begin = header_frame_ > since ? 0 : -1;
+		for (int i = 0; i < entries_used_; i++) {
+			int offset = HEADER_SIZE + i * entry_size_;
+			bool changed = entry_frame_[i] > since;
+			if (changed && run_begin < 0) {
+				run_begin = offset;
+			}
+			else if (!changed && run_begin >= 0) {
+				UploadRange(run_begin, offset);
+				run_begin = -1;
+			}
+		}
+		if (run_begin >= 0) {
+			UploadRange(run_begin, HEADER_SIZE + entries_used_ * entry_size_);
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, binding_point, buffers_[current_]);
+
+		buffer_frame_[current_] = frame_;
+		frame_++;
+	}
+
+	void UniformRing::UploadRange(int begin, int end) {
+		glBufferSubData(GL_UNIFORM_BUFFER, begin, end - begin, staging_.data() + begin);
+		last_upload_bytes_ += end - begin;
+	}
+
+	void UniformRing::Fence() {
+		if (!GLEW_ARB_sync) { // Sync objects are core in 3.2, without them the driver orders the writes itself
+			return;
+		}
+		if (fences_[current_]) {
+			glDeleteSync(fences_[current_]);
+		}
+		fences_[current_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+} // namespace raytrace
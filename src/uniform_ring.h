@@ -0,0 +1,62 @@
+#pragma once
+#ifndef RAYTRACE_UNIFORM_RING_H_
+#define	RAYTRACE_UNIFORM_RING_H_
+
+#include <vector>
+
+#include "GL/glew.h"
+
+#include "types.h"
+
+namespace raytrace {
+	// A std140 uniform block made of a 16 byte header and an array of fixed size entries, kept in RING_SIZE
+	// buffers that are used round robin. Every frame writes the buffer the GPU used longest ago, so uploads
+	// don't wait on the frame that is still being drawn.
+	// The block is staged on the CPU and every entry remembers the frame it last changed in,
+	// a buffer is only sent the entries that changed since it was last used.
+	class UniformRing {
+	public:
+		static const int RING_SIZE = 3;
+		static const int HEADER_SIZE = 16; // The entry count, padded to the struct alignment
+		// Upper bound on waiting for the GPU to release a buffer
+		static const u64 FENCE_TIMEOUT_NS = 1000000000;
+
+		int Init(int entry_size, int max_entries);
+		int GetMaxEntries() const { return max_entries_; };
+		int GetSize() const { return HEADER_SIZE + entry_size_ * max_entries_; };
+
+		// Staging, a write only counts as a change when the bytes differ from what is staged
+		void WriteCount(int count);
+		void WriteEntry(int index, const u8* entry); // entry_size bytes, index must be below max_entries
+		// count consecutive entries starting at first
+		void WriteEntries(int first, int count, const u8* entries);
+		// Sends the whole block to every buffer again
+		void Invalidate();
+
+		// Moves to the next buffer, uploads what changed since it was last used and binds it to binding_point
+		void Upload(GLuint binding_point);
+		// Call once the draw reading the current buffer is issued, the buffer isn't written again until it finishes
+		void Fence();
+
+		// Bytes sent by the last Upload
+		int GetLastUploadBytes() const { return last_upload_bytes_; };
+
+	private:
+		void UploadRange(int begin, int end);
+
+		int entry_size_ = 0;
+		int max_entries_ = 0;
+		int entries_used_ = 0; // Highest entry ever written + 1, nothing past it needs uploading
+		std::vector<u8> staging_;
+		u64 header_frame_ = 0; // Frame the count last changed in
+		std::vector<u64> entry_frame_; // Frame each entry last changed in
+
+		GLuint buffers_[RING_SIZE] = {};
+		GLsync fences_[RING_SIZE] = {};
+		u64 buffer_frame_[RING_SIZE] = {}; // Staging frame each buffer was last brought up to, 0 when never written
+		int current_ = RING_SIZE - 1;
+		u64 frame_ = 1;
+		int last_upload_bytes_ = 0;
+	};
+} // namespace raytrace
+#endif // RAYTRACE_UNIFORM_RING_H_
@@ -1,3 +1,4 @@
+#include <cstring>
 #include <iostream>
 #include <SDL.h>
 #include "util.h"
@@ -50,4 +51,20 @@ namespace raytrace {
 		};
 		return Mat4(m);
 	}
+	u64 HashBytes(const void* data, size_t size, u64 hash) {
+		// FNV-1a over 8 byte words, every step is invertible so a changed word can't cancel out on its own
+		const u8* bytes = (const u8*)data;
+		const u64 prime = 0x100000001B3ull;
+		size_t i = 0;
+		for (; i + sizeof(u64) <= size; i += sizeof(u64)) {
+			u64 word;
+			memcpy(&word, bytes + i, sizeof(u64));
+			hash = (hash ^ word) * prime;
+			hash ^= hash >> 29;
+		}
+		for (; i < size; i++) {
+			hash = (hash ^ bytes[i]) * prime;
+		}
+		return hash;
+	}
 }// namespace raytrace
\ No newline at end of file
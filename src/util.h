@@ -11,6 +11,8 @@ namespace raytrace {
 	Mat4 RotationAboutX(float degrees);
 	Mat4 RotationAboutY(float degrees);
 	Mat4 RotationAboutZ(float degrees);
+	// Cheap non-cryptographic hash for noticing that something changed, chain calls by passing the previous hash
+	u64 HashBytes(const void* data, size_t size, u64 hash = 0xCBF29CE484222325ull);
 
 }// namespace raytrace
 #endif // RAYTRACE_UTIL_H_
\ No newline at end of file